@@ -33,6 +33,7 @@
 #include "pk-alpm-config.h"
 #include "pk-alpm-databases.h"
 #include "pk-alpm-error.h"
+#include "pk-alpm-index.h"
 
 // bad API choice
 static gchar *xfercmd = NULL;
@@ -45,6 +46,8 @@ typedef struct
 	 gchar			*arch, *cleanmethod, *dbpath, *gpgdir, *logfile,
 				*root, *xfercmd;
 
+	 guint			 paralleldownloads;
+
 	 alpm_list_t		*cachedirs, *holdpkgs, *ignoregroups,
 				*ignorepkgs, *localfilesiglevels, *noextracts,
 				*noupgrades, *remotefilesiglevels, *hookdirs;
@@ -291,6 +294,15 @@ pk_alpm_config_set_logfile (PkAlpmConfig *config, const gchar *filename)
 	config->logfile = g_strdup (filename);
 }
 
+static void
+pk_alpm_config_set_paralleldownloads (PkAlpmConfig *config, const gchar *number)
+{
+	g_return_if_fail (config != NULL);
+	g_return_if_fail (number != NULL);
+
+	config->paralleldownloads = g_ascii_strtoull (number, NULL, 10);
+}
+
 static void
 pk_alpm_config_set_root (PkAlpmConfig *config, const gchar *path)
 {
@@ -325,6 +337,7 @@ static const PkAlpmConfigString pk_alpm_config_string_options[] = {
 	{ "DBPath", pk_alpm_config_set_dbpath },
 	{ "GPGDir", pk_alpm_config_set_gpgdir },
 	{ "LogFile", pk_alpm_config_set_logfile },
+	{ "ParallelDownloads", pk_alpm_config_set_paralleldownloads },
 	{ "RootDir", pk_alpm_config_set_root },
 	{ "XferCommand", pk_alpm_config_set_xfercmd },
 	{ NULL, NULL }
@@ -618,10 +631,6 @@ pk_alpm_config_parse (PkAlpmConfig *config, const gchar *filename,
 			continue;
 		}
 
-		if (g_strcmp0 (key, "ParallelDownloads") == 0 && str != NULL) {
-			continue;
-		}
-
 		if (g_strcmp0 (key, "Usage") == 0 && str != NULL) {
 			continue;
 		}
@@ -865,6 +874,7 @@ pk_alpm_config_configure_repos (PkBackend *backend, PkAlpmConfig *config,
 
 			db = alpm_register_syncdb (handle, repo->name, repo_level);
 			alpm_db_set_servers (db, alpm_list_strdup (repo->servers));
+			pk_alpm_index_register (backend, handle, db);
 		}
 	}
 
@@ -984,6 +994,10 @@ pk_alpm_config_configure_alpm (PkBackend *backend, PkAlpmConfig *config, GError
 	alpm_option_set_checkspace (handle, config->checkspace);
 	alpm_option_set_usesyslog (handle, config->usesyslog);
 
+	/* databases and packages are downloaded concurrently */
+	if (config->paralleldownloads > 0)
+		alpm_option_set_parallel_downloads (handle, config->paralleldownloads);
+
 	arches = g_strsplit (config->arch, ",", -1);
 	for (i = 0; arches[i]; i++) {
 		arches_list = alpm_list_add (arches_list, arches[i]);
@@ -25,6 +25,7 @@
 #include "pk-alpm-config.h"
 #include "pk-alpm-databases.h"
 #include "pk-alpm-error.h"
+#include "pk-alpm-index.h"
 
 typedef struct
 {
@@ -39,6 +40,7 @@ pk_alpm_disabled_repos_configure (PkBackend *backend, gboolean only_trusted, GEr
 	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
 	const alpm_list_t *i;
 
+	pk_alpm_index_invalidate_syncdbs (backend, priv->alpm);
 	if (alpm_unregister_all_syncdbs (priv->alpm) < 0) {
 		alpm_errno_t alpm_err = alpm_errno (priv->alpm);
 		g_set_error_literal (error, PK_ALPM_ERROR, alpm_err,
@@ -66,6 +68,7 @@ pk_alpm_disabled_repos_configure (PkBackend *backend, gboolean only_trusted, GEr
 		}
 
 		alpm_db_set_servers (db, alpm_list_strdup (repo->servers));
+		pk_alpm_index_register (backend, priv->alpm, db);
 	}
 
 	return TRUE;
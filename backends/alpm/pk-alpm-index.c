@@ -0,0 +1,992 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "pk-backend-alpm.h"
+#include "pk-alpm-index.h"
+
+#define PK_ALPM_APPLICATIONS_DIR	"usr/share/applications/"
+
+/* stamp of the sync database, then name, version, arch, description,
+ * licenses, provides and whether the package is an application */
+#define PK_ALPM_SEARCH_INDEX_TYPE	"(sa(ssssasasb))"
+
+/* stamps of the sync and local databases, then one byte per package */
+#define PK_ALPM_INSTALLED_INDEX_TYPE	"(ssay)"
+
+/* separates the name, description and licenses in the details text */
+#define PK_ALPM_SEARCH_FIELD_SEPARATOR	'\x1f'
+
+typedef struct {
+	const gchar	*name;
+	const gchar	*version;
+	const gchar	*arch;
+	const gchar	*desc;
+	gboolean	 application;
+	gboolean	 installed;
+} PkAlpmSearchEntry;
+
+/*
+ * The packages of a sync database in the order of its package cache. The
+ * strings point into the serialized data, which is kept on disk and only
+ * rebuilt when the database file changes. Names and details are also kept
+ * casefolded in one text each, one line per package, so a term is found
+ * with a single scan instead of a regex per package.
+ */
+typedef struct {
+	GVariant	*data;
+	gchar		*stamp;
+	gchar		*local_stamp;
+	gchar		*repo;
+	gchar		*folded_repo;
+	GArray		*entries;
+	GString		*names;
+	GArray		*name_offsets;
+	GString		*details;
+	GArray		*detail_offsets;
+	GHashTable	*provides;
+} PkAlpmSearchIndex;
+
+/*
+ * Every path of every package in a database, sorted so that exact paths and
+ * directories are found with a binary search, and the owners of each file
+ * name. The strings belong to the file lists of the packages.
+ */
+typedef struct {
+	const gchar	*path;
+	alpm_pkg_t	*pkg;
+} PkAlpmFileEntry;
+
+typedef struct {
+	GArray		*paths;
+	GHashTable	*basenames;
+} PkAlpmFileIndex;
+
+/*
+ * Everything derived from the packages of one database. An index is valid
+ * until the package cache of its database is reloaded, so it must be
+ * invalidated whenever alpm updates, unregisters or commits to the database.
+ */
+typedef struct {
+	GHashTable		*applications;
+	PkAlpmSearchIndex	*search;
+	PkAlpmFileIndex		*files;
+	gchar			*files_stamp;
+	gchar			*loaded_stamp;
+} PkAlpmIndex;
+
+static void
+pk_alpm_file_index_free (PkAlpmFileIndex *files)
+{
+	g_array_unref (files->paths);
+	g_hash_table_unref (files->basenames);
+	g_free (files);
+}
+
+static void
+pk_alpm_search_index_free (PkAlpmSearchIndex *search)
+{
+	g_variant_unref (search->data);
+	g_free (search->stamp);
+	g_free (search->local_stamp);
+	g_free (search->repo);
+	g_free (search->folded_repo);
+	g_array_unref (search->entries);
+	g_string_free (search->names, TRUE);
+	g_array_unref (search->name_offsets);
+	g_string_free (search->details, TRUE);
+	g_array_unref (search->detail_offsets);
+	g_hash_table_unref (search->provides);
+	g_free (search);
+}
+
+static void
+pk_alpm_index_free (PkAlpmIndex *db_index)
+{
+	if (db_index->applications != NULL)
+		g_hash_table_unref (db_index->applications);
+	if (db_index->search != NULL)
+		pk_alpm_search_index_free (db_index->search);
+	if (db_index->files != NULL)
+		pk_alpm_file_index_free (db_index->files);
+	g_free (db_index->files_stamp);
+	g_free (db_index->loaded_stamp);
+	g_free (db_index);
+}
+
+static PkAlpmIndex *
+pk_alpm_index_get (PkBackend *backend, alpm_db_t *db)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	PkAlpmIndex *db_index;
+
+	if (priv->indexes == NULL) {
+		priv->indexes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+						       (GDestroyNotify) pk_alpm_index_free);
+	}
+
+	db_index = g_hash_table_lookup (priv->indexes, db);
+	if (db_index == NULL) {
+		db_index = g_new0 (PkAlpmIndex, 1);
+		g_hash_table_insert (priv->indexes, db, db_index);
+	}
+	return db_index;
+}
+
+static gboolean
+pk_alpm_filelist_has_application (alpm_filelist_t *files)
+{
+	gsize lower = 0, upper = files->count;
+
+	/* file lists are sorted, so the desktop files are all in one run */
+	while (lower < upper) {
+		gsize middle = lower + (upper - lower) / 2;
+		if (strcmp (files->files[middle].name, PK_ALPM_APPLICATIONS_DIR) < 0)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	for (; lower < files->count; ++lower) {
+		const gchar *file = files->files[lower].name;
+
+		if (!g_str_has_prefix (file, PK_ALPM_APPLICATIONS_DIR))
+			break;
+		if (g_str_has_suffix (file, ".desktop"))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static GHashTable *
+pk_alpm_index_get_applications (PkBackend *backend, alpm_db_t *db)
+{
+	PkAlpmIndex *db_index = pk_alpm_index_get (backend, db);
+	const alpm_list_t *i;
+
+	if (db_index->applications != NULL)
+		return db_index->applications;
+
+	/* loads the file lists once for the whole database */
+	db_index->applications = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = alpm_db_get_pkgcache (db); i != NULL; i = i->next) {
+		if (pk_alpm_filelist_has_application (alpm_pkg_get_files (i->data)))
+			g_hash_table_add (db_index->applications, i->data);
+	}
+
+	g_debug ("indexed %u applications in %s",
+		 g_hash_table_size (db_index->applications), alpm_db_get_name (db));
+	return db_index->applications;
+}
+
+gboolean
+pk_alpm_index_pkg_is_application (PkBackend *backend, alpm_pkg_t *pkg)
+{
+	alpm_db_t *db;
+
+	g_return_val_if_fail (pkg != NULL, FALSE);
+
+	/* packages loaded from a file don't belong to any database */
+	db = alpm_pkg_get_db (pkg);
+	if (db == NULL)
+		return pk_alpm_filelist_has_application (alpm_pkg_get_files (pkg));
+
+	return g_hash_table_contains (pk_alpm_index_get_applications (backend, db), pkg);
+}
+
+static gchar *
+pk_alpm_index_stamp (const gchar *path)
+{
+	GStatBuf buf;
+
+	/* downloads keep the modification time of the server */
+	if (g_stat (path, &buf) < 0)
+		return NULL;
+
+	return g_strdup_printf ("%" G_GINT64_FORMAT ":%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+				(gint64) buf.st_mtime, (guint64) buf.st_size,
+				(guint64) buf.st_nlink);
+}
+
+static gchar *
+pk_alpm_index_db_stamp (alpm_handle_t *handle, alpm_db_t *db)
+{
+	g_autofree gchar *path = NULL;
+
+	path = g_strconcat (alpm_option_get_dbpath (handle), "sync/",
+			    alpm_db_get_name (db), alpm_option_get_dbext (handle), NULL);
+	return pk_alpm_index_stamp (path);
+}
+
+static gchar *
+pk_alpm_index_local_stamp (PkBackend *backend)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	g_autofree gchar *path = NULL;
+	gchar *stamp;
+
+	/* the directory changes whenever a package is added or removed */
+	path = g_build_filename (alpm_option_get_dbpath (priv->alpm), "local", NULL);
+	stamp = pk_alpm_index_stamp (path);
+	return stamp != NULL ? stamp : g_strdup ("");
+}
+
+static gchar *
+pk_alpm_index_filename (alpm_handle_t *handle, const gchar *repo, const gchar *suffix)
+{
+	g_autofree gchar *checksum = NULL;
+
+	/* the update check keeps its own copy of the databases */
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1,
+						  alpm_option_get_dbpath (handle), -1);
+	checksum[8] = '\0';
+	return g_strconcat (PK_ALPM_CACHE_DIR, repo, "-", checksum, suffix, NULL);
+}
+
+static GVariant *
+pk_alpm_index_load (const gchar *filename, const gchar *type)
+{
+	g_autoptr(GMappedFile) file = NULL;
+	g_autoptr(GBytes) bytes = NULL;
+
+	file = g_mapped_file_new (filename, FALSE, NULL);
+	if (file == NULL)
+		return NULL;
+
+	bytes = g_mapped_file_get_bytes (file);
+	return g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (type), bytes, FALSE));
+}
+
+static void
+pk_alpm_index_save (const gchar *filename, GVariant *data)
+{
+	g_autoptr(GError) error = NULL;
+
+	if (g_mkdir_with_parents (PK_ALPM_CACHE_DIR, 0755) < 0) {
+		g_warning ("failed to create %s: %s", PK_ALPM_CACHE_DIR, g_strerror (errno));
+		return;
+	}
+
+	if (!g_file_set_contents (filename, g_variant_get_data (data),
+				  g_variant_get_size (data), &error)) {
+		g_warning ("failed to save %s: %s", filename, error->message);
+	}
+}
+
+static GVariant *
+pk_alpm_search_index_build (PkBackend *backend, alpm_db_t *db, const gchar *stamp)
+{
+	GVariantBuilder entries;
+	const alpm_list_t *i, *j;
+
+	g_variant_builder_init (&entries, G_VARIANT_TYPE ("a(ssssasasb)"));
+	for (i = alpm_db_get_pkgcache (db); i != NULL; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		const gchar *arch = alpm_pkg_get_arch (pkg);
+		const gchar *desc = alpm_pkg_get_desc (pkg);
+		GVariantBuilder licenses, provides;
+
+		g_variant_builder_init (&licenses, G_VARIANT_TYPE_STRING_ARRAY);
+		for (j = alpm_pkg_get_licenses (pkg); j != NULL; j = j->next)
+			g_variant_builder_add (&licenses, "s", j->data);
+
+		g_variant_builder_init (&provides, G_VARIANT_TYPE_STRING_ARRAY);
+		for (j = alpm_pkg_get_provides (pkg); j != NULL; j = j->next) {
+			alpm_depend_t *provide = j->data;
+			g_variant_builder_add (&provides, "s", provide->name);
+		}
+
+		g_variant_builder_add (&entries, "(ssssasasb)",
+				       alpm_pkg_get_name (pkg),
+				       alpm_pkg_get_version (pkg),
+				       arch != NULL ? arch : "any",
+				       desc != NULL ? desc : "",
+				       &licenses, &provides,
+				       pk_alpm_index_pkg_is_application (backend, pkg));
+	}
+
+	return g_variant_ref_sink (g_variant_new (PK_ALPM_SEARCH_INDEX_TYPE, stamp, &entries));
+}
+
+static void
+pk_alpm_search_append_folded (GString *text, const gchar *value)
+{
+	g_autofree gchar *folded = g_utf8_casefold (value, -1);
+	g_string_append (text, folded);
+}
+
+static PkAlpmSearchIndex *
+pk_alpm_search_index_new (alpm_db_t *db, GVariant *data)
+{
+	PkAlpmSearchIndex *search = g_new0 (PkAlpmSearchIndex, 1);
+	g_autoptr(GVariant) entries = NULL;
+	gsize n_entries;
+	guint k, offset;
+
+	search->data = g_variant_ref (data);
+	g_variant_get (data, "(s@a(ssssasasb))", &search->stamp, &entries);
+	search->repo = g_strdup (alpm_db_get_name (db));
+	search->folded_repo = g_utf8_casefold (search->repo, -1);
+
+	n_entries = g_variant_n_children (entries);
+	search->entries = g_array_sized_new (FALSE, FALSE, sizeof (PkAlpmSearchEntry), n_entries);
+	search->names = g_string_new (NULL);
+	search->name_offsets = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_entries + 1);
+	search->details = g_string_new (NULL);
+	search->detail_offsets = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_entries + 1);
+	search->provides = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						  (GDestroyNotify) g_array_unref);
+
+	for (k = 0; k < n_entries; k++) {
+		PkAlpmSearchEntry entry = { NULL };
+		g_autoptr(GVariant) licenses = NULL;
+		g_autoptr(GVariant) provides = NULL;
+		GVariantIter iter;
+		const gchar *value;
+
+		g_variant_get_child (entries, k, "(&s&s&s&s@as@asb)",
+				     &entry.name, &entry.version, &entry.arch, &entry.desc,
+				     &licenses, &provides, &entry.application);
+		g_array_append_val (search->entries, entry);
+
+		offset = search->names->len;
+		g_array_append_val (search->name_offsets, offset);
+		pk_alpm_search_append_folded (search->names, entry.name);
+		g_string_append_c (search->names, '\n');
+
+		offset = search->details->len;
+		g_array_append_val (search->detail_offsets, offset);
+		pk_alpm_search_append_folded (search->details, entry.name);
+		g_string_append_c (search->details, PK_ALPM_SEARCH_FIELD_SEPARATOR);
+		pk_alpm_search_append_folded (search->details, entry.desc);
+		g_variant_iter_init (&iter, licenses);
+		while (g_variant_iter_next (&iter, "&s", &value)) {
+			g_string_append_c (search->details, PK_ALPM_SEARCH_FIELD_SEPARATOR);
+			pk_alpm_search_append_folded (search->details, value);
+		}
+		g_string_append_c (search->details, '\n');
+
+		/* provides are matched as whole tokens */
+		g_variant_iter_init (&iter, provides);
+		while (g_variant_iter_next (&iter, "&s", &value)) {
+			GArray *matches = g_hash_table_lookup (search->provides, value);
+
+			if (matches == NULL) {
+				matches = g_array_new (FALSE, FALSE, sizeof (guint));
+				g_hash_table_insert (search->provides, (gpointer) value, matches);
+			}
+			if (matches->len == 0 || g_array_index (matches, guint, matches->len - 1) != k)
+				g_array_append_val (matches, k);
+		}
+	}
+
+	/* the end of the last line */
+	offset = search->names->len;
+	g_array_append_val (search->name_offsets, offset);
+	offset = search->details->len;
+	g_array_append_val (search->detail_offsets, offset);
+
+	return search;
+}
+
+static void
+pk_alpm_search_index_update_installed (PkBackend *backend, alpm_handle_t *handle,
+				       PkAlpmSearchIndex *search, const gchar *local_stamp)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	g_autofree gchar *filename = NULL;
+	g_autofree guint8 *installed = NULL;
+	g_autoptr(GVariant) data = NULL;
+	guint k, n_entries = search->entries->len;
+
+	filename = pk_alpm_index_filename (handle, search->repo, ".installed");
+	data = pk_alpm_index_load (filename, PK_ALPM_INSTALLED_INDEX_TYPE);
+	if (data != NULL) {
+		const gchar *stamp, *saved_local_stamp;
+		g_autoptr(GVariant) column = NULL;
+		const guint8 *saved;
+		gsize n_saved;
+
+		g_variant_get (data, "(&s&s@ay)", &stamp, &saved_local_stamp, &column);
+		saved = g_variant_get_fixed_array (column, &n_saved, sizeof (guint8));
+		if (g_strcmp0 (stamp, search->stamp) == 0 &&
+		    g_strcmp0 (saved_local_stamp, local_stamp) == 0 &&
+		    n_saved == n_entries) {
+			for (k = 0; k < n_entries; k++)
+				g_array_index (search->entries, PkAlpmSearchEntry, k).installed = saved[k];
+			goto out;
+		}
+		g_clear_pointer (&data, g_variant_unref);
+	}
+
+	/* the same version of the package is installed */
+	installed = g_new0 (guint8, n_entries);
+	for (k = 0; k < n_entries; k++) {
+		PkAlpmSearchEntry *entry = &g_array_index (search->entries, PkAlpmSearchEntry, k);
+		alpm_pkg_t *local = alpm_db_get_pkg (priv->localdb, entry->name);
+		const gchar *arch;
+
+		entry->installed = FALSE;
+		if (local == NULL)
+			continue;
+		if (alpm_pkg_vercmp (alpm_pkg_get_version (local), entry->version) != 0)
+			continue;
+		arch = alpm_pkg_get_arch (local);
+		if (g_strcmp0 (arch != NULL ? arch : "any", entry->arch) != 0)
+			continue;
+
+		entry->installed = installed[k] = TRUE;
+	}
+
+	data = g_variant_ref_sink (g_variant_new ("(ss@ay)", search->stamp, local_stamp,
+						  g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+									     installed, n_entries,
+									     sizeof (guint8))));
+	pk_alpm_index_save (filename, data);
+out:
+	g_free (search->local_stamp);
+	search->local_stamp = g_strdup (local_stamp);
+}
+
+static PkAlpmSearchIndex *
+pk_alpm_index_get_search (PkBackend *backend, alpm_handle_t *handle, alpm_db_t *db)
+{
+	PkAlpmIndex *db_index = pk_alpm_index_get (backend, db);
+	g_autofree gchar *stamp = NULL;
+	g_autofree gchar *local_stamp = NULL;
+
+	/* the database was never downloaded */
+	stamp = pk_alpm_index_db_stamp (handle, db);
+	if (stamp == NULL)
+		return NULL;
+
+	if (db_index->search != NULL && g_strcmp0 (db_index->search->stamp, stamp) != 0)
+		g_clear_pointer (&db_index->search, pk_alpm_search_index_free);
+
+	if (db_index->search == NULL) {
+		g_autofree gchar *filename = NULL;
+		g_autoptr(GVariant) data = NULL;
+		const gchar *saved_stamp = NULL;
+
+		filename = pk_alpm_index_filename (handle, alpm_db_get_name (db), ".search");
+		data = pk_alpm_index_load (filename, PK_ALPM_SEARCH_INDEX_TYPE);
+		if (data != NULL)
+			g_variant_get_child (data, 0, "&s", &saved_stamp);
+		if (g_strcmp0 (saved_stamp, stamp) != 0) {
+			/* the package cache still holds the database as it was
+			 * registered, so it can't describe a newer download */
+			if (g_strcmp0 (db_index->loaded_stamp, stamp) != 0) {
+				g_debug ("%s changed since it was loaded", alpm_db_get_name (db));
+				return NULL;
+			}
+			g_debug ("rebuilding search index of %s", alpm_db_get_name (db));
+			g_clear_pointer (&data, g_variant_unref);
+			data = pk_alpm_search_index_build (backend, db, stamp);
+			pk_alpm_index_save (filename, data);
+		}
+		db_index->search = pk_alpm_search_index_new (db, data);
+	}
+
+	local_stamp = pk_alpm_index_local_stamp (backend);
+	if (g_strcmp0 (db_index->search->local_stamp, local_stamp) != 0)
+		pk_alpm_search_index_update_installed (backend, handle, db_index->search, local_stamp);
+
+	return db_index->search;
+}
+
+static void
+pk_alpm_search_index_emit (PkBackendJob *job, PkAlpmSearchIndex *search, guint k,
+			   PkBitfield filters)
+{
+	PkAlpmSearchEntry *entry = &g_array_index (search->entries, PkAlpmSearchEntry, k);
+	g_autofree gchar *package_id = NULL;
+
+	/* installed packages are reported from the local database */
+	if (entry->installed)
+		return;
+
+	/* want applications */
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_APPLICATION) && !entry->application)
+		return;
+
+	/* don't want applications */
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_APPLICATION) && entry->application)
+		return;
+
+	package_id = pk_package_id_build (entry->name, entry->version, entry->arch, search->repo);
+	pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE, package_id, entry->desc);
+}
+
+static guint
+pk_alpm_search_index_find_line (GArray *offsets, guint position)
+{
+	guint lower = 0, upper = offsets->len - 1;
+
+	/* the last line that starts at or before the position */
+	while (lower < upper) {
+		guint middle = lower + (upper - lower) / 2;
+		if (g_array_index (offsets, guint, middle) <= position)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	return lower - 1;
+}
+
+static gboolean
+pk_alpm_search_details_match (const gchar *line, gsize length, const gchar *needle)
+{
+	const gchar *field = line, *end = line + length;
+	gsize needle_length = strlen (needle);
+	guint n_field;
+
+	/* the name and the description match anywhere, licenses only at the start */
+	for (n_field = 0; field <= end; ++n_field) {
+		const gchar *next = memchr (field, PK_ALPM_SEARCH_FIELD_SEPARATOR, end - field);
+		gsize field_length = (next != NULL ? next : end) - field;
+
+		if (n_field < 2) {
+			if (g_strstr_len (field, field_length, needle) != NULL)
+				return TRUE;
+		} else if (field_length >= needle_length &&
+			   strncmp (field, needle, needle_length) == 0) {
+			return TRUE;
+		}
+
+		if (next == NULL)
+			break;
+		field = next + 1;
+	}
+
+	return FALSE;
+}
+
+static void
+pk_alpm_search_index_scan (PkBackendJob *job, PkAlpmSearchIndex *search,
+			   gboolean details, gchar **needles, PkBitfield filters)
+{
+	GString *text = details ? search->details : search->names;
+	GArray *offsets = details ? search->detail_offsets : search->name_offsets;
+	const gchar *position = text->str, *end = text->str + text->len;
+
+	/* the first term finds the candidates, all terms are checked per line */
+	while (position < end && (position = strstr (position, needles[0])) != NULL) {
+		guint k = pk_alpm_search_index_find_line (offsets, position - text->str);
+		const gchar *line = text->str + g_array_index (offsets, guint, k);
+		gsize length = g_array_index (offsets, guint, k + 1) - 1 - (line - text->str);
+		gchar **needle;
+
+		if (pk_backend_job_is_cancelled (job))
+			return;
+
+		for (needle = needles; *needle != NULL; ++needle) {
+			if (details ? !pk_alpm_search_details_match (line, length, *needle) :
+				      g_strstr_len (line, length, *needle) == NULL) {
+				break;
+			}
+		}
+
+		if (*needle == NULL)
+			pk_alpm_search_index_emit (job, search, k, filters);
+
+		position = line + length + 1;
+	}
+}
+
+static gboolean
+pk_alpm_search_index_contains (GArray *matches, guint k)
+{
+	guint lower = 0, upper = matches->len;
+
+	while (lower < upper) {
+		guint middle = lower + (upper - lower) / 2;
+		guint value = g_array_index (matches, guint, middle);
+
+		if (value == k)
+			return TRUE;
+		if (value < k)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	return FALSE;
+}
+
+static void
+pk_alpm_search_index_provides (PkBackendJob *job, PkAlpmSearchIndex *search,
+			       gchar **needles, PkBitfield filters)
+{
+	GArray *first = g_hash_table_lookup (search->provides, needles[0]);
+	guint i;
+
+	if (first == NULL)
+		return;
+
+	/* every term has to be provided by the package */
+	for (i = 0; i < first->len; i++) {
+		guint k = g_array_index (first, guint, i);
+		gchar **needle;
+
+		for (needle = needles + 1; *needle != NULL; ++needle) {
+			GArray *matches = g_hash_table_lookup (search->provides, *needle);
+			if (matches == NULL || !pk_alpm_search_index_contains (matches, k))
+				break;
+		}
+
+		if (*needle == NULL)
+			pk_alpm_search_index_emit (job, search, k, filters);
+	}
+}
+
+gboolean
+pk_alpm_index_search (PkBackendJob *job, alpm_handle_t *handle, alpm_db_t *db,
+		      PkAlpmIndexSearch type, gchar **needles, PkBitfield filters)
+{
+	PkBackend *backend = pk_backend_job_get_backend (job);
+	PkAlpmSearchIndex *search;
+	g_autoptr(GPtrArray) folded = NULL;
+	guint k;
+
+	g_return_val_if_fail (db != NULL, FALSE);
+
+	if (type == PK_ALPM_INDEX_SEARCH_NONE)
+		return FALSE;
+
+	search = pk_alpm_index_get_search (backend, handle, db);
+	if (search == NULL)
+		return FALSE;
+
+	if (type == PK_ALPM_INDEX_SEARCH_PROVIDES && needles != NULL && *needles != NULL) {
+		pk_alpm_search_index_provides (job, search, needles, filters);
+		return TRUE;
+	}
+
+	/* terms that match the repository name match every package */
+	folded = g_ptr_array_new_with_free_func (g_free);
+	for (; needles != NULL && *needles != NULL; ++needles) {
+		gchar *needle = g_utf8_casefold (*needles, -1);
+
+		if (type == PK_ALPM_INDEX_SEARCH_DETAILS &&
+		    g_str_has_prefix (search->folded_repo, needle)) {
+			g_free (needle);
+			continue;
+		}
+		g_ptr_array_add (folded, needle);
+	}
+
+	if (type == PK_ALPM_INDEX_SEARCH_ALL || folded->len == 0) {
+		for (k = 0; k < search->entries->len; k++) {
+			if (pk_backend_job_is_cancelled (job))
+				break;
+			pk_alpm_search_index_emit (job, search, k, filters);
+		}
+		return TRUE;
+	}
+
+	g_ptr_array_add (folded, NULL);
+	pk_alpm_search_index_scan (job, search, type == PK_ALPM_INDEX_SEARCH_DETAILS,
+				   (gchar **) folded->pdata, filters);
+	return TRUE;
+}
+
+void
+pk_alpm_index_register (PkBackend *backend, alpm_handle_t *handle, alpm_db_t *db)
+{
+	PkAlpmIndex *db_index;
+
+	g_return_if_fail (db != NULL);
+
+	/* alpm reads the database file the first time its packages are used */
+	pk_alpm_index_invalidate (backend, db);
+	db_index = pk_alpm_index_get (backend, db);
+	db_index->loaded_stamp = pk_alpm_index_db_stamp (handle, db);
+}
+
+void
+pk_alpm_index_refresh (PkBackend *backend, alpm_handle_t *handle, alpm_db_t *db)
+{
+	g_return_if_fail (db != NULL);
+
+	pk_alpm_index_register (backend, handle, db);
+	pk_alpm_index_get_search (backend, handle, db);
+}
+
+static gint
+pk_alpm_file_entry_compare (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((const PkAlpmFileEntry *) a)->path, ((const PkAlpmFileEntry *) b)->path);
+}
+
+static PkAlpmFileIndex *
+pk_alpm_index_get_files (PkBackend *backend, alpm_db_t *db)
+{
+	PkAlpmIndex *db_index = pk_alpm_index_get (backend, db);
+	PkAlpmFileIndex *files;
+	const alpm_list_t *i;
+
+	if (db_index->files != NULL)
+		return db_index->files;
+
+	files = g_new0 (PkAlpmFileIndex, 1);
+	files->paths = g_array_new (FALSE, FALSE, sizeof (PkAlpmFileEntry));
+	files->basenames = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						  (GDestroyNotify) g_ptr_array_unref);
+
+	for (i = alpm_db_get_pkgcache (db); i != NULL; i = i->next) {
+		alpm_filelist_t *filelist = alpm_pkg_get_files (i->data);
+		gsize j;
+
+		for (j = 0; j < filelist->count; ++j) {
+			PkAlpmFileEntry entry = { filelist->files[j].name, i->data };
+			const gchar *name = strrchr (entry.path, G_DIR_SEPARATOR);
+			GPtrArray *owners;
+
+			g_array_append_val (files->paths, entry);
+
+			/* directories have no file name */
+			name = (name != NULL) ? name + 1 : entry.path;
+			if (*name == '\0')
+				continue;
+
+			owners = g_hash_table_lookup (files->basenames, name);
+			if (owners == NULL) {
+				owners = g_ptr_array_new ();
+				g_hash_table_insert (files->basenames, (gpointer) name, owners);
+			}
+			if (owners->len == 0 || g_ptr_array_index (owners, owners->len - 1) != i->data)
+				g_ptr_array_add (owners, i->data);
+		}
+	}
+
+	g_array_sort (files->paths, pk_alpm_file_entry_compare);
+	g_debug ("indexed %u paths in %s", files->paths->len, alpm_db_get_name (db));
+
+	db_index->files = files;
+	return files;
+}
+
+static void
+pk_alpm_file_index_find_path (PkAlpmFileIndex *files, const gchar *path, GHashTable *found)
+{
+	gboolean directory = g_str_has_suffix (path, G_DIR_SEPARATOR_S);
+	guint lower = 0, upper = files->paths->len;
+
+	while (lower < upper) {
+		guint middle = lower + (upper - lower) / 2;
+		if (strcmp (g_array_index (files->paths, PkAlpmFileEntry, middle).path, path) < 0)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	/* a directory matches itself and everything below it */
+	for (; lower < files->paths->len; ++lower) {
+		PkAlpmFileEntry *entry = &g_array_index (files->paths, PkAlpmFileEntry, lower);
+
+		if (directory ? !g_str_has_prefix (entry->path, path) : strcmp (entry->path, path) != 0)
+			break;
+		g_hash_table_add (found, entry->pkg);
+	}
+}
+
+static gboolean
+pk_alpm_file_index_not_found (gpointer pkg, gpointer value, gpointer found)
+{
+	return !g_hash_table_contains (found, pkg);
+}
+
+GHashTable *
+pk_alpm_index_find_files (PkBackend *backend, alpm_db_t *db, const alpm_list_t *needles)
+{
+	PkAlpmFileIndex *files = pk_alpm_index_get_files (backend, db);
+	GHashTable *matches = NULL;
+
+	/* packages that contain a match for every needle */
+	for (; needles != NULL; needles = needles->next) {
+		const gchar *needle = needles->data;
+		GHashTable *found = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+		if (G_IS_DIR_SEPARATOR (*needle)) {
+			pk_alpm_file_index_find_path (files, needle + 1, found);
+		} else {
+			GPtrArray *owners = g_hash_table_lookup (files->basenames, needle);
+			guint i;
+
+			for (i = 0; owners != NULL && i < owners->len; ++i)
+				g_hash_table_add (found, g_ptr_array_index (owners, i));
+		}
+
+		if (matches == NULL) {
+			matches = found;
+		} else {
+			g_hash_table_foreach_remove (matches, pk_alpm_file_index_not_found, found);
+			g_hash_table_unref (found);
+		}
+	}
+
+	if (matches == NULL)
+		matches = g_hash_table_new (g_direct_hash, g_direct_equal);
+	return matches;
+}
+
+static void
+pk_alpm_index_release_files_handle (PkBackend *backend)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	const alpm_list_t *i;
+
+	if (priv->alpm_files == NULL)
+		return;
+
+	for (i = alpm_get_syncdbs (priv->alpm_files); i != NULL; i = i->next)
+		pk_alpm_index_invalidate (backend, i->data);
+	alpm_release (priv->alpm_files);
+	priv->alpm_files = NULL;
+}
+
+static alpm_handle_t *
+pk_alpm_index_get_files_handle (PkBackend *backend, alpm_handle_t *handle)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	alpm_errno_t alpm_err;
+
+	/* the update check downloads its databases somewhere else */
+	if (priv->alpm_files != NULL &&
+	    g_strcmp0 (alpm_option_get_dbpath (priv->alpm_files),
+		       alpm_option_get_dbpath (handle)) == 0)
+		return priv->alpm_files;
+
+	pk_alpm_index_release_files_handle (backend);
+
+	/* a second handle reads the .files databases next to the .db ones */
+	priv->alpm_files = alpm_initialize (alpm_option_get_root (handle),
+					    alpm_option_get_dbpath (handle), &alpm_err);
+	if (priv->alpm_files == NULL) {
+		g_warning ("failed to read file databases: %s", alpm_strerror (alpm_err));
+		return NULL;
+	}
+
+	alpm_option_set_dbext (priv->alpm_files, ".files");
+	alpm_option_set_gpgdir (priv->alpm_files, alpm_option_get_gpgdir (handle));
+	return priv->alpm_files;
+}
+
+alpm_db_t *
+pk_alpm_index_get_files_db (PkBackend *backend, alpm_handle_t *handle, alpm_db_t *db)
+{
+	const gchar *name = alpm_db_get_name (db);
+	g_autofree gchar *path = NULL;
+	g_autofree gchar *stamp = NULL;
+	alpm_handle_t *files_handle;
+	const alpm_list_t *i;
+	alpm_db_t *files_db = NULL;
+	PkAlpmIndex *db_index;
+
+	/* the database already has the file lists */
+	if (g_strcmp0 (alpm_option_get_dbext (handle), ".files") == 0)
+		return db;
+
+	path = g_strconcat (alpm_option_get_dbpath (handle), "sync/", name, ".files", NULL);
+	stamp = pk_alpm_index_stamp (path);
+	if (stamp == NULL)
+		return NULL;
+
+	files_handle = pk_alpm_index_get_files_handle (backend, handle);
+	if (files_handle == NULL)
+		return NULL;
+
+	for (i = alpm_get_syncdbs (files_handle); i != NULL; i = i->next) {
+		if (g_strcmp0 (alpm_db_get_name (i->data), name) == 0) {
+			files_db = i->data;
+			break;
+		}
+	}
+
+	/* load the database again if it was downloaded since */
+	if (files_db != NULL) {
+		db_index = pk_alpm_index_get (backend, files_db);
+		if (g_strcmp0 (db_index->files_stamp, stamp) == 0)
+			return files_db;
+
+		pk_alpm_index_invalidate (backend, files_db);
+		alpm_db_unregister (files_db);
+	}
+
+	files_db = alpm_register_syncdb (files_handle, name, ALPM_SIG_USE_DEFAULT);
+	if (files_db == NULL) {
+		alpm_errno_t alpm_err = alpm_errno (files_handle);
+		g_warning ("failed to read %s: %s", path, alpm_strerror (alpm_err));
+		return NULL;
+	}
+
+	db_index = pk_alpm_index_get (backend, files_db);
+	db_index->files_stamp = g_steal_pointer (&stamp);
+	return files_db;
+}
+
+void
+pk_alpm_index_invalidate (PkBackend *backend, alpm_db_t *db)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+
+	g_return_if_fail (db != NULL);
+
+	if (priv->indexes != NULL)
+		g_hash_table_remove (priv->indexes, db);
+}
+
+void
+pk_alpm_index_invalidate_syncdbs (PkBackend *backend, alpm_handle_t *handle)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	const alpm_list_t *i;
+
+	g_return_if_fail (handle != NULL);
+
+	for (i = alpm_get_syncdbs (handle); i != NULL; i = i->next)
+		pk_alpm_index_invalidate (backend, i->data);
+
+	/* the file databases go with the handle they were read for */
+	if (priv->alpm_files != NULL &&
+	    g_strcmp0 (alpm_option_get_dbpath (priv->alpm_files),
+		       alpm_option_get_dbpath (handle)) == 0)
+		pk_alpm_index_release_files_handle (backend);
+}
+
+void
+pk_alpm_index_destroy (PkBackend *backend)
+{
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+
+	if (priv->indexes != NULL) {
+		g_hash_table_unref (priv->indexes);
+		priv->indexes = NULL;
+	}
+
+	if (priv->alpm_files != NULL) {
+		alpm_release (priv->alpm_files);
+		priv->alpm_files = NULL;
+	}
+}
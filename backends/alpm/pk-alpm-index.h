@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <alpm.h>
+#include <pk-backend.h>
+
+typedef enum {
+	PK_ALPM_INDEX_SEARCH_ALL,
+	PK_ALPM_INDEX_SEARCH_DETAILS,
+	PK_ALPM_INDEX_SEARCH_NAME,
+	PK_ALPM_INDEX_SEARCH_PROVIDES,
+	PK_ALPM_INDEX_SEARCH_NONE
+} PkAlpmIndexSearch;
+
+gboolean	 pk_alpm_index_pkg_is_application	(PkBackend *backend,
+							 alpm_pkg_t *pkg);
+
+gboolean	 pk_alpm_index_search			(PkBackendJob *job,
+							 alpm_handle_t *handle,
+							 alpm_db_t *db,
+							 PkAlpmIndexSearch type,
+							 gchar **needles,
+							 PkBitfield filters);
+
+GHashTable	*pk_alpm_index_find_files		(PkBackend *backend,
+							 alpm_db_t *db,
+							 const alpm_list_t *needles);
+
+alpm_db_t	*pk_alpm_index_get_files_db		(PkBackend *backend,
+							 alpm_handle_t *handle,
+							 alpm_db_t *db);
+
+void		 pk_alpm_index_register		(PkBackend *backend,
+							 alpm_handle_t *handle,
+							 alpm_db_t *db);
+
+void		 pk_alpm_index_refresh			(PkBackend *backend,
+							 alpm_handle_t *handle,
+							 alpm_db_t *db);
+
+void		 pk_alpm_index_invalidate		(PkBackend *backend,
+							 alpm_db_t *db);
+
+void		 pk_alpm_index_invalidate_syncdbs	(PkBackend *backend,
+							 alpm_handle_t *handle);
+
+void		 pk_alpm_index_destroy			(PkBackend *backend);
@@ -0,0 +1,253 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <alpm.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <pk-backend.h>
+#include <string.h>
+#include <utime.h>
+
+#include "pk-backend-alpm.h"
+#include "pk-alpm-error.h"
+#include "pk-alpm-index.h"
+#include "pk-alpm-refresh.h"
+
+typedef enum {
+	PK_ALPM_REFRESH_PENDING,
+	PK_ALPM_REFRESH_DONE,
+	PK_ALPM_REFRESH_FAILED
+} PkAlpmRefreshState;
+
+typedef struct {
+	alpm_db_t		*db;
+	gchar			*filename;
+	guint			 percentage;
+	PkAlpmRefreshState	 state;
+} PkAlpmRefreshItem;
+
+typedef struct {
+	PkBackendJob		*job;
+	GArray			*items;
+} PkAlpmRefresh;
+
+static void
+pk_alpm_refresh_item_clear (PkAlpmRefreshItem *item)
+{
+	g_free (item->filename);
+}
+
+static gchar *
+pk_alpm_update_get_db_timestamp_filename (alpm_db_t *db, gboolean is_check)
+{
+	return g_strconcat (PK_ALPM_CACHE_DIR,
+			    alpm_db_get_name (db),
+			    is_check ? ".check" : "",
+			    ".db.timestamp",
+			    NULL);
+}
+
+static gboolean
+pk_alpm_update_set_db_timestamp (alpm_db_t *db, gboolean is_check, GError **error)
+{
+	g_autofree gchar *timestamp_filename = NULL;
+	struct utimbuf times;
+
+	timestamp_filename = pk_alpm_update_get_db_timestamp_filename (db, is_check);
+
+	times.actime = time (NULL);
+	times.modtime = time (NULL);
+
+	if (g_mkdir_with_parents (PK_ALPM_CACHE_DIR, 0755) < 0) {
+		g_set_error_literal (error, PK_ALPM_ERROR, errno, strerror(errno));
+		return FALSE;
+	}
+
+	if (!g_file_set_contents (timestamp_filename, "", 0, error)) {
+		return FALSE;
+	}
+
+	if (g_utime (timestamp_filename, &times) < 0) {
+		g_set_error_literal (error, PK_ALPM_ERROR, errno, strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+pk_alpm_update_db_is_fresh (alpm_handle_t *handle, alpm_db_t *db, gboolean is_check,
+			    guint cache_age)
+{
+	g_autofree gchar *db_filename = NULL;
+	g_autofree gchar *timestamp_filename = NULL;
+	GStatBuf buf;
+
+	/* without a hint every database is checked with the server */
+	if (cache_age == G_MAXUINT)
+		return FALSE;
+
+	db_filename = g_strconcat (alpm_option_get_dbpath (handle), "sync/",
+				   alpm_db_get_name (db), alpm_option_get_dbext (handle), NULL);
+	if (!g_file_test (db_filename, G_FILE_TEST_EXISTS))
+		return FALSE;
+
+	timestamp_filename = pk_alpm_update_get_db_timestamp_filename (db, is_check);
+	if (g_stat (timestamp_filename, &buf) < 0)
+		return FALSE;
+
+	return time (NULL) - buf.st_mtime < (time_t) cache_age;
+}
+
+static void
+pk_alpm_refresh_dlcb (void *ctx, const gchar *filename, alpm_download_event_type_t type, void *data)
+{
+	PkAlpmRefresh *refresh = ctx;
+	GArray *items = refresh->items;
+	PkAlpmRefreshItem *item = NULL;
+	guint i, total = 0;
+
+	g_return_if_fail (filename != NULL);
+
+	/* signatures are optional and don't count towards the progress */
+	for (i = 0; i < items->len; i++) {
+		PkAlpmRefreshItem *candidate = &g_array_index (items, PkAlpmRefreshItem, i);
+		if (g_strcmp0 (candidate->filename, filename) == 0) {
+			item = candidate;
+			break;
+		}
+	}
+	if (item == NULL)
+		return;
+
+	switch (type) {
+	case ALPM_DOWNLOAD_INIT:
+		pk_backend_job_set_status (refresh->job, PK_STATUS_ENUM_DOWNLOAD_REPOSITORY);
+		break;
+	case ALPM_DOWNLOAD_PROGRESS: {
+		alpm_download_event_progress_t *progress = data;
+		if (progress->total > 0)
+			item->percentage = MIN (progress->downloaded * 100 / progress->total, 99);
+		break;
+	}
+	case ALPM_DOWNLOAD_RETRY:
+		item->percentage = 0;
+		break;
+	case ALPM_DOWNLOAD_COMPLETED: {
+		alpm_download_event_completed_t *completed = data;
+		item->percentage = 100;
+		item->state = (completed->result < 0) ? PK_ALPM_REFRESH_FAILED : PK_ALPM_REFRESH_DONE;
+		g_debug ("%s: %s", filename, completed->result > 0 ? "up to date" :
+			 completed->result == 0 ? "downloaded" : "failed");
+		break;
+	}
+	default:
+		break;
+	}
+
+	/* every database weighs the same */
+	for (i = 0; i < items->len; i++)
+		total += g_array_index (items, PkAlpmRefreshItem, i).percentage;
+	pk_backend_job_set_percentage (refresh->job, total / items->len);
+}
+
+gboolean
+pk_alpm_refresh_databases (PkBackendJob *job, alpm_handle_t *handle, gint force,
+			   alpm_list_t *dbs, GError **error)
+{
+	PkBackend *backend = pk_backend_job_get_backend (job);
+	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
+	gboolean is_check = (handle != priv->alpm);
+	guint cache_age = pk_backend_job_get_cache_age (job);
+	g_autoptr(GArray) items = NULL;
+	PkAlpmRefresh refresh;
+	alpm_list_t *stale = NULL, *i;
+	alpm_cb_download dlcb;
+	void *dlcb_ctx;
+	gboolean ret = TRUE;
+	gint result;
+	guint j;
+
+	/* only refresh the databases that are older than the cache age */
+	items = g_array_new (FALSE, FALSE, sizeof (PkAlpmRefreshItem));
+	g_array_set_clear_func (items, (GDestroyNotify) pk_alpm_refresh_item_clear);
+	for (i = dbs; i; i = alpm_list_next (i)) {
+		PkAlpmRefreshItem item = { i->data, NULL, 0, PK_ALPM_REFRESH_PENDING };
+
+		if (!force && pk_alpm_update_db_is_fresh (handle, i->data, is_check, cache_age)) {
+			g_debug ("%s is fresh, not refreshing", alpm_db_get_name (i->data));
+			continue;
+		}
+
+		item.filename = g_strconcat (alpm_db_get_name (i->data),
+					     alpm_option_get_dbext (handle), NULL);
+		g_array_append_val (items, item);
+		stale = alpm_list_add (stale, i->data);
+	}
+
+	if (stale == NULL)
+		return TRUE;
+
+	if (!is_check && priv->alpm_check != NULL) {
+		// We can now discard the check db as the main db is more up to date again
+		pk_alpm_index_invalidate_syncdbs (backend, priv->alpm_check);
+		alpm_release(priv->alpm_check);
+		priv->alpm_check = NULL;
+	}
+
+	/* the databases are downloaded together, and unless forced only
+	 * if the server has a newer copy than the one we have */
+	dlcb = alpm_option_get_dlcb (handle);
+	dlcb_ctx = alpm_option_get_dlcb_ctx (handle);
+	refresh.job = job;
+	refresh.items = items;
+	alpm_option_set_dlcb (handle, pk_alpm_refresh_dlcb, &refresh);
+	result = alpm_db_update (handle, stale, force);
+	alpm_option_set_dlcb (handle, dlcb, dlcb_ctx);
+	alpm_list_free (stale);
+
+	if (result < 0) {
+		g_set_error (error, PK_ALPM_ERROR, alpm_errno (handle), "failed to update database: %s",
+			     alpm_strerror (alpm_errno (handle)));
+		ret = FALSE;
+	}
+
+	for (j = 0; j < items->len; j++) {
+		PkAlpmRefreshItem *item = &g_array_index (items, PkAlpmRefreshItem, j);
+
+		pk_alpm_index_invalidate (backend, item->db);
+
+		/* an XferCommand reports no progress, so only the result of
+		 * the whole update is known */
+		if (item->state == PK_ALPM_REFRESH_FAILED ||
+		    (item->state == PK_ALPM_REFRESH_PENDING && result < 0)) {
+			continue;
+		}
+
+		if (!pk_alpm_update_set_db_timestamp (item->db, is_check, ret ? error : NULL)) {
+			ret = FALSE;
+			continue;
+		}
+
+		/* rebuild the search index while the database is fresh */
+		pk_alpm_index_refresh (backend, handle, item->db);
+	}
+
+	return ret;
+}
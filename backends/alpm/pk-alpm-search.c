@@ -27,6 +27,7 @@
 
 #include "pk-backend-alpm.h"
 #include "pk-alpm-groups.h"
+#include "pk-alpm-index.h"
 #include "pk-alpm-packages.h"
 
 static gpointer
@@ -150,6 +151,16 @@ pk_backend_match_file (alpm_pkg_t *pkg, const gchar *needle)
 	return FALSE;
 }
 
+static gboolean
+pk_backend_match_indexed (alpm_pkg_t *pkg, GHashTable *matches)
+{
+	g_return_val_if_fail (pkg != NULL, FALSE);
+	g_return_val_if_fail (matches != NULL, FALSE);
+
+	/* match the packages found in the index */
+	return g_hash_table_contains (matches, pkg);
+}
+
 static gboolean
 pk_backend_match_group (alpm_pkg_t *pkg, const gchar *needle)
 {
@@ -181,15 +192,10 @@ pk_alpm_pkg_match_provides (alpm_pkg_t *pkg, gpointer pattern)
 
 	/* match features provided by package */
 	for (i = alpm_pkg_get_provides (pkg); i != NULL; i = i->next) {
-		const gchar *needle = pattern, *name = i->data;
+		const alpm_depend_t *provide = i->data;
 
-		for (; *needle == *name; ++needle, ++name) {
-			if (*needle == '\0') {
-				if (*name == '\0' || *name == '=')
-					return TRUE;
-				break;
-			}
-		}
+		if (g_strcmp0 (pattern, provide->name) == 0)
+			return TRUE;
 	}
 
 	return FALSE;
@@ -226,6 +232,15 @@ static GDestroyNotify pattern_frees[] = {
 	NULL
 };
 
+static PkAlpmIndexSearch index_searches[] = {
+	PK_ALPM_INDEX_SEARCH_ALL,
+	PK_ALPM_INDEX_SEARCH_DETAILS,
+	PK_ALPM_INDEX_SEARCH_NONE,
+	PK_ALPM_INDEX_SEARCH_NONE,
+	PK_ALPM_INDEX_SEARCH_NAME,
+	PK_ALPM_INDEX_SEARCH_PROVIDES
+};
+
 static MatchFunc match_funcs[] = {
 	pk_backend_match_all,
 	(MatchFunc) pk_backend_match_details,
@@ -264,24 +279,6 @@ pk_alpm_pkg_is_local (PkBackendJob *job, alpm_pkg_t *pkg)
 	return TRUE;
 }
 
-static gboolean
-pk_alpm_search_is_application (alpm_pkg_t *pkg) {
-	guint i;
-	alpm_filelist_t *filelist;
-	g_autoptr(GRegex) regex = NULL;
-
-	filelist = alpm_pkg_get_files (pkg);
-	regex = g_regex_new ("^usr/share/applications/.*\\.desktop$", 0, 0, NULL);
-
-	for (i = 0; i < filelist->count; i++) {
-		const alpm_file_t *file = filelist->files + i;
-		if (g_regex_match (regex, file->name, 0, NULL)) {
-			return TRUE;
-		}
-	}
-	return FALSE;
-}
-
 static void
 pk_backend_search_db (PkBackendJob *job, alpm_db_t *db, MatchFunc match,
 		      const alpm_list_t *patterns, PkBitfield filters)
@@ -289,10 +286,14 @@ pk_backend_search_db (PkBackendJob *job, alpm_db_t *db, MatchFunc match,
 	PkBackend *backend = pk_backend_job_get_backend (job);
 	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
 	const alpm_list_t *i, *j;
+	gboolean want_application, want_not_application;
 
 	g_return_if_fail (db != NULL);
 	g_return_if_fail (match != NULL);
 
+	want_application = pk_bitfield_contain (filters, PK_FILTER_ENUM_APPLICATION);
+	want_not_application = pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_APPLICATION);
+
 	/* emit packages that match all search terms */
 	for (i = alpm_db_get_pkgcache (db); i != NULL; i = i->next) {
 		if (pk_backend_job_is_cancelled (job))
@@ -308,11 +309,11 @@ pk_backend_search_db (PkBackendJob *job, alpm_db_t *db, MatchFunc match,
 			continue;
 
 		/* want applications */
-		if (pk_bitfield_contain (filters, PK_FILTER_ENUM_APPLICATION) && !pk_alpm_search_is_application (i->data))
+		if (want_application && !pk_alpm_index_pkg_is_application (backend, i->data))
 			continue;
 
 		/* don't want applications */
-		if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_APPLICATION) && pk_alpm_search_is_application (i->data))
+		if (want_not_application && pk_alpm_index_pkg_is_application (backend, i->data))
 			continue;
 
 		if (db == priv->localdb) {
@@ -323,6 +324,23 @@ pk_backend_search_db (PkBackendJob *job, alpm_db_t *db, MatchFunc match,
 	}
 }
 
+static void
+pk_backend_search_files_db (PkBackendJob *job, alpm_db_t *db,
+			    const alpm_list_t *patterns, PkBitfield filters)
+{
+	PkBackend *backend = pk_backend_job_get_backend (job);
+	g_autoptr(GHashTable) matches = NULL;
+	alpm_list_t *indexed;
+
+	g_return_if_fail (db != NULL);
+
+	/* look the files up once instead of scanning every file list */
+	matches = pk_alpm_index_find_files (backend, db, patterns);
+	indexed = alpm_list_add (NULL, matches);
+	pk_backend_search_db (job, db, (MatchFunc) pk_backend_match_indexed, indexed, filters);
+	alpm_list_free (indexed);
+}
+
 static void
 pk_backend_search_thread (PkBackendJob *job, GVariant* params, gpointer p)
 {
@@ -339,8 +357,10 @@ pk_backend_search_thread (PkBackendJob *job, GVariant* params, gpointer p)
 	PkBitfield filters = 0;
 	gboolean skip_local, skip_remote;
 
+	alpm_handle_t *handle;
 	const alpm_list_t *i;
 	alpm_list_t *patterns = NULL;
+	gchar **needle;
 	g_autoptr(GError) error = NULL;
 
 	g_return_if_fail (p == NULL);
@@ -397,8 +417,8 @@ pk_backend_search_thread (PkBackendJob *job, GVariant* params, gpointer p)
 
 	/* convert search terms to the pattern requested */
 	if (needles) {
-		for (; *needles != NULL; ++needles) {
-			gpointer pattern = pattern_func (backend, *needles, &error);
+		for (needle = needles; *needle != NULL; ++needle) {
+			gpointer pattern = pattern_func (backend, *needle, &error);
 
 			if (pattern == NULL)
 				goto out;
@@ -408,16 +428,33 @@ pk_backend_search_thread (PkBackendJob *job, GVariant* params, gpointer p)
 	}
 
 	/* find installed packages first */
-	if (!skip_local)
+	if (!skip_local && type == SEARCH_TYPE_FILES)
+		pk_backend_search_files_db (job, priv->localdb, patterns, filters);
+	else if (!skip_local)
 		pk_backend_search_db (job, priv->localdb, match_func, patterns, filters);
 
 	if (skip_remote)
 		goto out;
 
-	for (i = alpm_get_syncdbs (priv->alpm_check ? priv->alpm_check : priv->alpm); i != NULL; i = i->next) {
+	handle = priv->alpm_check ? priv->alpm_check : priv->alpm;
+	for (i = alpm_get_syncdbs (handle); i != NULL; i = i->next) {
 		if (pk_backend_job_is_cancelled (job))
 			break;
 
+		/* only the .files databases know the files of sync packages */
+		if (type == SEARCH_TYPE_FILES) {
+			alpm_db_t *files_db = pk_alpm_index_get_files_db (backend, handle, i->data);
+			if (files_db != NULL)
+				pk_backend_search_files_db (job, files_db, patterns, filters);
+			continue;
+		}
+
+		/* use the search index if there is one for this kind of search */
+		if (pk_alpm_index_search (job, handle, i->data, index_searches[type],
+					  needles, filters)) {
+			continue;
+		}
+
 		pk_backend_search_db (job, i->data, match_func, patterns, filters);
 	}
 out:
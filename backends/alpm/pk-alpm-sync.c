@@ -29,6 +29,7 @@
 #include "pk-alpm-databases.h"
 #include "pk-alpm-error.h"
 #include "pk-alpm-transaction.h"
+#include "pk-alpm-refresh.h"
 #include "pk-alpm-update.h"
 #include "pk-alpm-packages.h"
 
@@ -201,7 +202,7 @@ pk_backend_sync_thread (PkBackendJob* job, GVariant* params, gpointer p)
 
 	if (p) {
 		i = alpm_get_syncdbs(priv->alpm);
-		pk_alpm_refresh_databases (job, TRUE, i, &error);
+		pk_alpm_refresh_databases (job, priv->alpm, FALSE, i, &error);
 		pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 	}
 
@@ -23,6 +23,7 @@
 
 #include "pk-backend-alpm.h"
 #include "pk-alpm-error.h"
+#include "pk-alpm-index.h"
 #include "pk-alpm-packages.h"
 #include "pk-alpm-transaction.h"
 
@@ -1060,6 +1061,7 @@ pk_alpm_transaction_commit (PkBackendJob *job, GError **error)
 	pk_backend_transaction_inhibit_start (backend);
 	commit_result = alpm_trans_commit (priv->alpm, &data);
 	pk_backend_transaction_inhibit_end (backend);
+	pk_alpm_index_invalidate (backend, priv->localdb);
 	if (commit_result >= 0)
 		return TRUE;
 
@@ -35,7 +35,9 @@
 #include "pk-backend-alpm.h"
 #include "pk-alpm-config.h"
 #include "pk-alpm-error.h"
+#include "pk-alpm-index.h"
 #include "pk-alpm-packages.h"
+#include "pk-alpm-refresh.h"
 #include "pk-alpm-transaction.h"
 #include "pk-alpm-update.h"
 
@@ -211,74 +213,6 @@ pk_backend_get_update_detail (PkBackend * self,
 	pk_alpm_run (job, PK_STATUS_ENUM_QUERY, pk_backend_get_update_detail_thread, package_ids);
 }
 
-static gchar *
-pk_alpm_update_get_db_timestamp_filename (alpm_db_t *db)
-{
-	return g_strconcat ("/var/cache/PackageKit/alpm/",
-			    alpm_db_get_name (db),
-			    ".db.timestamp",
-			    NULL);
-}
-
-static gboolean
-pk_alpm_update_set_db_timestamp (alpm_db_t *db, GError **error)
-{
-	g_autofree gchar *timestamp_filename = NULL;
-	struct utimbuf times;
-
-	timestamp_filename = pk_alpm_update_get_db_timestamp_filename (db);
-
-	times.actime = time (NULL);
-	times.modtime = time (NULL);
-
-	if (g_mkdir_with_parents ("/var/cache/PackageKit/alpm/", 0755) < 0) {
-		g_set_error_literal (error, PK_ALPM_ERROR, errno, strerror(errno));
-		return FALSE;
-	}
-
-	if (!g_file_set_contents (timestamp_filename, "", 0, error)) {
-		return FALSE;
-	}
-
-	if (g_utime (timestamp_filename, &times) < 0) {
-		g_set_error_literal (error, PK_ALPM_ERROR, errno, strerror(errno));
-		return FALSE;
-	}
-
-	return TRUE;
-}
-
-gboolean
-pk_alpm_refresh_databases (PkBackendJob *job, gint force, alpm_list_t *dbs, GError **error)
-{
-	PkBackend *backend = pk_backend_job_get_backend (job);
-	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
-	gint result;
-	alpm_list_t *i;
-
-	if (!force)
-		return TRUE;
-
-	if (priv->alpm != priv->alpm_check) {
-		// We can now discard the check db as the main db is more up to date again
-		alpm_release(priv->alpm_check);
-		priv->alpm_check = NULL;
-	}
-	result = alpm_db_update (priv->alpm, dbs, force);
-	if (result < 0) {
-		g_set_error (error, PK_ALPM_ERROR, alpm_errno (priv->alpm), "failed to update database: %s",
-			     alpm_strerror (alpm_errno (priv->alpm)));
-		return FALSE;
-	}
-
-	for (i = dbs; i; i = alpm_list_next (i)) {
-		if (!pk_alpm_update_set_db_timestamp (i->data, error)) {
-			return FALSE;
-		}
-	}
-	return TRUE;
-}
-
 static gboolean
 pk_alpm_update_databases (PkBackendJob *job, gint force, GError **error)
 {
@@ -294,7 +228,7 @@ pk_alpm_update_databases (PkBackendJob *job, gint force, GError **error)
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_DOWNLOAD_PACKAGELIST);
 
 	i = alpm_get_syncdbs (priv->alpm);
-	ret = pk_alpm_refresh_databases(job, force, i, error);
+	ret = pk_alpm_refresh_databases (job, priv->alpm, force, i, error);
 
 	if (i == NULL)
 		return pk_alpm_transaction_end (job, error);
@@ -422,7 +356,6 @@ pk_backend_get_updates_thread (PkBackendJob *job, GVariant* params, gpointer p)
 	PkBitfield filters = 0;
 	FILE *file;
 	int stored_count;
-	alpm_handle_t* old_handle = priv->alpm;
 	alpm_handle_t* handle = priv->alpm_check ? priv->alpm_check : pk_alpm_configure (backend, PK_BACKEND_CONFIG_FILE, TRUE, &error);
 
 	alpm_logaction (handle, PK_LOG_PREFIX, "synchronizing package lists\n");
@@ -430,12 +363,7 @@ pk_backend_get_updates_thread (PkBackendJob *job, GVariant* params, gpointer p)
 
 	/* set total size to minus the number of databases */
 	i = alpm_get_syncdbs (handle);
-
-	// swap around the handles since the refresh database will grab
-	// the main system handle and not the check update handle otherwise
-	priv->alpm = handle;
-	pk_alpm_refresh_databases (job, TRUE, i, &error);
-	priv->alpm = old_handle;
+	pk_alpm_refresh_databases (job, handle, FALSE, i, &error);
 	priv->alpm_check = handle;
 
 	if (pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATES) {
@@ -33,6 +33,7 @@
 #include "pk-alpm-databases.h"
 #include "pk-alpm-error.h"
 #include "pk-alpm-groups.h"
+#include "pk-alpm-index.h"
 #include "pk-alpm-transaction.h"
 #include "pk-alpm-environment.h"
 
@@ -165,6 +166,7 @@ pk_backend_destroy (PkBackend *backend)
 {
 	PkBackendAlpmPrivate *priv = pk_backend_get_user_data (backend);
 	pk_alpm_groups_destroy (backend);
+	pk_alpm_index_destroy (backend);
 	pk_alpm_destroy_databases (backend);
 	pk_alpm_destroy_monitor (backend);
 
@@ -31,7 +31,9 @@ typedef struct {
 	alpm_list_t	*holdpkgs;
 	alpm_handle_t	*alpm;
 	alpm_handle_t	*alpm_check;
+	alpm_handle_t	*alpm_files; /* reads the .files databases for file searches */
 	GFileMonitor    *monitor;
+	GHashTable	*indexes; /* alpm_db_t -> per-database search indexes */
 	alpm_list_t     *configured_repos; /* list of configured repos */
 	gboolean	localdb_changed;
 } PkBackendAlpmPrivate;
@@ -0,0 +1,362 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+
+#include "definitions.h"
+#include "pk-alpm-index.h"
+#include "pk-alpm-refresh.h"
+
+#define ALPM_TEST_BENCHMARK_PACKAGES	1500
+#define ALPM_TEST_BENCHMARK_FILES	20
+
+static void
+alpm_test_remove_dir (const gchar *path)
+{
+	const gchar *name;
+	g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *child = g_build_filename (path, name, NULL);
+		if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+		    !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+			alpm_test_remove_dir (child);
+		else
+			g_unlink (child);
+	}
+	g_rmdir (path);
+}
+
+static void
+alpm_test_write_file (const gchar *filename, const gchar *contents)
+{
+	g_autofree gchar *dirname = g_path_get_dirname (filename);
+	g_autoptr(GError) error = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (dirname, 0755), ==, 0);
+	g_assert_true (g_file_set_contents (filename, contents, -1, &error));
+	g_assert_no_error (error);
+}
+
+/* a local database of n packages, each with a binary and a data directory */
+static void
+alpm_test_write_local_db (const gchar *dbpath, guint n)
+{
+	g_autofree gchar *version = g_build_filename (dbpath, "local", "ALPM_DB_VERSION", NULL);
+
+	alpm_test_write_file (version, "9\n");
+	for (guint i = 0; i < n; i++) {
+		g_autofree gchar *dir = NULL;
+		g_autofree gchar *desc = NULL;
+		g_autofree gchar *desc_fn = NULL;
+		g_autofree gchar *files_fn = NULL;
+		g_autoptr(GString) files = g_string_new ("%FILES%\n");
+
+		dir = g_strdup_printf ("%s/local/pk-test-%u-1.0-1", dbpath, i);
+		desc = g_strdup_printf ("%%NAME%%\npk-test-%u\n\n"
+					"%%VERSION%%\n1.0-1\n\n"
+					"%%DESC%%\nTest package %u\n\n"
+					"%%ARCH%%\nx86_64\n\n", i, i);
+		desc_fn = g_build_filename (dir, "desc", NULL);
+		alpm_test_write_file (desc_fn, desc);
+
+		g_string_append_printf (files, "usr/\nusr/bin/\nusr/bin/pk-test-%u\n"
+					"usr/share/\nusr/share/pk-test-%u/\n", i, i);
+		for (guint j = 0; j < ALPM_TEST_BENCHMARK_FILES; j++)
+			g_string_append_printf (files, "usr/share/pk-test-%u/file-%u\n", i, j);
+		g_string_append_c (files, '\n');
+		files_fn = g_build_filename (dir, "files", NULL);
+		alpm_test_write_file (files_fn, files->str);
+	}
+}
+
+/* a sync database of n packages on the mirror, last modified at mtime */
+static void
+alpm_test_write_sync_db (const gchar *root, const gchar *mirror, const gchar *name,
+			 guint n, const gchar *version, time_t mtime)
+{
+	g_autofree gchar *staging = g_build_filename (root, "staging", name, NULL);
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *db_name = g_strconcat (name, ".db", NULL);
+	g_autoptr(GPtrArray) argv = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GError) error = NULL;
+	struct utimbuf times = { mtime, mtime };
+	gint status = 0;
+
+	alpm_test_remove_dir (staging);
+	g_ptr_array_add (argv, g_strdup ("tar"));
+	g_ptr_array_add (argv, g_strdup ("-cf"));
+	g_ptr_array_add (argv, g_build_filename (mirror, db_name, NULL));
+	g_ptr_array_add (argv, g_strdup ("-C"));
+	g_ptr_array_add (argv, g_strdup (staging));
+	for (guint i = 0; i < n; i++) {
+		g_autofree gchar *desc = NULL;
+		g_autofree gchar *desc_fn = NULL;
+		gchar *dir;
+
+		dir = g_strdup_printf ("%s-%u-%s", name, i, version);
+		desc = g_strdup_printf ("%%FILENAME%%\n%s-x86_64.pkg.tar.zst\n\n"
+					"%%NAME%%\n%s-%u\n\n"
+					"%%VERSION%%\n%s\n\n"
+					"%%DESC%%\nTest package %u\n\n"
+					"%%CSIZE%%\n1024\n\n"
+					"%%ARCH%%\nx86_64\n\n", dir, name, i, version, i);
+		desc_fn = g_build_filename (staging, dir, "desc", NULL);
+		alpm_test_write_file (desc_fn, desc);
+		g_ptr_array_add (argv, dir);
+	}
+	g_ptr_array_add (argv, NULL);
+
+	g_assert_cmpint (g_mkdir_with_parents (mirror, 0755), ==, 0);
+	g_assert_true (g_spawn_sync (NULL, (gchar **) argv->pdata, NULL, G_SPAWN_SEARCH_PATH,
+				     NULL, NULL, NULL, NULL, &status, &error));
+	g_assert_no_error (error);
+	g_assert_true (g_spawn_check_wait_status (status, &error));
+	g_assert_no_error (error);
+
+	/* alpm only downloads a database the server has a newer copy of */
+	filename = g_build_filename (mirror, db_name, NULL);
+	g_assert_cmpint (g_utime (filename, &times), ==, 0);
+}
+
+static guint
+alpm_test_count_pkgs (alpm_handle_t *handle, const gchar *name)
+{
+	const alpm_list_t *i;
+	alpm_db_t *db = NULL;
+
+	for (i = alpm_get_syncdbs (handle); i != NULL && db == NULL; i = i->next) {
+		if (g_strcmp0 (alpm_db_get_name (i->data), name) == 0)
+			db = i->data;
+	}
+	g_assert_nonnull (db);
+	return alpm_list_count (alpm_db_get_pkgcache (db));
+}
+
+static void
+alpm_test_assert_progress (GArray *percentages)
+{
+	g_assert_cmpuint (percentages->len, >, 0);
+	for (guint i = 1; i < percentages->len; i++) {
+		g_assert_cmpuint (g_array_index (percentages, guint, i - 1), <=,
+				  g_array_index (percentages, guint, i));
+	}
+	g_assert_cmpuint (g_array_index (percentages, guint, percentages->len - 1), ==, 100);
+}
+
+static void
+alpm_test_refresh_file_mirror (void)
+{
+	const gchar *names[] = { "pk-test-a", "pk-test-b", NULL };
+	g_autofree gchar *root = g_dir_make_tmp ("pk-alpm-test-XXXXXX", NULL);
+	g_autofree gchar *mirror = g_build_filename (root, "mirror", NULL);
+	g_autofree gchar *server = g_strconcat ("file://", mirror, NULL);
+	g_autofree gchar *dbpath = g_strconcat (root, "/var/lib/pacman/", NULL);
+	g_autofree gchar *timestamp = NULL;
+	g_autoptr(GError) error = NULL;
+	AlpmTestJob job = { 0 };
+	PkBackendJob *backend_job = (PkBackendJob *) &job;
+	alpm_errno_t alpm_err;
+	time_t now = time (NULL);
+
+	alpm_test_remove_dir (PK_ALPM_CACHE_DIR);
+	for (guint i = 0; names[i] != NULL; i++)
+		alpm_test_write_sync_db (root, mirror, names[i], 2, "1.0-1", now - 100);
+
+	g_assert_cmpint (g_mkdir_with_parents (dbpath, 0755), ==, 0);
+	job.priv.alpm = alpm_initialize (root, dbpath, &alpm_err);
+	g_assert_nonnull (job.priv.alpm);
+	job.priv.localdb = alpm_get_localdb (job.priv.alpm);
+	for (guint i = 0; names[i] != NULL; i++) {
+		alpm_db_t *db = alpm_register_syncdb (job.priv.alpm, names[i], 0);
+		g_assert_nonnull (db);
+		g_assert_cmpint (alpm_db_add_server (db, server), ==, 0);
+		pk_alpm_index_register ((PkBackend *) &job, job.priv.alpm, db);
+	}
+
+	/* without a cache age every database is downloaded */
+	job.cache_age = G_MAXUINT;
+	job.percentages = g_array_new (FALSE, FALSE, sizeof (guint));
+	g_assert_true (pk_alpm_refresh_databases (backend_job, job.priv.alpm, FALSE,
+						  alpm_get_syncdbs (job.priv.alpm), &error));
+	g_assert_no_error (error);
+	g_assert_cmpint (job.status, ==, PK_STATUS_ENUM_DOWNLOAD_REPOSITORY);
+	alpm_test_assert_progress (job.percentages);
+	for (guint i = 0; names[i] != NULL; i++) {
+		g_autofree gchar *fn = g_strconcat (PK_ALPM_CACHE_DIR, names[i], ".db.timestamp", NULL);
+		g_assert_true (g_file_test (fn, G_FILE_TEST_EXISTS));
+		g_assert_cmpuint (alpm_test_count_pkgs (job.priv.alpm, names[i]), ==, 2);
+	}
+
+	/* only the database without a fresh timestamp is downloaded again */
+	for (guint i = 0; names[i] != NULL; i++)
+		alpm_test_write_sync_db (root, mirror, names[i], 3, "2.0-1", now);
+	timestamp = g_strconcat (PK_ALPM_CACHE_DIR, "pk-test-b.db.timestamp", NULL);
+	g_assert_cmpint (g_unlink (timestamp), ==, 0);
+	job.cache_age = 3600;
+	job.status = PK_STATUS_ENUM_UNKNOWN;
+	g_array_set_size (job.percentages, 0);
+	g_assert_true (pk_alpm_refresh_databases (backend_job, job.priv.alpm, FALSE,
+						  alpm_get_syncdbs (job.priv.alpm), &error));
+	g_assert_no_error (error);
+	g_assert_cmpint (job.status, ==, PK_STATUS_ENUM_DOWNLOAD_REPOSITORY);
+	alpm_test_assert_progress (job.percentages);
+	g_assert_cmpuint (alpm_test_count_pkgs (job.priv.alpm, "pk-test-a"), ==, 2);
+	g_assert_cmpuint (alpm_test_count_pkgs (job.priv.alpm, "pk-test-b"), ==, 3);
+	g_assert_true (g_file_test (timestamp, G_FILE_TEST_EXISTS));
+
+	/* nothing is downloaded while every database is fresh */
+	job.status = PK_STATUS_ENUM_UNKNOWN;
+	g_array_set_size (job.percentages, 0);
+	g_assert_true (pk_alpm_refresh_databases (backend_job, job.priv.alpm, FALSE,
+						  alpm_get_syncdbs (job.priv.alpm), &error));
+	g_assert_no_error (error);
+	g_assert_cmpint (job.status, ==, PK_STATUS_ENUM_UNKNOWN);
+	g_assert_cmpuint (job.percentages->len, ==, 0);
+
+	/* forcing downloads the rest */
+	g_assert_true (pk_alpm_refresh_databases (backend_job, job.priv.alpm, TRUE,
+						  alpm_get_syncdbs (job.priv.alpm), &error));
+	g_assert_no_error (error);
+	alpm_test_assert_progress (job.percentages);
+	g_assert_cmpuint (alpm_test_count_pkgs (job.priv.alpm, "pk-test-a"), ==, 3);
+
+	g_array_unref (job.percentages);
+	pk_alpm_index_destroy ((PkBackend *) &job);
+	alpm_release (job.priv.alpm);
+	alpm_test_remove_dir (PK_ALPM_CACHE_DIR);
+	alpm_test_remove_dir (root);
+}
+
+/* what SearchFiles did before the index: every needle against every file list */
+static guint
+alpm_test_scan_files (alpm_db_t *db, const alpm_list_t *needles)
+{
+	const alpm_list_t *i, *j;
+	guint found = 0;
+
+	for (i = alpm_db_get_pkgcache (db); i != NULL; i = i->next) {
+		alpm_filelist_t *filelist = alpm_pkg_get_files (i->data);
+
+		for (j = needles; j != NULL; j = j->next) {
+			const gchar *needle = j->data;
+			gboolean match = FALSE;
+
+			for (gsize k = 0; k < filelist->count && !match; k++) {
+				const gchar *path = filelist->files[k].name;
+				const gchar *name = strrchr (path, G_DIR_SEPARATOR);
+
+				if (G_IS_DIR_SEPARATOR (*needle))
+					match = g_str_has_suffix (needle, G_DIR_SEPARATOR_S) ?
+						g_str_has_prefix (path, needle + 1) :
+						strcmp (path, needle + 1) == 0;
+				else
+					match = g_strcmp0 (name != NULL ? name + 1 : path, needle) == 0;
+			}
+			if (!match)
+				break;
+		}
+		if (j == NULL)
+			found++;
+	}
+	return found;
+}
+
+static void
+alpm_test_search_files_benchmark (void)
+{
+	const gchar *searches[][2] = {
+		{ "/usr/bin/pk-test-749", NULL },
+		{ "/usr/share/pk-test-12/", NULL },
+		{ "file-7", NULL },
+		{ "file-7", "/usr/bin/pk-test-1499" },
+		{ "/usr/bin/missing", NULL },
+	};
+	const guint expected[] = { 1, 1, ALPM_TEST_BENCHMARK_PACKAGES, 1, 0 };
+	g_autofree gchar *root = g_dir_make_tmp ("pk-alpm-test-XXXXXX", NULL);
+	g_autofree gchar *dbpath = NULL;
+	AlpmTestJob job = { 0 };
+	PkBackendAlpmPrivate *priv = &job.priv;
+	PkBackend *backend = (PkBackend *) &job;
+	alpm_errno_t alpm_err;
+	gdouble ms;
+	gdouble ms_scan;
+	guint k;
+
+	dbpath = g_strconcat (root, "/var/lib/pacman/", NULL);
+	alpm_test_write_local_db (dbpath, ALPM_TEST_BENCHMARK_PACKAGES);
+	priv->alpm = alpm_initialize (root, dbpath, &alpm_err);
+	g_assert_nonnull (priv->alpm);
+	priv->localdb = alpm_get_localdb (priv->alpm);
+	g_assert_cmpuint (alpm_list_count (alpm_db_get_pkgcache (priv->localdb)), ==,
+			  ALPM_TEST_BENCHMARK_PACKAGES);
+
+	/* check the first search builds the index and they all answer quickly */
+	g_test_timer_start ();
+	for (k = 0; k < G_N_ELEMENTS (searches); k++) {
+		g_autoptr(GHashTable) matches = NULL;
+		alpm_list_t *needles = NULL;
+
+		needles = alpm_list_add (needles, (gpointer) searches[k][0]);
+		if (searches[k][1] != NULL)
+			needles = alpm_list_add (needles, (gpointer) searches[k][1]);
+		matches = pk_alpm_index_find_files (backend, priv->localdb, needles);
+		g_assert_cmpuint (g_hash_table_size (matches), ==, expected[k]);
+		alpm_list_free (needles);
+	}
+	ms = g_test_timer_elapsed ();
+	g_test_message ("searched the files of %u packages %u times in %.3fs",
+			ALPM_TEST_BENCHMARK_PACKAGES, k, ms);
+	g_assert_cmpfloat (ms, <, 2.0);
+
+	/* compare with scanning every file list for every search */
+	if (g_test_perf ()) {
+		g_test_timer_start ();
+		for (k = 0; k < G_N_ELEMENTS (searches); k++) {
+			alpm_list_t *needles = NULL;
+
+			needles = alpm_list_add (needles, (gpointer) searches[k][0]);
+			if (searches[k][1] != NULL)
+				needles = alpm_list_add (needles, (gpointer) searches[k][1]);
+			g_assert_cmpuint (alpm_test_scan_files (priv->localdb, needles), ==, expected[k]);
+			alpm_list_free (needles);
+		}
+		ms_scan = g_test_timer_elapsed ();
+		g_test_minimized_result (ms_scan, "scanning file lists: %.3fs, indexed: %.3fs",
+					 ms_scan, ms);
+	}
+
+	pk_alpm_index_destroy (backend);
+	alpm_release (priv->alpm);
+	alpm_test_remove_dir (root);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/alpm/index/search-files-benchmark", alpm_test_search_files_benchmark);
+	g_test_add_func ("/alpm/refresh/file-mirror", alpm_test_refresh_file_mirror);
+
+	return g_test_run ();
+}
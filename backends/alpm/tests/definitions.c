@@ -0,0 +1,59 @@
+#include "definitions.h"
+
+/* Define symbols used by libpk_backend_alpm,
+ * otherwise we can't link it.
+ */
+
+gpointer
+pk_backend_get_user_data (PkBackend *backend)
+{
+	return &((AlpmTestJob *) backend)->priv;
+}
+
+gpointer
+pk_backend_job_get_backend (PkBackendJob *job)
+{
+	return job;
+}
+
+gboolean
+pk_backend_job_is_cancelled (PkBackendJob *job)
+{
+	return FALSE;
+}
+
+guint
+pk_backend_job_get_cache_age (PkBackendJob *job)
+{
+	return ((AlpmTestJob *) job)->cache_age;
+}
+
+void
+pk_backend_job_set_status (PkBackendJob *job, PkStatusEnum status)
+{
+	((AlpmTestJob *) job)->status = status;
+}
+
+void
+pk_backend_job_set_percentage (PkBackendJob *job, guint percentage)
+{
+	AlpmTestJob *test_job = (AlpmTestJob *) job;
+
+	if (test_job->percentages != NULL)
+		g_array_append_val (test_job->percentages, percentage);
+}
+
+void
+pk_backend_job_package (PkBackendJob *job,
+			PkInfoEnum info,
+			const gchar *package_id,
+			const gchar *summary)
+{
+}
+
+void
+pk_backend_job_error_code (PkBackendJob *job,
+			   PkErrorEnum code,
+			   const gchar *details, ...)
+{
+}
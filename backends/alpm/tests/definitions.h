@@ -0,0 +1,17 @@
+#ifndef __ALPM_TEST_DEFINITIONS_H
+#define __ALPM_TEST_DEFINITIONS_H
+
+#include <pk-backend.h>
+#include <pk-backend-job.h>
+
+#include "pk-backend-alpm.h"
+
+/* Stands in for both the job and the backend of the alpm code */
+typedef struct {
+	PkBackendAlpmPrivate	 priv; /* first, so the job is also the backend */
+	guint			 cache_age;
+	PkStatusEnum		 status;
+	GArray			*percentages;
+} AlpmTestJob;
+
+#endif /* __ALPM_TEST_DEFINITIONS_H */
@@ -55,6 +55,7 @@
 #include "gst-matcher.h"
 #include "apt-messages.h"
 #include "acqpkitstatus.h"
+#include "apt-plan-cache.h"
 #include "deb-file.h"
 
 using namespace APT;
@@ -2205,6 +2206,9 @@ void AptJob::refreshCache()
     // do the work
     ListUpdate(Stat, *m_cache->GetSourceList());
 
+    // a plan resolved against the old lists must not be replayed
+    AptPlanCache::instance().clear();
+
     // Rebuild the cache.
     pkgCacheFile::RemoveCaches();
     if (m_cache->BuildCaches() == false) {
@@ -2248,11 +2252,9 @@ PkgList AptJob::resolveLocalFiles(gchar **localDebs)
     return ret;
 }
 
-bool AptJob::runTransaction(const PkgList &install, const PkgList &remove, const PkgList &update,
-                             bool fixBroken, PkBitfield flags, bool autoremove)
+bool AptJob::resolveTransaction(const PkgList &install, const PkgList &remove, const PkgList &update,
+                                 bool autoremove)
 {
-    pk_backend_job_set_status (m_job, PK_STATUS_ENUM_RUNNING);
-
     // Enter the special broken fixing mode if the user specified arguments
     // THIS mode will run if fixBroken is false and the cache has broken packages
     bool attemptFixBroken = false;
@@ -2339,6 +2341,37 @@ bool AptJob::runTransaction(const PkgList &install, const PkgList &remove, const
         }
     }
 
+    return true;
+}
+
+bool AptJob::runTransaction(const PkgList &install, const PkgList &remove, const PkgList &update,
+                             bool fixBroken, PkBitfield flags, bool autoremove)
+{
+    pk_backend_job_set_status (m_job, PK_STATUS_ENUM_RUNNING);
+
+    // PkTask simulates a transaction before running it for real, remember the
+    // resolved plan of the simulation so the commit does not need to resolve again.
+    // Local files are excluded since their contents are not part of the key.
+    const bool simulate = pk_bitfield_contain(flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE);
+    const PkRoleEnum role = pk_backend_job_get_role(m_job);
+    string planKey;
+    if (role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
+            role == PK_ROLE_ENUM_UPDATE_PACKAGES ||
+            role == PK_ROLE_ENUM_REMOVE_PACKAGES) {
+        planKey = AptPlanCache::planKey(install, remove, update, fixBroken, flags, autoremove);
+    }
+
+    if (simulate || planKey.empty() ||
+            !AptPlanCache::instance().restore(planKey, *m_cache->GetDepCache())) {
+        if (!resolveTransaction(install, remove, update, autoremove)) {
+            return false;
+        }
+
+        if (simulate && !planKey.empty()) {
+            AptPlanCache::instance().store(planKey, *m_cache->GetDepCache());
+        }
+    }
+
     // Prepare for the restart thing
     struct stat restartStatStart;
     if (g_file_test(REBOOT_REQUIRED_FILE, G_FILE_TEST_EXISTS)) {
@@ -242,6 +242,14 @@ public:
     AptCacheFile* aptCacheFile() const;
 
 private:
+    /**
+     * marks the requested changes and runs the problem resolver on them
+     */
+    bool resolveTransaction(const PkgList &install,
+                            const PkgList &remove,
+                            const PkgList &update,
+                            bool autoremove);
+
     void setEnvLocaleFromJob();
     bool checkTrusted(pkgAcquire &fetcher, PkBitfield flags);
     bool packageIsSupported(const pkgCache::VerIterator &verIter, string component);
@@ -0,0 +1,215 @@
+/* apt-plan-cache.cpp
+ *
+ * Copyright (c) 2026 The PackageKit Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "apt-plan-cache.h"
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+
+#include <sys/stat.h>
+#include <sstream>
+
+AptPlanCache &AptPlanCache::instance()
+{
+    static AptPlanCache cache;
+    return cache;
+}
+
+static void appendPkgList(std::ostringstream &out, const char *prefix, const PkgList &pkgs)
+{
+    out << prefix;
+    for (const PkgInfo &pki : pkgs) {
+        out << pki.ver.ParentPkg().FullName(false) << "="
+            << pki.ver.VerStr() << "/"
+            << static_cast<int>(pki.action) << ";";
+    }
+    out << "|";
+}
+
+std::string AptPlanCache::planKey(const PkgList &install,
+                                  const PkgList &remove,
+                                  const PkgList &update,
+                                  bool fixBroken,
+                                  PkBitfield flags,
+                                  bool autoremove)
+{
+    std::ostringstream out;
+    appendPkgList(out, "i:", install);
+    appendPkgList(out, "r:", remove);
+    appendPkgList(out, "u:", update);
+
+    // the simulate flag is exactly what differs between the two runs
+    pk_bitfield_remove(flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE);
+    out << "f:" << flags << "|b:" << fixBroken << "|a:" << autoremove;
+
+    return out.str();
+}
+
+static void appendFileStamp(std::ostringstream &out, const std::string &path)
+{
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0) {
+        out << "-;";
+        return;
+    }
+
+    out << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec << ":" << st.st_size << ";";
+}
+
+std::string AptPlanCache::cacheGeneration()
+{
+    std::ostringstream out;
+
+    // Anything that changes the dpkg status, the available versions or
+    // their pinning invalidates a previously resolved plan
+    appendFileStamp(out, _config->FindFile("Dir::State::status"));
+    appendFileStamp(out, _config->FindFile("Dir::Cache::pkgcache"));
+    appendFileStamp(out, _config->FindDir("Dir::State::lists"));
+    appendFileStamp(out, _config->FindFile("Dir::State::extended_states"));
+    appendFileStamp(out, _config->FindFile("Dir::Etc::sourcelist"));
+    appendFileStamp(out, _config->FindDir("Dir::Etc::sourceparts"));
+    appendFileStamp(out, _config->FindFile("Dir::Etc::preferences"));
+    appendFileStamp(out, _config->FindDir("Dir::Etc::preferencesparts"));
+
+    return out.str();
+}
+
+void AptPlanCache::store(const std::string &key, pkgDepCache &cache)
+{
+    std::vector<PlanItem> plan;
+    for (pkgCache::PkgIterator pkg = cache.PkgBegin(); !pkg.end(); ++pkg) {
+        const pkgDepCache::StateCache &state = cache[pkg];
+        const bool reinstall = (state.iFlags & pkgDepCache::ReInstall) != 0;
+        if (state.Mode == pkgDepCache::ModeKeep && !reinstall)
+            continue;
+
+        PlanItem item;
+        item.pkgName = pkg.FullName(false);
+        item.remove = state.Mode == pkgDepCache::ModeDelete;
+        item.purge = (state.iFlags & pkgDepCache::Purge) != 0;
+        item.reinstall = reinstall;
+        item.autoInstalled = (state.Flags & pkgCache::Flag::Auto) != 0;
+        if (!item.remove) {
+            const pkgCache::VerIterator candVer = state.CandidateVerIter(cache);
+            if (candVer.end())
+                return;
+            item.version = candVer.VerStr();
+        }
+
+        plan.push_back(item);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_key = key;
+    m_generation = cacheGeneration();
+    m_created = g_get_monotonic_time();
+    m_instCount = cache.InstCount();
+    m_delCount = cache.DelCount();
+    m_plan = std::move(plan);
+
+    g_debug("Stored simulated transaction plan with %zu changes", m_plan.size());
+}
+
+bool AptPlanCache::restore(const std::string &key, pkgDepCache &cache)
+{
+    std::vector<PlanItem> plan;
+    unsigned long instCount;
+    unsigned long delCount;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_key.empty() || m_key != key) {
+            return false;
+        }
+
+        const bool expired = (g_get_monotonic_time() - m_created) / G_USEC_PER_SEC > APT_PLAN_CACHE_TTL;
+        const bool outdated = m_generation != cacheGeneration();
+        plan = std::move(m_plan);
+        instCount = m_instCount;
+        delCount = m_delCount;
+
+        // a plan is only ever good for one commit
+        m_key.clear();
+        m_plan.clear();
+
+        if (expired || outdated) {
+            g_debug("Not reusing simulated transaction plan (expired: %i, outdated: %i)",
+                    expired, outdated);
+            return false;
+        }
+    }
+
+    bool ok = true;
+    {
+        pkgDepCache::ActionGroup group(cache);
+
+        for (const PlanItem &item : plan) {
+            pkgCache::PkgIterator pkg = cache.FindPkg(item.pkgName);
+            if (pkg.end()) {
+                ok = false;
+                break;
+            }
+
+            if (item.remove) {
+                cache.MarkDelete(pkg, item.purge);
+                continue;
+            }
+
+            pkgCache::VerIterator ver = pkg.VersionList();
+            for (; !ver.end(); ++ver) {
+                if (item.version == ver.VerStr())
+                    break;
+            }
+            if (ver.end()) {
+                ok = false;
+                break;
+            }
+
+            cache.SetCandidateVersion(ver);
+            cache.MarkInstall(pkg, false, 0, !item.autoInstalled);
+            cache.MarkAuto(pkg, item.autoInstalled);
+            if (item.reinstall)
+                cache.SetReInstall(pkg, true);
+        }
+    }
+
+    if (ok && (cache.BrokenCount() != 0 ||
+               cache.InstCount() != instCount ||
+               cache.DelCount() != delCount)) {
+        ok = false;
+    }
+
+    if (!ok) {
+        g_debug("Failed to replay simulated transaction plan, resolving again");
+        // drop whatever we marked so far so the caller starts from a clean state
+        cache.Init(nullptr);
+        _error->Discard();
+        return false;
+    }
+
+    g_debug("Reusing simulated transaction plan with %zu changes", plan.size());
+    return true;
+}
+
+void AptPlanCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_key.clear();
+    m_plan.clear();
+}
@@ -0,0 +1,102 @@
+/* apt-plan-cache.h
+ *
+ * Copyright (c) 2026 The PackageKit Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef APT_PLAN_CACHE_H
+#define APT_PLAN_CACHE_H
+
+#include <apt-pkg/depcache.h>
+#include <pk-backend.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pkg-list.h"
+
+// Seconds a simulated plan stays valid for a following commit
+#define APT_PLAN_CACHE_TTL 120
+
+/**
+ * Keeps the resolved plan of the last simulated transaction around,
+ * so the real transaction that usually follows (e.g. from PkTask) can
+ * replay the marks instead of running the problem resolver again.
+ */
+class AptPlanCache
+{
+public:
+    static AptPlanCache &instance();
+
+    /**
+     * Builds a key describing the requested transaction, independent of
+     * the simulate flag.
+     */
+    static std::string planKey(const PkgList &install,
+                               const PkgList &remove,
+                               const PkgList &update,
+                               bool fixBroken,
+                               PkBitfield flags,
+                               bool autoremove);
+
+    /**
+     * Returns a string identifying the state of the package database,
+     * sources and preferences the plan was resolved against.
+     */
+    static std::string cacheGeneration();
+
+    /**
+     * Serializes the marks currently set on the dependency cache.
+     */
+    void store(const std::string &key, pkgDepCache &cache);
+
+    /**
+     * Replays a stored plan onto a freshly opened dependency cache.
+     * The stored plan is consumed in any case.
+     * @returns false if no matching plan exists or it could not be applied,
+     * in that case all marks on the cache are reset.
+     */
+    bool restore(const std::string &key, pkgDepCache &cache);
+
+    /**
+     * Drops the stored plan, e.g. after the package lists were refreshed.
+     */
+    void clear();
+
+private:
+    AptPlanCache() = default;
+
+    struct PlanItem {
+        std::string pkgName;
+        std::string version;
+        bool remove;
+        bool purge;
+        bool reinstall;
+        bool autoInstalled;
+    };
+
+    std::mutex m_mutex;
+    std::string m_key;
+    std::string m_generation;
+    gint64 m_created = 0;
+    unsigned long m_instCount = 0;
+    unsigned long m_delCount = 0;
+    std::vector<PlanItem> m_plan;
+};
+
+#endif // APT_PLAN_CACHE_H
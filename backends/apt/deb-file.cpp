@@ -26,7 +26,29 @@
 #include <apt-pkg/init.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/fileutl.h>
+#include <sys/stat.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+
+// Maximum number of archives we keep parsed data around for
+#define DEB_FILE_CACHE_MAX_ENTRIES 32
+
+struct DebFileData
+{
+    off_t size = 0;
+    struct timespec mtime = {};
+
+    // raw control stanza, including the two trailing newlines pkgTagSection expects
+    string control;
+
+    std::mutex filesMutex;
+    bool filesLoaded = false;
+    std::vector<std::string> files;
+};
+
+static std::mutex debFileCacheMutex;
+static std::map<string, std::shared_ptr<DebFileData>> debFileCache;
 
 class GetFilesStream : public pkgDirStream
 {
@@ -34,45 +56,104 @@ public:
     std::vector<std::string> files;
 
     virtual bool DoItem(Item &Itm,int &Fd) override {
+        // Only collect the member names, we never want the payload written anywhere
         Fd = -1;
         files.push_back(Itm.Name);
         return true;
     }
 };
 
-DebFile::DebFile(const string &filename)
+static std::shared_ptr<DebFileData> debFileLookupCache(const string &filename, const struct stat &st)
 {
-    FileFd in(filename, FileFd::ReadOnly);
-    debDebFile deb(in);
+    std::lock_guard<std::mutex> lock(debFileCacheMutex);
+    auto it = debFileCache.find(filename);
+    if (it == debFileCache.end())
+        return nullptr;
 
-    // Extract control data
-    m_extractor = new debDebFile::MemControlExtract("control");
-    if (!m_extractor->Read(deb)) {
-        return;
+    if (it->second->size != st.st_size ||
+        it->second->mtime.tv_sec != st.st_mtim.tv_sec ||
+        it->second->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+        // the file changed on disk, drop stale data
+        debFileCache.erase(it);
+        return nullptr;
     }
 
-    if(!m_controlData.Scan(m_extractor->Control,m_extractor->Length+2)) {
-        g_warning("DebFile: Scan failed.");
+    return it->second;
+}
+
+static void debFileStoreCache(const string &filename, const std::shared_ptr<DebFileData> &data)
+{
+    std::lock_guard<std::mutex> lock(debFileCacheMutex);
+    if (debFileCache.size() >= DEB_FILE_CACHE_MAX_ENTRIES)
+        debFileCache.clear();
+    debFileCache[filename] = data;
+}
+
+DebFile::DebFile(const string &filename)
+    : m_filename(filename)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        g_warning("DebFile: Unable to stat %s", filename.c_str());
         return;
     }
 
-    GetFilesStream stream;
-    if (deb.ExtractArchive(stream) == false) {
+    m_data = debFileLookupCache(filename, st);
+    if (!m_data) {
+        FileFd in(filename, FileFd::ReadOnly);
+        debDebFile deb(in);
+
+        // Extract control data only, the (potentially huge) data member
+        // is left alone until someone asks for the file list
+        debDebFile::MemControlExtract extractor("control");
+        if (!extractor.Read(deb)) {
+            return;
+        }
+
+        auto data = std::make_shared<DebFileData>();
+        data->size = st.st_size;
+        data->mtime = st.st_mtim;
+        data->control.assign(extractor.Control, extractor.Length + 2);
+        m_data = data;
+    }
+
+    if(!m_controlData.Scan(m_data->control.c_str(), m_data->control.length())) {
+        g_warning("DebFile: Scan failed.");
+        m_data.reset();
         return;
     }
-    m_files = stream.files;
 
+    debFileStoreCache(filename, m_data);
     m_isValid = true;
 }
 
 DebFile::~DebFile()
 {
-    delete m_extractor;
 }
 
 std::vector<std::string> DebFile::files() const
 {
-    return m_files;
+    if (!m_data)
+        return {};
+
+    std::lock_guard<std::mutex> lock(m_data->filesMutex);
+    if (!m_data->filesLoaded) {
+        FileFd in(m_filename, FileFd::ReadOnly);
+        debDebFile deb(in);
+
+        // The tar headers are interleaved with the payload, so the data member
+        // still has to be decompressed, but nothing is written out
+        GetFilesStream stream;
+        if (deb.ExtractArchive(stream)) {
+            // a failed read is retried on the next call
+            m_data->files = std::move(stream.files);
+            m_data->filesLoaded = true;
+        } else {
+            g_warning("DebFile: Unable to read the file list of %s", m_filename.c_str());
+        }
+    }
+
+    return m_data->files;
 }
 
 bool DebFile::isValid() const
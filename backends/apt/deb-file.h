@@ -24,9 +24,19 @@
 #define DEB_FILE_H
 
 #include <apt-pkg/debfile.h>
+#include <memory>
 
 using std::string;
 
+struct DebFileData;
+
+/**
+ * Lazy view on a local .deb archive.
+ *
+ * Only the control member is read on construction, the data member is
+ * only walked once files() is called. Parsed results are shared between
+ * instances as long as the file's path, size and mtime stay the same.
+ */
 class DebFile
 {
 public:
@@ -48,10 +58,10 @@ public:
     string errorMsg() const;
 
 private:
-    debDebFile::MemControlExtract *m_extractor;
+    string m_filename;
+    std::shared_ptr<DebFileData> m_data;
     pkgTagSection m_controlData;
     string m_errorMsg;
-    std::vector<std::string> m_files;
     bool m_isValid = false;
 };
 
@@ -18,11 +18,18 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#include <algorithm>
 #include <filesystem>
 #include <memory>
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/cachefile.h>
 #include <apt-pkg/configuration.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
 
 #include "deb822.h"
+#include "deb-file.h"
+#include "apt-plan-cache.h"
 #include "apt-sourceslist.h"
 #include "gst-matcher.h"
 
@@ -450,6 +457,133 @@ apt_test_sources_write (void)
     fs::remove_all(wtestSourcesDir);
 }
 
+static void
+apt_test_deb_file_lazy (void)
+{
+    const std::string debPath = testdata_dir + "/debs/pk-hello_1.0-1_all.deb";
+    std::vector<std::string> files;
+
+    {
+        DebFile deb(debPath);
+        g_assert_true(deb.isValid());
+        g_assert_cmpstr(deb.packageName().c_str(), ==, "pk-hello");
+        g_assert_cmpstr(deb.version().c_str(), ==, "1.0-1");
+        g_assert_cmpstr(deb.architecture().c_str(), ==, "all");
+        g_assert_cmpstr(deb.summary().c_str(), ==, "PackageKit test package");
+
+        files = deb.files();
+        g_assert_true(std::find(files.begin(), files.end(), "./usr/share/pk-hello/hello.txt") != files.end());
+    }
+
+    {
+        // second instance is served from the cache, including the file list
+        DebFile deb(debPath);
+        g_assert_true(deb.isValid());
+        g_assert_cmpstr(deb.packageName().c_str(), ==, "pk-hello");
+        g_assert_true(deb.files() == files);
+    }
+
+    {
+        DebFile deb(testdata_dir + "/debs/does-not-exist.deb");
+        g_assert_false(deb.isValid());
+        g_assert_true(deb.files().empty());
+    }
+}
+
+/**
+ * Resolves the removal of pk-lib, which takes pk-app with it,
+ * the same way a simulated RemovePackages transaction would.
+ */
+static void
+_plan_cache_resolve_removal (pkgDepCache *cache)
+{
+    pkgCache::PkgIterator lib = cache->FindPkg("pk-lib");
+    g_assert_false(lib.end());
+
+    pkgProblemResolver fix(cache);
+    fix.Clear(lib);
+    fix.Protect(lib);
+    cache->MarkDelete(lib, false);
+    g_assert_true(fix.Resolve(true));
+
+    g_assert_cmpuint(cache->DelCount(), ==, 2);
+    g_assert_cmpuint(cache->BrokenCount(), ==, 0);
+}
+
+static void
+apt_test_plan_cache_replay (void)
+{
+    std::string workDir = testdata_dir + "/plan-cache.tmp";
+
+    if (fs::exists(workDir))
+        fs::remove_all(workDir);
+    fs::create_directories(workDir + "/lists/partial");
+    fs::create_directories(workDir + "/sources.list.d");
+    fs::create_directories(workDir + "/preferences.d");
+
+    // a system with only the packages of the status file and no sources
+    g_assert_true(pkgInitConfig(*_config));
+    _config->Set("Dir::State::status", testdata_dir + "/plan-cache/status");
+    _config->Set("Dir::State::lists", workDir + "/lists/");
+    _config->Set("Dir::State::extended_states", workDir + "/extended_states");
+    _config->Set("Dir::Etc::sourcelist", workDir + "/sources.list");
+    _config->Set("Dir::Etc::sourceparts", workDir + "/sources.list.d");
+    _config->Set("Dir::Etc::preferences", workDir + "/preferences");
+    _config->Set("Dir::Etc::preferencesparts", workDir + "/preferences.d");
+    _config->Set("Dir::Cache::pkgcache", "");
+    _config->Set("Dir::Cache::srcpkgcache", "");
+    _config->Set("Debug::NoLocking", true);
+    g_assert_true(pkgInitSystem(*_config, _system));
+
+    pkgCacheFile cacheFile;
+    g_assert_true(cacheFile.Open(nullptr, false));
+    pkgDepCache *cache = cacheFile.GetDepCache();
+    g_assert_nonnull(cache);
+
+    AptPlanCache &planCache = AptPlanCache::instance();
+    const PkgList noPkgs;
+    const std::string key = AptPlanCache::planKey(noPkgs, noPkgs, noPkgs, false, 0, false);
+    const std::string otherKey = AptPlanCache::planKey(noPkgs, noPkgs, noPkgs, true, 0, false);
+
+    // simulation: resolve and remember the plan
+    _plan_cache_resolve_removal(cache);
+    planCache.store(key, *cache);
+
+    // commit: a fresh cache gets the very same marks without resolving
+    cache->Init(nullptr);
+    g_assert_cmpuint(cache->DelCount(), ==, 0);
+    g_assert_false(planCache.restore(otherKey, *cache));
+    g_assert_true(planCache.restore(key, *cache));
+    g_assert_cmpuint(cache->DelCount(), ==, 2);
+    g_assert_cmpuint(cache->BrokenCount(), ==, 0);
+    g_assert_true((*cache)[cache->FindPkg("pk-app")].Delete());
+    g_assert_true((*cache)[cache->FindPkg("pk-lib")].Delete());
+    g_assert_false((*cache)[cache->FindPkg("pk-extra")].Delete());
+
+    // the plan was consumed by the commit
+    cache->Init(nullptr);
+    g_assert_false(planCache.restore(key, *cache));
+
+    // if replaying does not end up with the stored counts, the marks are
+    // dropped again so the caller resolves from a clean state
+    _plan_cache_resolve_removal(cache);
+    planCache.store(key, *cache);
+    cache->Init(nullptr);
+    cache->MarkDelete(cache->FindPkg("pk-extra"), false);
+    g_assert_false(planCache.restore(key, *cache));
+    g_assert_cmpuint(cache->DelCount(), ==, 0);
+
+    // refreshing the cache drops any stored plan
+    _plan_cache_resolve_removal(cache);
+    planCache.store(key, *cache);
+    planCache.clear();
+    cache->Init(nullptr);
+    g_assert_false(planCache.restore(key, *cache));
+
+    cacheFile.Close();
+    fs::remove_all(workDir);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -473,6 +607,8 @@ main (int argc, char **argv)
     g_test_add_func ("/apt/deb822/readwrite", apt_test_deb822);
     g_test_add_func ("/apt/sources/read", apt_test_sources_read);
     g_test_add_func ("/apt/sources/write", apt_test_sources_write);
+    g_test_add_func ("/apt/deb-file/lazy", apt_test_deb_file_lazy);
+    g_test_add_func ("/apt/plan-cache/replay", apt_test_plan_cache_replay);
 
     return g_test_run();
 }
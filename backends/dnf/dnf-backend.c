@@ -26,6 +26,7 @@
 #include <glib/gstdio.h>
 
 #include <libdnf/libdnf.h>
+#include <libdnf/hy-query.h>
 
 #include "dnf-backend.h"
 
@@ -278,3 +279,147 @@ dnf_get_filter_for_ids (gchar **package_ids)
 		filters = pk_bitfield_value (PK_FILTER_ENUM_INSTALLED);
 	return filters;
 }
+
+static gchar *
+dnf_utils_package_key (const gchar *name, const gchar *evr, const gchar *arch)
+{
+	/* an epoch of zero is implicit */
+	if (g_str_has_prefix (evr, "0:"))
+		evr += 2;
+	return g_strdup_printf ("%s;%s;%s", name, evr, arch);
+}
+
+/**
+ * dnf_utils_find_package_ids:
+ *
+ * Returns a hash table of all the packages found in the sack.
+ * If a specific package-id is not found then the method does not fail, but
+ * no package will be inserted into the hash table.
+ *
+ * If multiple packages are found, an error is returned, as the package-id is
+ * supposed to uniquely identify the package across all repos.
+ */
+GHashTable *
+dnf_utils_find_package_ids (DnfSack *sack, gchar **package_ids, GError **error)
+{
+	const gchar *reponame;
+	gboolean ret = TRUE;
+	GHashTable *hash;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint i;
+	DnfPackage *pkg;
+	g_autoptr(GHashTable) names_by_repo = NULL;
+	g_autoptr(GHashTable) ids_by_repo = NULL;
+
+	/* group the names by repo and remember which package-ids each
+	 * name;evr;arch stands for, several if they only differ by an
+	 * explicit zero epoch */
+	hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+				      g_free, (GDestroyNotify) g_object_unref);
+	names_by_repo = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, (GDestroyNotify) g_ptr_array_unref);
+	ids_by_repo = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_hash_table_unref);
+	for (i = 0; package_ids[i] != NULL; i++) {
+		g_auto(GStrv) split = NULL;
+		GPtrArray *names;
+		GPtrArray *key_ids;
+		GHashTable *ids;
+		gchar *pkg_key;
+
+		split = pk_package_id_split (package_ids[i]);
+		if (split == NULL)
+			continue;
+		reponame = split[PK_PACKAGE_ID_DATA];
+		if (g_strcmp0 (reponame, "installed") == 0 ||
+		    g_str_has_prefix (reponame, "installed:"))
+			reponame = HY_SYSTEM_REPO_NAME;
+		else if (g_strcmp0 (reponame, "local") == 0)
+			reponame = HY_CMDLINE_REPO_NAME;
+
+		names = g_hash_table_lookup (names_by_repo, reponame);
+		if (names == NULL) {
+			names = g_ptr_array_new_with_free_func (g_free);
+			g_hash_table_insert (names_by_repo, g_strdup (reponame), names);
+			ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						     (GDestroyNotify) g_ptr_array_unref);
+			g_hash_table_insert (ids_by_repo, g_strdup (reponame), ids);
+		} else {
+			ids = g_hash_table_lookup (ids_by_repo, reponame);
+		}
+		g_ptr_array_add (names, g_strdup (split[PK_PACKAGE_ID_NAME]));
+		pkg_key = dnf_utils_package_key (split[PK_PACKAGE_ID_NAME],
+						 split[PK_PACKAGE_ID_VERSION],
+						 split[PK_PACKAGE_ID_ARCH]);
+		key_ids = g_hash_table_lookup (ids, pkg_key);
+		if (key_ids == NULL) {
+			key_ids = g_ptr_array_new ();
+			g_hash_table_insert (ids, pkg_key, key_ids);
+		} else {
+			g_free (pkg_key);
+		}
+		g_ptr_array_add (key_ids, package_ids[i]);
+	}
+
+	/* one query per repo, matching the EVR and arch in the hash */
+	g_hash_table_iter_init (&iter, names_by_repo);
+	while (ret && g_hash_table_iter_next (&iter, &key, &value)) {
+		GPtrArray *names = value;
+		GHashTable *ids = g_hash_table_lookup (ids_by_repo, key);
+		g_autoptr(GPtrArray) pkglist = NULL;
+		HyQuery query;
+
+		g_ptr_array_add (names, NULL);
+		query = hy_query_create (sack);
+		hy_query_filter (query, HY_PKG_REPONAME, HY_EQ, key);
+		hy_query_filter_in (query, HY_PKG_NAME, HY_EQ, (const gchar **) names->pdata);
+		pkglist = hy_query_run (query);
+		hy_query_free (query);
+
+		for (i = 0; ret && i < pkglist->len; i++) {
+			g_autofree gchar *pkg_key = NULL;
+			GPtrArray *key_ids;
+
+			pkg = g_ptr_array_index (pkglist, i);
+			pkg_key = dnf_utils_package_key (dnf_package_get_name (pkg),
+							 dnf_package_get_evr (pkg),
+							 dnf_package_get_arch (pkg));
+			key_ids = g_hash_table_lookup (ids, pkg_key);
+			if (key_ids == NULL)
+				continue;
+
+			for (guint j = 0; j < key_ids->len; j++) {
+				const gchar *package_id = g_ptr_array_index (key_ids, j);
+				DnfPackage *found = g_hash_table_lookup (hash, package_id);
+
+				/* the same package-id was asked for twice */
+				if (found == pkg)
+					continue;
+
+				/* multiple matches */
+				if (found != NULL) {
+					ret = FALSE;
+					g_set_error (error,
+						     DNF_ERROR,
+						     PK_ERROR_ENUM_PACKAGE_CONFLICTS,
+						     "Multiple matches of %s", package_id);
+					g_debug ("possible matches: %s, %s",
+						 dnf_package_get_package_id (found),
+						 dnf_package_get_package_id (pkg));
+					break;
+				}
+
+				/* add to results */
+				g_hash_table_insert (hash,
+						     g_strdup (package_id),
+						     g_object_ref (pkg));
+			}
+		}
+	}
+	if (!ret) {
+		g_hash_table_unref (hash);
+		hash = NULL;
+	}
+	return hash;
+}
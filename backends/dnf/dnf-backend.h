@@ -26,6 +26,7 @@
 
 #include <libdnf/dnf-advisory.h>
 #include <libdnf/dnf-package.h>
+#include <libdnf/dnf-sack.h>
 
 #include <pk-backend.h>
 
@@ -48,6 +49,9 @@ void		 dnf_emit_package_list_filter	(PkBackendJob		*job,
 						 PkBitfield		 filters,
 						 GPtrArray		*pkglist);
 PkBitfield	 dnf_get_filter_for_ids		(gchar			**package_ids);
+GHashTable	*dnf_utils_find_package_ids	(DnfSack		*sack,
+						 gchar			**package_ids,
+						 GError			**error);
 
 G_END_DECLS
 
@@ -0,0 +1,218 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * A cache of sacks keyed by what was loaded into them.
+ *
+ * Even read-only queries write to the libsolv pool of a sack (the provides
+ * index, the temporary string space, ...), so a sack is only ever used by
+ * one owner at a time. Owners asking for a key while all of its sacks are
+ * claimed create another one and add it, so the number of sacks per key
+ * follows the number of jobs running at the same time. Once the jobs are
+ * done only a few of them are kept around.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "dnf-sack-pool.h"
+
+#define DNF_SACK_POOL_MAX_IDLE	2	/* per key */
+
+typedef struct {
+	GPtrArray	*sacks;		/* of DnfSack */
+	GTimer		*timer;
+} DnfSackPoolItem;
+
+struct _DnfSackPool {
+	GMutex		 mutex;
+	GHashTable	*items;		/* of key → DnfSackPoolItem */
+	GHashTable	*owners;	/* of DnfSack → owner */
+};
+
+static void
+dnf_sack_pool_item_free (DnfSackPoolItem *item)
+{
+	g_ptr_array_unref (item->sacks);
+	g_timer_destroy (item->timer);
+	g_slice_free (DnfSackPoolItem, item);
+}
+
+/* drops the unclaimed sacks of @item above DNF_SACK_POOL_MAX_IDLE */
+static void
+dnf_sack_pool_item_trim (DnfSackPool *pool, const gchar *key, DnfSackPoolItem *item)
+{
+	guint idle = 0;
+
+	for (guint i = 0; i < item->sacks->len;) {
+		DnfSack *sack = g_ptr_array_index (item->sacks, i);
+
+		if (g_hash_table_contains (pool->owners, sack) ||
+		    ++idle <= DNF_SACK_POOL_MAX_IDLE) {
+			i++;
+			continue;
+		}
+		g_ptr_array_remove_index (item->sacks, i);
+	}
+	if (idle > DNF_SACK_POOL_MAX_IDLE)
+		g_debug ("dropped %u idle sacks %s", idle - DNF_SACK_POOL_MAX_IDLE, key);
+}
+
+DnfSackPool *
+dnf_sack_pool_new (void)
+{
+	DnfSackPool *pool = g_new0 (DnfSackPool, 1);
+
+	g_mutex_init (&pool->mutex);
+	pool->items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					     (GDestroyNotify) dnf_sack_pool_item_free);
+	pool->owners = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      g_object_unref, NULL);
+	return pool;
+}
+
+void
+dnf_sack_pool_free (DnfSackPool *pool)
+{
+	g_hash_table_unref (pool->items);
+	g_hash_table_unref (pool->owners);
+	g_mutex_clear (&pool->mutex);
+	g_free (pool);
+}
+
+/**
+ * dnf_sack_pool_claim:
+ *
+ * Returns a sack cached for @key that no other owner is using, or the one
+ * @owner claimed before. The sack stays claimed until
+ * dnf_sack_pool_release() is called for @owner.
+ *
+ * Returns: (transfer full): a sack, or %NULL if there is none to use
+ */
+DnfSack *
+dnf_sack_pool_claim (DnfSackPool *pool, const gchar *key, gpointer owner)
+{
+	DnfSackPoolItem *item;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->mutex);
+
+	item = g_hash_table_lookup (pool->items, key);
+	if (item == NULL)
+		return NULL;
+	for (guint i = 0; i < item->sacks->len; i++) {
+		DnfSack *sack = g_ptr_array_index (item->sacks, i);
+		gpointer sack_owner = g_hash_table_lookup (pool->owners, sack);
+
+		if (sack_owner != NULL && sack_owner != owner)
+			continue;
+		if (sack_owner == NULL)
+			g_hash_table_insert (pool->owners, g_object_ref (sack), owner);
+		g_timer_start (item->timer);
+		return g_object_ref (sack);
+	}
+	g_debug ("all %u sacks %s are in use", item->sacks->len, key);
+	return NULL;
+}
+
+/**
+ * dnf_sack_pool_add:
+ *
+ * Caches @sack for @key, claimed by @owner unless that is %NULL. With
+ * @replace the sacks cached for @key before are dropped, owners using them
+ * keep them until released.
+ */
+void
+dnf_sack_pool_add (DnfSackPool *pool,
+		   const gchar *key,
+		   DnfSack *sack,
+		   gpointer owner,
+		   gboolean replace)
+{
+	DnfSackPoolItem *item;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->mutex);
+
+	item = g_hash_table_lookup (pool->items, key);
+	if (item == NULL || replace) {
+		item = g_slice_new (DnfSackPoolItem);
+		item->sacks = g_ptr_array_new_with_free_func (g_object_unref);
+		item->timer = g_timer_new ();
+		g_hash_table_insert (pool->items, g_strdup (key), item);
+	}
+	g_ptr_array_add (item->sacks, g_object_ref (sack));
+	if (owner != NULL && !g_hash_table_contains (pool->owners, sack))
+		g_hash_table_insert (pool->owners, g_object_ref (sack), owner);
+	else
+		dnf_sack_pool_item_trim (pool, key, item);
+	g_timer_start (item->timer);
+	g_debug ("created cached sack %s, %u in total", key, item->sacks->len);
+}
+
+static gboolean
+dnf_sack_pool_owner_cb (gpointer key, gpointer value, gpointer user_data)
+{
+	return value == user_data;
+}
+
+/* makes the sacks claimed by @owner available to others again */
+void
+dnf_sack_pool_release (DnfSackPool *pool, gpointer owner)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer item;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->mutex);
+
+	if (g_hash_table_foreach_remove (pool->owners, dnf_sack_pool_owner_cb, owner) == 0)
+		return;
+	g_hash_table_iter_init (&iter, pool->items);
+	while (g_hash_table_iter_next (&iter, &key, &item))
+		dnf_sack_pool_item_trim (pool, key, item);
+}
+
+static gboolean
+dnf_sack_pool_expired_cb (gpointer key, gpointer value, gpointer user_data)
+{
+	DnfSackPoolItem *item = value;
+	gdouble *max_age = user_data;
+
+	if (g_timer_elapsed (item->timer, NULL) > *max_age) {
+		g_debug ("invalidating %s as expired", (const gchar *) key);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* drops the sacks of the keys nobody asked for in @max_age seconds */
+void
+dnf_sack_pool_expire (DnfSackPool *pool, gdouble max_age)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->mutex);
+
+	g_hash_table_foreach_remove (pool->items, dnf_sack_pool_expired_cb, &max_age);
+}
+
+/* drops all cached sacks, owners using one keep it until released */
+void
+dnf_sack_pool_clear (DnfSackPool *pool)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->mutex);
+
+	g_debug ("removing all dnf sack caches");
+	g_hash_table_remove_all (pool->items);
+}
@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __DNF_SACK_POOL_H
+#define __DNF_SACK_POOL_H
+
+#include <glib.h>
+
+#include <libdnf/dnf-sack.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DnfSackPool DnfSackPool;
+
+DnfSackPool	*dnf_sack_pool_new		(void);
+void		 dnf_sack_pool_free		(DnfSackPool		*pool);
+DnfSack		*dnf_sack_pool_claim		(DnfSackPool		*pool,
+						 const gchar		*key,
+						 gpointer		 owner);
+void		 dnf_sack_pool_add		(DnfSackPool		*pool,
+						 const gchar		*key,
+						 DnfSack		*sack,
+						 gpointer		 owner,
+						 gboolean		 replace);
+void		 dnf_sack_pool_release		(DnfSackPool		*pool,
+						 gpointer		 owner);
+void		 dnf_sack_pool_expire		(DnfSackPool		*pool,
+						 gdouble		 max_age);
+void		 dnf_sack_pool_clear		(DnfSackPool		*pool);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(DnfSackPool, dnf_sack_pool_free)
+
+G_END_DECLS
+
+#endif /* __DNF_SACK_POOL_H */
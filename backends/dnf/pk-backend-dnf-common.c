@@ -23,12 +23,18 @@
 
 #include <gmodule.h>
 #include <glib.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <appstream.h>
 #include <libdnf/libdnf.h>
 
 #include "pk-shared.h"
 #include "pk-backend-dnf-common.h"
 
+#define DNF_REFRESH_MAX_WORKERS	4
+
 gboolean
 pk_backend_setup_dnf_context (DnfContext *context, GKeyFile *conf, const gchar *release_ver, GError **error)
 {
@@ -105,3 +111,351 @@ dnf_utils_refresh_repo_appstream (DnfRepo *repo, GError **error)
 	}
 	return TRUE;
 }
+
+/* where a refresh puts the new metadata until they are swapped in */
+static gchar *
+pk_backend_refresh_repo_staging (DnfRepo *repo)
+{
+	return g_strdup_printf ("%s.pk-staged", dnf_repo_get_location (repo));
+}
+
+/**
+ * pk_backend_refresh_repo:
+ *
+ * Downloads the metadata of @repo unless they are newer than
+ * @max_cache_age. With @staged they are saved next to the current ones,
+ * and pk_backend_refresh_repo_swap() puts them in place.
+ */
+gboolean
+pk_backend_refresh_repo (guint max_cache_age,
+                         DnfRepo *repo,
+                         gboolean staged,
+                         DnfState *state,
+                         GError **error)
+{
+	gboolean ret;
+	gboolean repo_okay;
+	DnfState *state_local;
+	GError *error_local = NULL;
+	g_autofree gchar *location = NULL;
+	g_autofree gchar *staging = NULL;
+
+	/* set state */
+	ret = dnf_state_set_steps (state, error,
+				   2, /* check */
+				   98, /* download */
+				   -1);
+	if (!ret)
+		return FALSE;
+
+	/* is the repo up to date? */
+	state_local = dnf_state_get_child (state);
+	repo_okay = dnf_repo_check (repo,
+	                            max_cache_age,
+	                            state_local,
+	                            &error_local);
+	if (!repo_okay) {
+		g_debug ("repo %s not okay [%s], refreshing",
+			 dnf_repo_get_id (repo), error_local->message);
+		g_clear_error (&error_local);
+		if (!dnf_state_finished (state_local, error))
+			return FALSE;
+	}
+
+	/* done */
+	if (!dnf_state_done (state, error))
+		return FALSE;
+
+	/* update repo, TODO: if we have network access */
+	if (!repo_okay) {
+		if (staged) {
+			location = g_strdup (dnf_repo_get_location (repo));
+			staging = pk_backend_refresh_repo_staging (repo);
+			if (g_file_test (staging, G_FILE_TEST_EXISTS) &&
+			    !dnf_remove_recursive (staging, error))
+				return FALSE;
+			dnf_repo_set_location (repo, staging);
+		}
+		state_local = dnf_state_get_child (state);
+		ret = dnf_repo_update (repo,
+		                       DNF_REPO_UPDATE_FLAG_IMPORT_PUBKEY,
+		                       state_local,
+		                       &error_local);
+		if (location != NULL)
+			dnf_repo_set_location (repo, location);
+		if (!ret) {
+			if (g_error_matches (error_local,
+					     DNF_ERROR,
+					     DNF_ERROR_CANNOT_FETCH_SOURCE)) {
+				g_warning ("Skipping refresh of %s: %s",
+					   dnf_repo_get_id (repo),
+					   error_local->message);
+				g_clear_error (&error_local);
+				if (!dnf_state_finished (state_local, error))
+					return FALSE;
+			} else {
+				g_propagate_error (error, error_local);
+				return FALSE;
+			}
+		}
+	}
+
+	/* copy the appstream files somewhere that the GUI will pick them up */
+	if (!dnf_utils_refresh_repo_appstream (repo, error))
+		return FALSE;
+
+	/* done */
+	return dnf_state_done (state, error);
+}
+
+/**
+ * pk_backend_refresh_repo_swap:
+ *
+ * Replaces the metadata of @repo with the ones a staged refresh
+ * downloaded, if any. The cached packages are kept.
+ */
+gboolean
+pk_backend_refresh_repo_swap (DnfRepo *repo, GError **error)
+{
+	const gchar *location = dnf_repo_get_location (repo);
+	g_autofree gchar *staging = pk_backend_refresh_repo_staging (repo);
+	g_autofree gchar *packages = g_build_filename (location, "packages", NULL);
+	g_autofree gchar *staging_packages = g_build_filename (staging, "packages", NULL);
+
+	if (!g_file_test (staging, G_FILE_TEST_IS_DIR))
+		return TRUE;
+	g_debug ("swapping in the new metadata of %s", dnf_repo_get_id (repo));
+	if (g_file_test (packages, G_FILE_TEST_IS_DIR) &&
+	    !g_file_test (staging_packages, G_FILE_TEST_EXISTS) &&
+	    g_rename (packages, staging_packages) != 0) {
+		g_set_error (error, DNF_ERROR, DNF_ERROR_INTERNAL_ERROR,
+			     "failed to keep the packages of %s: %s",
+			     dnf_repo_get_id (repo), g_strerror (errno));
+		return FALSE;
+	}
+	if (g_file_test (location, G_FILE_TEST_EXISTS) &&
+	    !dnf_remove_recursive (location, error))
+		return FALSE;
+	if (g_rename (staging, location) != 0) {
+		g_set_error (error, DNF_ERROR, DNF_ERROR_INTERNAL_ERROR,
+			     "failed to move the metadata of %s in place: %s",
+			     dnf_repo_get_id (repo), g_strerror (errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+typedef struct {
+	const gchar	*helper;
+	GPtrArray	*repos;		/* of DnfRepo */
+	const gchar	*max_cache_age;
+	const gchar	*release_ver;
+	DnfState	*state;
+	guint		*percentages;	/* per repo */
+	guint		 percentage;
+	guint		 next;
+	guint		 running;
+	GString		*failed;	/* one line per failed helper */
+	GError		*error;
+} PkBackendDnfRefresh;
+
+typedef struct {
+	PkBackendDnfRefresh	*refresh;
+	guint			 idx;
+	guint			 pending;	/* stdout, stderr and exit */
+	gboolean		 success;
+	GSubprocess		*subprocess;
+	GDataInputStream	*stdout_stream;
+	GDataInputStream	*stderr_stream;
+	GString			*stderr_text;
+} PkBackendDnfRefreshWorker;
+
+static gboolean pk_backend_refresh_repo_start (PkBackendDnfRefresh *refresh);
+
+static void
+pk_backend_refresh_repo_progress (PkBackendDnfRefresh *refresh, guint idx, guint percentage)
+{
+	guint total = 0;
+
+	refresh->percentages[idx] = MIN (percentage, 100);
+	for (guint i = 0; i < refresh->repos->len; i++)
+		total += refresh->percentages[i];
+	total /= refresh->repos->len;
+
+	/* the helpers finish in any order, only ever move forwards */
+	if (total > refresh->percentage && total < 100) {
+		refresh->percentage = total;
+		dnf_state_set_percentage (refresh->state, total);
+	}
+}
+
+static void
+pk_backend_refresh_repo_worker_done (PkBackendDnfRefreshWorker *worker)
+{
+	PkBackendDnfRefresh *refresh = worker->refresh;
+
+	if (--worker->pending > 0)
+		return;
+
+	/* the helper prints why it failed on stderr */
+	if (!worker->success) {
+		DnfRepo *repo = g_ptr_array_index (refresh->repos, worker->idx);
+		g_strstrip (worker->stderr_text->str);
+		if (refresh->failed->len > 0)
+			g_string_append_c (refresh->failed, '\n');
+		g_string_append_printf (refresh->failed, "%s: %s",
+					dnf_repo_get_id (repo),
+					worker->stderr_text->str[0] != '\0' ?
+						worker->stderr_text->str : "refresh failed");
+	}
+
+	pk_backend_refresh_repo_progress (refresh, worker->idx, 100);
+	g_object_unref (worker->stdout_stream);
+	g_object_unref (worker->stderr_stream);
+	g_object_unref (worker->subprocess);
+	g_string_free (worker->stderr_text, TRUE);
+	g_free (worker);
+
+	refresh->running--;
+	pk_backend_refresh_repo_start (refresh);
+}
+
+static void
+pk_backend_refresh_repo_read_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	PkBackendDnfRefreshWorker *worker = user_data;
+	g_autofree gchar *line = NULL;
+
+	/* each line is the percentage of the helper */
+	line = g_data_input_stream_read_line_finish (G_DATA_INPUT_STREAM (source), res, NULL, NULL);
+	if (line == NULL) {
+		pk_backend_refresh_repo_worker_done (worker);
+		return;
+	}
+	pk_backend_refresh_repo_progress (worker->refresh, worker->idx, atoi (line));
+	g_data_input_stream_read_line_async (worker->stdout_stream, G_PRIORITY_DEFAULT, NULL,
+					     pk_backend_refresh_repo_read_cb, worker);
+}
+
+static void
+pk_backend_refresh_repo_read_stderr_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	PkBackendDnfRefreshWorker *worker = user_data;
+	g_autofree gchar *line = NULL;
+
+	line = g_data_input_stream_read_line_finish (G_DATA_INPUT_STREAM (source), res, NULL, NULL);
+	if (line == NULL) {
+		pk_backend_refresh_repo_worker_done (worker);
+		return;
+	}
+	g_string_append_printf (worker->stderr_text, "%s\n", line);
+	g_data_input_stream_read_line_async (worker->stderr_stream, G_PRIORITY_DEFAULT, NULL,
+					     pk_backend_refresh_repo_read_stderr_cb, worker);
+}
+
+static void
+pk_backend_refresh_repo_wait_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	PkBackendDnfRefreshWorker *worker = user_data;
+	g_autoptr(GError) error = NULL;
+
+	if (!g_subprocess_wait_finish (G_SUBPROCESS (source), res, &error))
+		g_string_append_printf (worker->stderr_text, "%s\n", error->message);
+	else
+		worker->success = g_subprocess_get_successful (G_SUBPROCESS (source));
+	pk_backend_refresh_repo_worker_done (worker);
+}
+
+/* starts helpers for the next repos until the worker limit is reached */
+static gboolean
+pk_backend_refresh_repo_start (PkBackendDnfRefresh *refresh)
+{
+	while (refresh->error == NULL &&
+	       refresh->running < DNF_REFRESH_MAX_WORKERS &&
+	       refresh->next < refresh->repos->len) {
+		PkBackendDnfRefreshWorker *worker;
+		DnfRepo *repo = g_ptr_array_index (refresh->repos, refresh->next);
+		GSubprocess *subprocess;
+		const gchar *argv[] = {
+			refresh->helper,
+			refresh->max_cache_age,
+			dnf_repo_get_id (repo),
+			refresh->release_ver,
+			NULL };
+
+		/* check and download in a separate process */
+		subprocess = g_subprocess_newv (argv,
+						G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+						G_SUBPROCESS_FLAGS_STDERR_PIPE,
+						&refresh->error);
+		if (subprocess == NULL)
+			return FALSE;
+
+		worker = g_new0 (PkBackendDnfRefreshWorker, 1);
+		worker->refresh = refresh;
+		worker->idx = refresh->next++;
+		worker->pending = 3;
+		worker->subprocess = subprocess;
+		worker->stdout_stream = g_data_input_stream_new (g_subprocess_get_stdout_pipe (subprocess));
+		worker->stderr_stream = g_data_input_stream_new (g_subprocess_get_stderr_pipe (subprocess));
+		worker->stderr_text = g_string_new (NULL);
+		refresh->running++;
+
+		g_data_input_stream_read_line_async (worker->stdout_stream, G_PRIORITY_DEFAULT, NULL,
+						     pk_backend_refresh_repo_read_cb, worker);
+		g_data_input_stream_read_line_async (worker->stderr_stream, G_PRIORITY_DEFAULT, NULL,
+						     pk_backend_refresh_repo_read_stderr_cb, worker);
+		g_subprocess_wait_async (subprocess, NULL,
+					 pk_backend_refresh_repo_wait_cb, worker);
+	}
+	return refresh->error == NULL;
+}
+
+/**
+ * pk_backend_refresh_repos:
+ *
+ * Refreshes the repos with up to DNF_REFRESH_MAX_WORKERS @helper processes
+ * running at the same time. The progress reported by the helpers is
+ * averaged into @state.
+ *
+ * A failing helper does not stop the others; once all have finished a
+ * DNF_ERROR_CANNOT_FETCH_SOURCE error lists every repo that failed.
+ */
+gboolean
+pk_backend_refresh_repos (const gchar *helper,
+			  GPtrArray *repos,
+			  const gchar *max_cache_age,
+			  const gchar *release_ver,
+			  DnfState *state,
+			  GError **error)
+{
+	PkBackendDnfRefresh refresh = { 0 };
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GString) failed = g_string_new (NULL);
+	g_autofree guint *percentages = g_new0 (guint, repos->len);
+
+	refresh.helper = helper;
+	refresh.repos = repos;
+	refresh.max_cache_age = max_cache_age;
+	refresh.release_ver = release_ver;
+	refresh.state = state;
+	refresh.percentages = percentages;
+	refresh.failed = failed;
+
+	g_main_context_push_thread_default (context);
+	pk_backend_refresh_repo_start (&refresh);
+	while (refresh.running > 0)
+		g_main_context_iteration (context, TRUE);
+	g_main_context_pop_thread_default (context);
+
+	if (refresh.error != NULL) {
+		g_propagate_error (error, refresh.error);
+		return FALSE;
+	}
+	if (failed->len > 0) {
+		g_set_error (error, DNF_ERROR, DNF_ERROR_CANNOT_FETCH_SOURCE,
+			     "failed to refresh repos:\n%s", failed->str);
+		return FALSE;
+	}
+	return dnf_state_finished (state, error);
+}
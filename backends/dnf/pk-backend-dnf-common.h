@@ -31,6 +31,19 @@ gboolean	pk_backend_setup_dnf_context (DnfContext *context,
 					      const gchar *release_ver,
 					      GError **error);
 gboolean	dnf_utils_refresh_repo_appstream (DnfRepo *repo, GError **error);
+gboolean	pk_backend_refresh_repo (guint max_cache_age,
+					 DnfRepo *repo,
+					 gboolean staged,
+					 DnfState *state,
+					 GError **error);
+gboolean	pk_backend_refresh_repo_swap (DnfRepo *repo,
+					      GError **error);
+gboolean	pk_backend_refresh_repos (const gchar *helper,
+					  GPtrArray *repos,
+					  const gchar *max_cache_age,
+					  const gchar *release_ver,
+					  DnfState *state,
+					  GError **error);
 
 G_END_DECLS
 
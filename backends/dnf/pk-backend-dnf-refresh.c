@@ -49,73 +49,14 @@
 #include "dnf-backend.h"
 #include "pk-backend-dnf-common.h"
 
-static gboolean
-pk_backend_refresh_repo (guint max_cache_age,
-                         DnfRepo *repo,
-                         DnfState *state,
-                         GError **error)
+static void
+pk_backend_refresh_percentage_changed_cb (DnfState *state,
+					  guint percentage,
+					  gpointer user_data)
 {
-	gboolean ret;
-	gboolean repo_okay;
-	DnfState *state_local;
-	GError *error_local = NULL;
-
-	/* set state */
-	ret = dnf_state_set_steps (state, error,
-				   2, /* check */
-				   98, /* download */
-				   -1);
-	if (!ret)
-		return FALSE;
-
-	/* is the repo up to date? */
-	state_local = dnf_state_get_child (state);
-	repo_okay = dnf_repo_check (repo,
-	                            max_cache_age,
-	                            state_local,
-	                            &error_local);
-	if (!repo_okay) {
-		g_debug ("repo %s not okay [%s], refreshing",
-			 dnf_repo_get_id (repo), error_local->message);
-		g_clear_error (&error_local);
-		if (!dnf_state_finished (state_local, error))
-			return FALSE;
-	}
-
-	/* done */
-	if (!dnf_state_done (state, error))
-		return FALSE;
-
-	/* update repo, TODO: if we have network access */
-	if (!repo_okay) {
-		state_local = dnf_state_get_child (state);
-		ret = dnf_repo_update (repo,
-		                       DNF_REPO_UPDATE_FLAG_IMPORT_PUBKEY,
-		                       state_local,
-		                       &error_local);
-		if (!ret) {
-			if (g_error_matches (error_local,
-					     DNF_ERROR,
-					     DNF_ERROR_CANNOT_FETCH_SOURCE)) {
-				g_warning ("Skipping refresh of %s: %s",
-					   dnf_repo_get_id (repo),
-					   error_local->message);
-				g_clear_error (&error_local);
-				if (!dnf_state_finished (state_local, error))
-					return FALSE;
-			} else {
-				g_propagate_error (error, error_local);
-				return FALSE;
-			}
-		}
-	}
-
-	/* copy the appstream files somewhere that the GUI will pick them up */
-	if (!dnf_utils_refresh_repo_appstream (repo, error))
-		return FALSE;
-
-	/* done */
-	return dnf_state_done (state, error);
+	/* the backend reads the progress from stdout */
+	g_print ("%u\n", percentage);
+	fflush (stdout);
 }
 
 int
@@ -151,19 +92,39 @@ main (int argc, char *argv[])
 
 	max_cache_age = atoi(argv[1]);
 	context = dnf_context_new ();
-	if (!pk_backend_setup_dnf_context (context, conf, argv[3], &error))
+	if (!pk_backend_setup_dnf_context (context, conf, argv[3], &error)) {
+		g_printerr ("%s\n", error->message);
 		return 1;
+	}
 	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (context), &error);
-	if (repos == NULL)
+	if (repos == NULL) {
+		g_printerr ("%s\n", error->message);
 		return 1;
+	}
 	for (i = 0; i < repos->len; i++) {
                 DnfRepo *repo = g_ptr_array_index (repos, i);
 		if (strcmp(dnf_repo_get_id (repo), argv[2]) == 0) {
 			state = dnf_state_new ();
-			pk_backend_refresh_repo (max_cache_age,
-						 repo,
-						 state,
-						 &error);
+			g_signal_connect (state, "percentage-changed",
+					  G_CALLBACK (pk_backend_refresh_percentage_changed_cb),
+					  NULL);
+			/* the backend swaps the metadata in once no sack
+			 * is being loaded from them */
+			if (!pk_backend_refresh_repo (max_cache_age,
+						      repo,
+						      TRUE,
+						      state,
+						      &error)) {
+				/* the backend reports this as the reason */
+				g_printerr ("%s\n", error->message);
+				return 1;
+			}
+			return 0;
 		}
         }
+
+	/* TRANSLATORS: The placeholder is a repository ID */
+	g_printerr (_("Repository %s was not found"), argv[2]);
+	g_printerr ("\n");
+	return 1;
 }
@@ -24,6 +24,7 @@
 #include <gmodule.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <pk-backend.h>
@@ -44,24 +45,26 @@
 
 #include "dnf-backend-vendor.h"
 #include "dnf-backend.h"
+#include "dnf-sack-pool.h"
 #include "pk-backend-dnf-common.h"
 
 #define DNF_SACK_MAX_AGE	600 /* seconds */
-
-typedef struct {
-	DnfSack		*sack;
-	gchar		*key;
-	GTimer		*timer;
-} DnfSackCacheItem;
+#define PK_DNF_SACK_ADVISORIES_KEY	"pk-dnf-advisories"
+#define PK_DNF_SACK_ADVISORY_SUMMARY_KEY	"pk-dnf-advisory-summary"
 
 typedef struct {
 	GKeyFile	*conf;
 	DnfContext	*context;
-	GHashTable	*sack_cache;	/* of DnfSackCacheItem */
+	DnfSackPool	*sack_pool;
 	GMutex		 sack_mutex;
+	GRecMutex	 context_mutex;
+	GMutex		 exclusive_mutex;
 	GTimer		*repos_timer;
+	gboolean	 removable_repos;	/* as of the last sack created */
 	gchar		*release_ver;
 	guint		 sack_expire_id;
+	GHashTable	*advisory_summary;	/* of "name;evr;arch" → info | severity << 16 */
+	gchar		*advisory_summary_fingerprint;
 } PkBackendDnfPrivate;
 
 typedef struct {
@@ -94,28 +97,82 @@ pk_backend_get_author (PkBackend *backend)
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
 {
-	return FALSE;
+	return TRUE;
 }
 
+/* roles that only query a sack and can run next to any other job */
 static gboolean
-pk_backend_check_sack_timer (gpointer key, gpointer value, gpointer user_data)
+pk_backend_dnf_role_is_read_only (PkRoleEnum role)
 {
-	DnfSackCacheItem *cache_item = value;
-	if (g_timer_elapsed (cache_item->timer, NULL) > DNF_SACK_MAX_AGE) {
-		g_debug ("invalidating %s as expired", (char *)key);
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_DETAILS_LOCAL:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_FILES_LOCAL:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
 		return TRUE;
+	default:
+		return FALSE;
 	}
-	return FALSE;
+}
+
+/*
+ * Runs a job that changes the system, the repos or the metadata. Such jobs
+ * run one at a time, but read-only jobs keep running next to them.
+ */
+static void
+pk_backend_exclusive_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
+{
+	PkBackendJobThreadFunc func = (PkBackendJobThreadFunc) user_data;
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (pk_backend_job_get_backend (job));
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	pk_backend_job_set_status (job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
+	locker = g_mutex_locker_new (&priv->exclusive_mutex);
+	pk_backend_job_set_locked (job, TRUE);
+	func (job, params, NULL);
+	pk_backend_job_set_locked (job, FALSE);
+}
+
+/* the repo loader of the shared context may reload the repos at any time */
+static GPtrArray *
+dnf_utils_get_repos (PkBackendJob *job, GError **error)
+{
+	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (job_data->backend);
+	g_autoptr(GRecMutexLocker) locker = g_rec_mutex_locker_new (&priv->context_mutex);
+
+	return dnf_repo_loader_get_repos (dnf_context_get_repo_loader (job_data->context), error);
+}
+
+static DnfRepo *
+dnf_utils_get_repo_by_id (PkBackendJob *job, const gchar *repo_id, GError **error)
+{
+	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (job_data->backend);
+	g_autoptr(GRecMutexLocker) locker = g_rec_mutex_locker_new (&priv->context_mutex);
+
+	return dnf_repo_loader_get_repo_by_id (dnf_context_get_repo_loader (job_data->context),
+					       repo_id, error);
 }
 
 static gboolean
 pk_backend_sack_expire (gpointer user_data)
 {
 	PkBackendDnfPrivate *priv = user_data;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
 
-	g_hash_table_foreach_remove (priv->sack_cache,
-				     pk_backend_check_sack_timer, NULL);
+	dnf_sack_pool_expire (priv->sack_pool, DNF_SACK_MAX_AGE);
 	return TRUE;
 }
 
@@ -123,11 +180,16 @@ static void
 pk_backend_sack_cache_invalidate (PkBackend *backend, const gchar *why)
 {
 	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
 
 	/* remove all cached sacks */
-	g_debug ("removing all dnf sack caches");
-	g_hash_table_remove_all (priv->sack_cache);
+	dnf_sack_pool_clear (priv->sack_pool);
+
+	/* and the advisory summary they were created with, it is checked
+	 * against the new metadata when needed again */
+	g_mutex_lock (&priv->sack_mutex);
+	g_clear_pointer (&priv->advisory_summary, g_hash_table_unref);
+	g_clear_pointer (&priv->advisory_summary_fingerprint, g_free);
+	g_mutex_unlock (&priv->sack_mutex);
 }
 
 static void
@@ -137,15 +199,6 @@ pk_backend_yum_repos_changed_cb (DnfRepoLoader *repo_loader, PkBackend *backend)
 	pk_backend_repo_list_changed (backend);
 }
 
-static void
-dnf_sack_cache_item_free (DnfSackCacheItem *cache_item)
-{
-	g_timer_destroy (cache_item->timer);
-	g_object_unref (cache_item->sack);
-	g_free (cache_item->key);
-	g_slice_free (DnfSackCacheItem, cache_item);
-}
-
 static void
 pk_backend_context_invalidate_cb (DnfContext *context,
 				 const gchar *message,
@@ -273,10 +326,9 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 	 *   modify state or if the repos or rpmdb are changed
 	 */
 	g_mutex_init (&priv->sack_mutex);
-	priv->sack_cache = g_hash_table_new_full (g_str_hash,
-						  g_str_equal,
-						  g_free,
-						  (GDestroyNotify) dnf_sack_cache_item_free);
+	g_rec_mutex_init (&priv->context_mutex);
+	g_mutex_init (&priv->exclusive_mutex);
+	priv->sack_pool = dnf_sack_pool_new ();
 
 	priv->sack_expire_id = g_timeout_add_seconds (DNF_SACK_MAX_AGE / 2,
 						      pk_backend_sack_expire,
@@ -298,7 +350,12 @@ pk_backend_destroy (PkBackend *backend)
 		g_source_remove (priv->sack_expire_id);
 	g_timer_destroy (priv->repos_timer);
 	g_mutex_clear (&priv->sack_mutex);
-	g_hash_table_unref (priv->sack_cache);
+	g_rec_mutex_clear (&priv->context_mutex);
+	g_mutex_clear (&priv->exclusive_mutex);
+	dnf_sack_pool_free (priv->sack_pool);
+	if (priv->advisory_summary != NULL)
+		g_hash_table_unref (priv->advisory_summary);
+	g_free (priv->advisory_summary_fingerprint);
 	g_free (priv->release_ver);
 	g_free (priv);
 }
@@ -478,6 +535,10 @@ void
 pk_backend_stop_job (PkBackend *backend, PkBackendJob *job)
 {
 	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
+
+	/* let other jobs use the cached sacks of this one */
+	dnf_sack_pool_release (priv->sack_pool, job);
 
 	if (job_data->state != NULL) {
 		dnf_state_release_locks (job_data->state);
@@ -500,7 +561,6 @@ dnf_utils_add_remote (PkBackendJob *job,
 		      DnfState *state,
 		      GError **error)
 {
-	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
 	gboolean ret;
 	DnfState *state_local;
 	g_autoptr(GPtrArray) repos = NULL;
@@ -516,7 +576,7 @@ dnf_utils_add_remote (PkBackendJob *job,
 		return FALSE;
 
 	/* ask the context's repo loader for new repos, forcing it to reload them */
-	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (job_data->context), error);
+	repos = dnf_utils_get_repos (job, error);
 	if (repos == NULL)
 		return FALSE;
 
@@ -561,6 +621,215 @@ dnf_utils_add_remote (PkBackendJob *job,
 	return TRUE;
 }
 
+#ifdef HAVE_HY_QUERY_GET_ADVISORY_PKGS
+static gint
+pk_backend_dnf_strcmp_cb (gconstpointer a, gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* identifies the updateinfo of the enabled repos by their repomd.xml */
+static gchar *
+pk_backend_dnf_repos_fingerprint (PkBackend *backend, DnfContext *context)
+{
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
+	g_autoptr(GRecMutexLocker) locker = g_rec_mutex_locker_new (&priv->context_mutex);
+	GPtrArray *repos = dnf_context_get_repos (context);
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autoptr(GPtrArray) entries = g_ptr_array_new_with_free_func (g_free);
+
+	for (guint i = 0; i < repos->len; i++) {
+		DnfRepo *repo = g_ptr_array_index (repos, i);
+		g_autofree gchar *repomd = NULL;
+		g_autofree gchar *contents = NULL;
+		g_autofree gchar *contents_checksum = NULL;
+		gsize len;
+
+		if (dnf_repo_get_enabled (repo) == DNF_REPO_ENABLED_NONE)
+			continue;
+		repomd = g_build_filename (dnf_repo_get_location (repo), "repodata", "repomd.xml", NULL);
+		if (g_file_get_contents (repomd, &contents, &len, NULL))
+			contents_checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+									 (const guchar *) contents, len);
+		g_ptr_array_add (entries, g_strdup_printf ("%s:%s",
+							   dnf_repo_get_id (repo),
+							   contents_checksum != NULL ? contents_checksum : "missing"));
+	}
+
+	/* the repo order doesn't matter */
+	g_ptr_array_sort (entries, pk_backend_dnf_strcmp_cb);
+	g_checksum_update (checksum, (const guchar *) dnf_context_get_release_ver (context), -1);
+	for (guint i = 0; i < entries->len; i++) {
+		g_checksum_update (checksum, (const guchar *) "\n", 1);
+		g_checksum_update (checksum, g_ptr_array_index (entries, i), -1);
+	}
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+static gchar *
+pk_backend_dnf_advisory_summary_filename (DnfContext *context)
+{
+	return g_build_filename (dnf_context_get_solv_dir (context), "pk-advisories.gvariant", NULL);
+}
+
+static GHashTable *
+pk_backend_dnf_advisory_summary_load (const gchar *filename, const gchar *fingerprint)
+{
+	const gchar *id;
+	const gchar *file_fingerprint;
+	guint32 info;
+	guint32 severity;
+	GHashTable *hash;
+	GVariantIter iter;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GMappedFile) file = NULL;
+	g_autoptr(GVariant) entries = NULL;
+	g_autoptr(GVariant) summary = NULL;
+
+	file = g_mapped_file_new (filename, FALSE, NULL);
+	if (file == NULL)
+		return NULL;
+	bytes = g_mapped_file_get_bytes (file);
+	summary = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE ("(sa{s(uu)})"),
+								bytes, FALSE));
+	g_variant_get (summary, "(&s@a{s(uu)})", &file_fingerprint, &entries);
+	if (g_strcmp0 (file_fingerprint, fingerprint) != 0) {
+		g_debug ("ignoring outdated %s", filename);
+		return NULL;
+	}
+
+	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_variant_iter_init (&iter, entries);
+	while (g_variant_iter_next (&iter, "{&s(uu)}", &id, &info, &severity))
+		g_hash_table_insert (hash, g_strdup (id), GUINT_TO_POINTER (info | severity << 16));
+	return hash;
+}
+#endif
+
+/**
+ * pk_backend_dnf_advisory_summary_get:
+ *
+ * Returns the kind and severity of the advisories of the available packages
+ * if they are known for the current repo metadata. The summary is kept on
+ * disk, so GetUpdates doesn't have to load the updateinfo of every repo
+ * after the daemon was restarted.
+ */
+static GHashTable *
+pk_backend_dnf_advisory_summary_get (PkBackend *backend, DnfContext *context)
+{
+#ifdef HAVE_HY_QUERY_GET_ADVISORY_PKGS
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *fingerprint = pk_backend_dnf_repos_fingerprint (backend, context);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
+
+	if (priv->advisory_summary == NULL ||
+	    g_strcmp0 (priv->advisory_summary_fingerprint, fingerprint) != 0) {
+		g_clear_pointer (&priv->advisory_summary, g_hash_table_unref);
+		g_clear_pointer (&priv->advisory_summary_fingerprint, g_free);
+		filename = pk_backend_dnf_advisory_summary_filename (context);
+		priv->advisory_summary = pk_backend_dnf_advisory_summary_load (filename, fingerprint);
+		if (priv->advisory_summary == NULL)
+			return NULL;
+		priv->advisory_summary_fingerprint = g_steal_pointer (&fingerprint);
+	}
+	return g_hash_table_ref (priv->advisory_summary);
+#else
+	return NULL;
+#endif
+}
+
+/* saves the advisories of a sack loaded with updateinfo for later jobs */
+static void
+pk_backend_dnf_advisory_summary_update (PkBackend *backend, DnfContext *context, DnfSack *sack)
+{
+#ifdef HAVE_HY_QUERY_GET_ADVISORY_PKGS
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
+	GHashTable *hash;
+	GVariantBuilder builder;
+	HyQuery query;
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *fingerprint = pk_backend_dnf_repos_fingerprint (backend, context);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
+	g_autoptr(GPtrArray) array = NULL;
+	g_autoptr(GVariant) summary = NULL;
+
+	if (priv->advisory_summary != NULL &&
+	    g_strcmp0 (priv->advisory_summary_fingerprint, fingerprint) == 0)
+		return;
+
+	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(uu)}"));
+	query = hy_query_create (sack);
+	array = hy_query_get_advisory_pkgs (query, HY_EQ);
+	hy_query_free (query);
+	for (guint i = 0; i < array->len; i++) {
+		DnfAdvisoryPkg *advpkg = g_ptr_array_index (array, i);
+		DnfAdvisory *advisory = dnf_advisorypkg_get_advisory (advpkg);
+		PkInfoEnum info = dnf_advisory_kind_to_info_enum (dnf_advisory_get_kind (advisory));
+		PkInfoEnum severity = dnf_update_severity_to_enum (dnf_advisory_get_severity (advisory));
+		gchar *id = g_strdup_printf ("%s;%s;%s",
+					     dnf_advisorypkg_get_name (advpkg),
+					     dnf_advisorypkg_get_evr (advpkg),
+					     dnf_advisorypkg_get_arch (advpkg));
+
+		g_variant_builder_add (&builder, "{s(uu)}", id, info, severity);
+		g_hash_table_insert (hash, id, GUINT_TO_POINTER (info | severity << 16));
+		dnf_advisory_free (advisory);
+	}
+	summary = g_variant_ref_sink (g_variant_new ("(s@a{s(uu)})", fingerprint,
+						     g_variant_builder_end (&builder)));
+
+	filename = pk_backend_dnf_advisory_summary_filename (context);
+	if (!g_file_set_contents (filename,
+				  g_variant_get_data (summary),
+				  g_variant_get_size (summary),
+				  &error))
+		g_warning ("failed to save %s: %s", filename, error->message);
+
+	if (priv->advisory_summary != NULL)
+		g_hash_table_unref (priv->advisory_summary);
+	g_free (priv->advisory_summary_fingerprint);
+	priv->advisory_summary = hash;
+	priv->advisory_summary_fingerprint = g_steal_pointer (&fingerprint);
+#endif
+}
+
+static gboolean
+pk_backend_dnf_advisory_summary_lookup (GHashTable *advisory_summary,
+					DnfPackage *pkg,
+					PkInfoEnum *info,
+					PkInfoEnum *severity)
+{
+	gpointer value;
+	g_autofree gchar *id = g_strdup_printf ("%s;%s;%s",
+						dnf_package_get_name (pkg),
+						dnf_package_get_evr (pkg),
+						dnf_package_get_arch (pkg));
+
+	if (!g_hash_table_lookup_extended (advisory_summary, id, NULL, &value))
+		return FALSE;
+	*info = GPOINTER_TO_UINT (value) & 0xffff;
+	*severity = GPOINTER_TO_UINT (value) >> 16;
+	return TRUE;
+}
+
+/* hands the advisory summary the sack was created for to the job using it */
+static void
+pk_backend_dnf_sack_set_advisory_summary (DnfSack *sack, GHashTable *advisory_summary)
+{
+	if (advisory_summary == NULL)
+		return;
+
+	/* a shared sack keeps the first one, they all match its metadata */
+	g_hash_table_ref (advisory_summary);
+	if (!g_object_replace_data (G_OBJECT (sack), PK_DNF_SACK_ADVISORY_SUMMARY_KEY,
+				    NULL, advisory_summary,
+				    (GDestroyNotify) g_hash_table_unref, NULL))
+		g_hash_table_unref (advisory_summary);
+}
+
 typedef enum {
 	DNF_CREATE_SACK_FLAG_NONE,
 	DNF_CREATE_SACK_FLAG_USE_CACHE,
@@ -610,6 +879,58 @@ dnf_utils_real_path (const gchar *path)
 	return real;
 }
 
+/* claims a cached sack for @flags without using the context */
+static DnfSack *
+dnf_utils_claim_cached_sack (PkBackendJob *job,
+			     DnfSackAddFlags flags,
+			     DnfCreateSackFlags *create_flags)
+{
+	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (pk_backend_job_get_backend (job));
+	DnfSack *sack;
+	gboolean media;
+	g_autofree gchar *cache_key = NULL;
+	g_autoptr(GHashTable) advisory_summary = NULL;
+
+	/* media repos could disappear at any time */
+	g_mutex_lock (&priv->sack_mutex);
+	media = priv->removable_repos && g_timer_elapsed (priv->repos_timer, NULL) > 1.0f;
+	g_timer_reset (priv->repos_timer);
+	g_mutex_unlock (&priv->sack_mutex);
+	if (media) {
+		g_debug ("not reusing sack as media may have disappeared");
+		*create_flags &= ~DNF_CREATE_SACK_FLAG_USE_CACHE;
+		return NULL;
+	}
+
+	/* if we've specified a specific cache-age then do not use the cache */
+	if ((flags & DNF_SACK_ADD_FLAG_REMOTE) > 0 &&
+	    pk_backend_job_get_cache_age (job) != G_MAXUINT) {
+		g_debug ("not reusing sack specific cache age requested");
+		*create_flags &= ~DNF_CREATE_SACK_FLAG_USE_CACHE;
+		return NULL;
+	}
+
+	/* GetUpdates does without the updateinfo if the advisory summary
+	 * is known, it is dropped together with the cached sacks */
+	if (pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATES) {
+		g_mutex_lock (&priv->sack_mutex);
+		if (priv->advisory_summary != NULL)
+			advisory_summary = g_hash_table_ref (priv->advisory_summary);
+		g_mutex_unlock (&priv->sack_mutex);
+		if (advisory_summary == NULL)
+			flags |= DNF_SACK_ADD_FLAG_UPDATEINFO;
+	}
+
+	cache_key = dnf_utils_create_cache_key (dnf_context_get_release_ver (job_data->context), flags);
+	sack = dnf_sack_pool_claim (priv->sack_pool, cache_key, job);
+	if (sack == NULL)
+		return NULL;
+	g_debug ("using cached sack %s", cache_key);
+	pk_backend_dnf_sack_set_advisory_summary (sack, advisory_summary);
+	return sack;
+}
+
 static DnfSack *
 dnf_utils_create_sack_for_filters (PkBackendJob *job,
 				   PkBitfield filters,
@@ -619,7 +940,6 @@ dnf_utils_create_sack_for_filters (PkBackendJob *job,
 {
 	gboolean ret;
 	DnfSackAddFlags flags = DNF_SACK_ADD_FLAG_FILELISTS;
-	DnfSackCacheItem *cache_item = NULL;
 	DnfState *state_local;
 	PkBackend *backend = pk_backend_job_get_backend (job);
 	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
@@ -628,14 +948,23 @@ dnf_utils_create_sack_for_filters (PkBackendJob *job,
 	g_autofree gchar *install_root = NULL;
 	g_autofree gchar *solv_dir = NULL;
 	g_autoptr(DnfSack) sack = NULL;
+	g_autoptr(GHashTable) advisory_summary = NULL;
+	g_autoptr(GRecMutexLocker) context_locker = NULL;
+	gboolean shared;
+
+	/* cached sacks are reused by the read-only jobs, one job at a time,
+	 * all other jobs get a sack of their own they are free to modify */
+	shared = (create_flags & DNF_CREATE_SACK_FLAG_USE_CACHE) > 0 &&
+		 pk_backend_dnf_role_is_read_only (pk_backend_job_get_role (job));
+	if (!shared)
+		create_flags &= ~DNF_CREATE_SACK_FLAG_USE_CACHE;
 
 	/* don't add if we're going to filter out anyway */
 	if (!pk_bitfield_contain (filters, PK_FILTER_ENUM_INSTALLED))
 		flags |= DNF_SACK_ADD_FLAG_REMOTE;
 
 	/* only load updateinfo when required */
-	if (pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATE_DETAIL ||
-	    pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATES)
+	if (pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATE_DETAIL)
 		flags |= DNF_SACK_ADD_FLAG_UPDATEINFO;
 
 	/* only use unavailble packages for queries */
@@ -652,33 +981,31 @@ dnf_utils_create_sack_for_filters (PkBackendJob *job,
 		break;
 	}
 
-	/* media repos could disappear at any time */
-	if ((create_flags & DNF_CREATE_SACK_FLAG_USE_CACHE) > 0 &&
-	    dnf_repo_loader_has_removable_repos (dnf_context_get_repo_loader (job_data->context)) &&
-	    g_timer_elapsed (priv->repos_timer, NULL) > 1.0f) {
-		g_debug ("not reusing sack as media may have disappeared");
-		create_flags &= ~DNF_CREATE_SACK_FLAG_USE_CACHE;
+	/* a cached sack doesn't need the context, so don't wait for the
+	 * jobs creating their sacks */
+	if ((create_flags & DNF_CREATE_SACK_FLAG_USE_CACHE) > 0) {
+		sack = dnf_utils_claim_cached_sack (job, flags, &create_flags);
+		if (sack != NULL)
+			return g_steal_pointer (&sack);
 	}
-	g_timer_reset (priv->repos_timer);
 
-	/* if we've specified a specific cache-age then do not use the cache */
-	if ((flags & DNF_SACK_ADD_FLAG_REMOTE) > 0 &&
-	    pk_backend_job_get_cache_age (job) != G_MAXUINT) {
-		g_debug ("not reusing sack specific cache age requested");
-		create_flags &= ~DNF_CREATE_SACK_FLAG_USE_CACHE;
-	}
+	/* the context isn't thread-safe, create one sack at a time */
+	context_locker = g_rec_mutex_locker_new (&priv->context_mutex);
 
-	/* do we have anything in the cache */
-	cache_key = dnf_utils_create_cache_key (dnf_context_get_release_ver (job_data->context), flags);
-	if ((create_flags & DNF_CREATE_SACK_FLAG_USE_CACHE) > 0) {
-		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
-		cache_item = g_hash_table_lookup (priv->sack_cache, cache_key);
-		if (cache_item != NULL && cache_item->sack != NULL) {
-			g_debug ("using cached sack %s", cache_key);
-			g_timer_start (cache_item->timer);
-			return g_object_ref (cache_item->sack);
-		}
+	/* GetUpdates only needs the kind and severity of the advisories,
+	 * which may be known already */
+	if (pk_backend_job_get_role (job) == PK_ROLE_ENUM_GET_UPDATES) {
+		advisory_summary = pk_backend_dnf_advisory_summary_get (backend, job_data->context);
+		if (advisory_summary == NULL)
+			flags |= DNF_SACK_ADD_FLAG_UPDATEINFO;
 	}
+	cache_key = dnf_utils_create_cache_key (dnf_context_get_release_ver (job_data->context), flags);
+
+	/* media repos could disappear at any time */
+	g_mutex_lock (&priv->sack_mutex);
+	priv->removable_repos = dnf_repo_loader_has_removable_repos (dnf_context_get_repo_loader (job_data->context));
+	g_timer_reset (priv->repos_timer);
+	g_mutex_unlock (&priv->sack_mutex);
 
 	/* update status */
 	dnf_state_action_start (state, DNF_STATE_ACTION_QUERY, NULL);
@@ -737,15 +1064,17 @@ dnf_utils_create_sack_for_filters (PkBackendJob *job,
 
 	dnf_sack_filter_modules (sack, dnf_context_get_repos (job_data->context), install_root, NULL);
 
-	/* save in cache */
-	g_mutex_lock (&priv->sack_mutex);
-	cache_item = g_slice_new (DnfSackCacheItem);
-	cache_item->key = g_strdup (cache_key);
-	cache_item->sack = g_object_ref (sack);
-	cache_item->timer = g_timer_new ();
-	g_debug ("created cached sack %s", cache_item->key);
-	g_hash_table_insert (priv->sack_cache, g_strdup (cache_key), cache_item);
-	g_mutex_unlock (&priv->sack_mutex);
+	if ((flags & DNF_SACK_ADD_FLAG_UPDATEINFO) > 0)
+		pk_backend_dnf_advisory_summary_update (backend, job_data->context, sack);
+	pk_backend_dnf_sack_set_advisory_summary (sack, advisory_summary);
+
+	if (!shared)
+		return g_steal_pointer (&sack);
+
+	/* save in cache, next to the sacks other jobs are using unless
+	 * those could not be reused */
+	dnf_sack_pool_add (priv->sack_pool, cache_key, sack, job,
+			   (create_flags & DNF_CREATE_SACK_FLAG_USE_CACHE) == 0);
 
 	return g_steal_pointer (&sack);
 }
@@ -888,6 +1217,14 @@ pk_backend_dnf_cache_advisories (DnfSack *sack)
 	HyQuery query;
 	guint ii;
 
+	static GMutex mutex;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&mutex);
+
+	/* built once for each sack, which might be cached */
+	hash = g_object_get_data (G_OBJECT (sack), PK_DNF_SACK_ADVISORIES_KEY);
+	if (hash != NULL)
+		return g_hash_table_ref (hash);
+
 	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) dnf_advisory_free);
 	query = hy_query_create (sack);
 	array = hy_query_get_advisory_pkgs (query, HY_EQ);
@@ -905,6 +1242,8 @@ pk_backend_dnf_cache_advisories (DnfSack *sack)
 	}
 
 	hy_query_free (query);
+	g_object_set_data_full (G_OBJECT (sack), PK_DNF_SACK_ADVISORIES_KEY,
+				g_hash_table_ref (hash), (GDestroyNotify) g_hash_table_unref);
 	return hash;
 #else
 	return NULL;
@@ -1106,9 +1445,25 @@ pk_backend_search_thread (PkBackendJob *job, GVariant *params, gpointer user_dat
 		DnfAdvisory *advisory;
 		DnfAdvisoryKind kind;
 		PkInfoEnum info_enum;
-		g_autoptr(GHashTable) advisories_hash = pk_backend_dnf_cache_advisories (sack);
+		PkInfoEnum severity;
+		GHashTable *advisory_summary;
+		g_autoptr(GHashTable) advisories_hash = NULL;
+
+		/* the sack has no updateinfo if it was created with a valid summary */
+		advisory_summary = g_object_get_data (G_OBJECT (sack), PK_DNF_SACK_ADVISORY_SUMMARY_KEY);
+		if (advisory_summary == NULL)
+			advisories_hash = pk_backend_dnf_cache_advisories (sack);
 		for (i = 0; i < pkglist->len; i++) {
 			pkg = g_ptr_array_index (pkglist, i);
+			if (advisory_summary != NULL) {
+				if (pk_backend_dnf_advisory_summary_lookup (advisory_summary, pkg,
+									    &info_enum, &severity)) {
+					g_object_set_data (G_OBJECT (pkg), PK_DNF_UPDATE_SEVERITY_KEY,
+							   GUINT_TO_POINTER (severity));
+					dnf_package_set_info (pkg, (DnfPackageInfo) info_enum);
+				}
+				continue;
+			}
 			advisory = pk_backend_dnf_get_advisory (advisories_hash, pkg);
 			if (advisory != NULL) {
 				kind = dnf_advisory_get_kind (advisory);
@@ -1320,7 +1675,6 @@ pk_backend_get_repo_list_thread (PkBackendJob *job,
 	gboolean enabled;
 	guint i;
 	DnfRepo *repo;
-	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
 	PkBitfield filters;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GPtrArray) repos = NULL;
@@ -1331,7 +1685,7 @@ pk_backend_get_repo_list_thread (PkBackendJob *job,
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 
 	/* ask the context's repo loader for new repos, forcing it to reload them */
-	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (job_data->context), &error);
+	repos = dnf_utils_get_repos (job, &error);
 	if (repos == NULL) {
 		pk_backend_job_error_code (job,
 		                           error->code,
@@ -1381,7 +1735,9 @@ pk_backend_repo_set_data_thread (PkBackendJob *job,
 	gboolean ret = FALSE;
 	DnfRepo *repo;
 	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (job_data->backend);
 	g_autoptr(GError) error = NULL;
+	g_autoptr(GRecMutexLocker) context_locker = NULL;
 
 	/* get arguments */
 	switch (pk_backend_job_get_role (job)) {
@@ -1421,8 +1777,11 @@ pk_backend_repo_set_data_thread (PkBackendJob *job,
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 	pk_backend_job_set_percentage (job, 0);
 
+	/* no sack may be loaded from the repo while it changes */
+	context_locker = g_rec_mutex_locker_new (&priv->context_mutex);
+
 	/* find the correct repo */
-	repo = dnf_repo_loader_get_repo_by_id (dnf_context_get_repo_loader (job_data->context), repo_id, &error);
+	repo = dnf_utils_get_repo_by_id (job, repo_id, &error);
 	if (repo == NULL) {
 		pk_backend_job_error_code (job,
 					   error->code,
@@ -1486,7 +1845,7 @@ pk_backend_repo_set_data (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_repo_set_data_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_repo_set_data_thread, NULL);
 }
 
 void
@@ -1504,7 +1863,7 @@ pk_backend_repo_enable (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_repo_set_data_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_repo_set_data_thread, NULL);
 }
 
 PkBitfield
@@ -1632,6 +1991,7 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GPtrArray) refresh_repos = NULL;
 	g_autoptr(GPtrArray) repos = NULL;
+	g_autoptr(GRecMutexLocker) context_locker = NULL;
 	g_autofree gchar *max_cache_age = NULL;
 
 	/* set state */
@@ -1647,7 +2007,7 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 	pk_backend_refresh_subman (job);
 
 	/* ask the context's repo loader for new repos, forcing it to reload them */
-	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (job_data->context), &error);
+	repos = dnf_utils_get_repos (job, &error);
 	if (repos == NULL) {
 		pk_backend_job_error_code (job,
 		                           error->code,
@@ -1669,49 +2029,42 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 		return;
 	}
 
-	/* refresh each repo */
+	/* refresh the repos in parallel, the helpers download next to the
+	 * current metadata so the other jobs can go on using them; forced
+	 * repos are downloaded again even if up to date */
 	state_local = dnf_state_get_child (job_data->state);
-	dnf_state_set_number_steps (state_local, refresh_repos->len);
-	max_cache_age = g_strdup_printf ("%u", pk_backend_job_get_cache_age (job));
+	max_cache_age = g_strdup_printf ("%u", force ? 0 : pk_backend_job_get_cache_age (job));
+	ret = pk_backend_refresh_repos (LIBEXECDIR "/packagekit-dnf-refresh-repo",
+					refresh_repos, max_cache_age, priv->release_ver,
+					state_local, &error);
+
+	/* no sack may be loaded from the metadata while it is replaced,
+	 * the repos that did refresh are swapped in even if others failed */
+	context_locker = g_rec_mutex_locker_new (&priv->context_mutex);
 	for (i = 0; i < refresh_repos->len; i++) {
-		gint wait_status;
-		const gchar *refresh[5];
-		repo = g_ptr_array_index (refresh_repos, i);
+		g_autoptr(GError) error_local = NULL;
 
-		/* delete content even if up to date */
-		if (force) {
-			g_debug ("Deleting contents of %s as forced", dnf_repo_get_id (repo));
-			ret = dnf_repo_clean (repo, &error);
-			if (!ret) {
-				pk_backend_job_error_code (job, error->code, "%s", error->message);
-				return;
+		repo = g_ptr_array_index (refresh_repos, i);
+		if (!pk_backend_refresh_repo_swap (repo, &error_local)) {
+			g_warning ("%s", error_local->message);
+			if (ret) {
+				ret = FALSE;
+				g_propagate_error (&error, g_steal_pointer (&error_local));
 			}
 		}
-
-		/* check and download */
-		refresh[0] = LIBEXECDIR "/packagekit-dnf-refresh-repo";
-		refresh[1] = max_cache_age;
-		refresh[2] = dnf_repo_get_id (repo);
-		refresh[3] = priv->release_ver;
-		refresh[4] = NULL;
-		if (!g_spawn_sync (NULL,
-				   (gchar **) refresh,
-				   NULL,
-				   G_SPAWN_DEFAULT,
-				   NULL,
-				   NULL,
-				   NULL,
-				   NULL,
-				   &wait_status,
-				   &error))
-			pk_backend_job_error_code (job, error->code, "%s", "unkown error in pk_backend_refresh_repo");
-
-		/* done */
-		ret = dnf_state_done (state_local, &error);
-		if (!ret) {
-			pk_backend_job_error_code (job, error->code, "%s", error->message);
-			return;
+	}
+	g_clear_pointer (&context_locker, g_rec_mutex_locker_free);
+	if (!ret) {
+		/* the repos that did refresh are still newer than the cached sacks */
+		pk_backend_sack_cache_invalidate (backend, "downloaded new metadata");
+		if (g_error_matches (error, DNF_ERROR, DNF_ERROR_CANNOT_FETCH_SOURCE)) {
+			pk_backend_job_error_code (job, PK_ERROR_ENUM_CANNOT_FETCH_SOURCES,
+						   "%s", error->message);
+		} else {
+			pk_backend_job_error_code (job, PK_ERROR_ENUM_INTERNAL_ERROR,
+						   "failed to refresh repos: %s", error->message);
 		}
+		return;
 	}
 
 	/* done */
@@ -1759,86 +2112,7 @@ pk_backend_refresh_cache (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_refresh_cache_thread, NULL, NULL);
-}
-
-/**
- * dnf_utils_find_package_ids:
- *
- * Returns a hash table of all the packages found in the sack.
- * If a specific package-id is not found then the method does not fail, but
- * no package will be inserted into the hash table.
- *
- * If multiple packages are found, an error is returned, as the package-id is
- * supposed to uniquely identify the package across all repos.
- */
-static GHashTable *
-dnf_utils_find_package_ids (DnfSack *sack, gchar **package_ids, GError **error)
-{
-	const gchar *reponame;
-	gboolean ret = TRUE;
-	GHashTable *hash;
-	guint i;
-	GPtrArray *pkglist = NULL;
-	DnfPackage *pkg;
-	HyQuery query = NULL;
-
-	/* run query */
-	hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-				      g_free, (GDestroyNotify) g_object_unref);
-	query = hy_query_create (sack);
-	for (i = 0; package_ids[i] != NULL; i++) {
-		g_auto(GStrv) split = NULL;
-		hy_query_clear (query);
-		split = pk_package_id_split (package_ids[i]);
-		reponame = split[PK_PACKAGE_ID_DATA];
-		if (g_strcmp0 (reponame, "installed") == 0 ||
-		    g_str_has_prefix (reponame, "installed:"))
-			reponame = HY_SYSTEM_REPO_NAME;
-		else if (g_strcmp0 (reponame, "local") == 0)
-			reponame = HY_CMDLINE_REPO_NAME;
-		hy_query_filter (query, HY_PKG_NAME, HY_EQ, split[PK_PACKAGE_ID_NAME]);
-		hy_query_filter (query, HY_PKG_EVR, HY_EQ, split[PK_PACKAGE_ID_VERSION]);
-		hy_query_filter (query, HY_PKG_ARCH, HY_EQ, split[PK_PACKAGE_ID_ARCH]);
-		hy_query_filter (query, HY_PKG_REPONAME, HY_EQ, reponame);
-		pkglist = hy_query_run (query);
-
-		/* no matches */
-		if (pkglist->len == 0) {
-			g_ptr_array_unref (pkglist);
-			continue;
-		}
-
-		/* multiple matches */
-		if (pkglist->len > 1) {
-			ret = FALSE;
-			g_set_error (error,
-				     DNF_ERROR,
-				     PK_ERROR_ENUM_PACKAGE_CONFLICTS,
-				     "Multiple matches of %s", package_ids[i]);
-			for (i = 0; i < pkglist->len; i++) {
-				pkg = g_ptr_array_index (pkglist, i);
-				g_debug ("possible matches: %s",
-					 dnf_package_get_package_id (pkg));
-			}
-			goto out;
-		}
-
-		/* add to results */
-		pkg = g_ptr_array_index (pkglist, 0);
-		g_hash_table_insert (hash,
-				     g_strdup (package_ids[i]),
-				     g_object_ref (pkg));
-		g_ptr_array_unref (pkglist);
-	}
-out:
-	if (!ret && hash != NULL) {
-		g_hash_table_unref (hash);
-		hash = NULL;
-	}
-	if (query != NULL)
-		hy_query_free (query);
-	return hash;
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_refresh_cache_thread, NULL);
 }
 
 static void
@@ -2219,9 +2493,9 @@ pk_backend_download_packages_thread (PkBackendJob *job, GVariant *params, gpoint
 		dnf_emit_package (job, PK_INFO_ENUM_DOWNLOADING, pkg);
 
 		/* get correct package repo */
-		repo = dnf_repo_loader_get_repo_by_id (dnf_context_get_repo_loader (job_data->context),
-		                                       dnf_package_get_reponame (pkg),
-		                                       &error);
+		repo = dnf_utils_get_repo_by_id (job,
+		                                 dnf_package_get_reponame (pkg),
+		                                 &error);
 		if (repo == NULL) {
 			g_prefix_error (&error, "Not sure where to download %s: ",
 					dnf_package_get_name (pkg));
@@ -2286,7 +2560,7 @@ pk_backend_download_packages (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_download_packages_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_download_packages_thread, NULL);
 }
 
 void
@@ -2325,9 +2599,9 @@ pk_backend_transaction_check_untrusted_repos (PkBackendJob *job, GError **error)
 		}
 
 		/* find repo */
-		repo = dnf_repo_loader_get_repo_by_id (dnf_context_get_repo_loader (job_data->context),
-		                                       dnf_package_get_reponame (pkg),
-		                                       error);
+		repo = dnf_utils_get_repo_by_id (job,
+		                                 dnf_package_get_reponame (pkg),
+		                                 error);
 		if (repo == NULL) {
 			g_prefix_error (error, "Can't GPG check %s: ",
 					dnf_package_get_name (pkg));
@@ -2656,6 +2930,7 @@ pk_backend_repo_remove_thread (PkBackendJob *job,
 	HyQuery query = NULL;
 	HyQuery query_release = NULL;
 	PkBackendDnfJobData *job_data = pk_backend_job_get_user_data (job);
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (job_data->backend);
 	PkBitfield filters = pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1);
 	const gchar *from_repo;
 	const gchar *repo_filename;
@@ -2671,6 +2946,7 @@ pk_backend_repo_remove_thread (PkBackendJob *job,
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GPtrArray) removed_id = NULL;
 	g_autoptr(GPtrArray) repos = NULL;
+	g_autoptr(GRecMutexLocker) context_locker = NULL;
 	g_auto(GStrv) search = NULL;
 
 	g_variant_get (params, "(t&sb)",
@@ -2678,6 +2954,10 @@ pk_backend_repo_remove_thread (PkBackendJob *job,
 		       &repo_id,
 		       &autoremove);
 
+	/* the transaction removes the .repo files, no sack may be loaded
+	 * from the repos until it is done */
+	context_locker = g_rec_mutex_locker_new (&priv->context_mutex);
+
 	/* set state */
 	ret = dnf_state_set_steps (job_data->state, NULL,
 				   1, /* get the .repo filename for @repo_id */
@@ -2689,7 +2969,7 @@ pk_backend_repo_remove_thread (PkBackendJob *job,
 	g_assert (ret);
 
 	/* find the repo-release package name for @repo_id */
-	repo = dnf_repo_loader_get_repo_by_id (dnf_context_get_repo_loader (job_data->context), repo_id, &error);
+	repo = dnf_utils_get_repo_by_id (job, repo_id, &error);
 	if (repo == NULL) {
 		pk_backend_job_error_code (job,
 					   error->code,
@@ -2705,7 +2985,7 @@ pk_backend_repo_remove_thread (PkBackendJob *job,
 	}
 
 	/* ask the context's repo loader for new repos, forcing it to reload them */
-	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (job_data->context), &error);
+	repos = dnf_utils_get_repos (job, &error);
 	if (repos == NULL) {
 		pk_backend_job_error_code (job,
 		                           error->code,
@@ -2844,7 +3124,7 @@ pk_backend_repo_remove (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_repo_remove_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_repo_remove_thread, NULL);
 }
 
 static gboolean
@@ -3021,7 +3301,7 @@ pk_backend_remove_packages (PkBackend *backend, PkBackendJob *job,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_remove_packages_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_remove_packages_thread, NULL);
 }
 
 static void
@@ -3210,7 +3490,7 @@ pk_backend_install_packages (PkBackend *backend, PkBackendJob *job,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_install_packages_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_install_packages_thread, NULL);
 }
 
 static void
@@ -3322,7 +3602,7 @@ pk_backend_install_files (PkBackend *backend, PkBackendJob *job,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_install_files_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_install_files_thread, NULL);
 }
 
 static void
@@ -3436,7 +3716,7 @@ pk_backend_update_packages (PkBackend *backend, PkBackendJob *job,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_update_packages_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_update_packages_thread, NULL);
 }
 
 static void
@@ -3541,7 +3821,7 @@ pk_backend_upgrade_system (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_upgrade_system_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_upgrade_system_thread, NULL);
 }
 
 PkBitfield
@@ -3919,5 +4199,5 @@ pk_backend_repair_system (PkBackend *backend,
 		return;
 	}
 	pk_backend_job_set_context (job, priv->context);
-	pk_backend_job_thread_create (job, pk_backend_repair_system_thread, NULL, NULL);
+	pk_backend_job_thread_create (job, pk_backend_exclusive_thread, (gpointer) pk_backend_repair_system_thread, NULL);
 }
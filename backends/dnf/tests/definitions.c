@@ -0,0 +1,15 @@
+#include <pk-backend.h>
+#include <pk-backend-job.h>
+
+/* Define symbols used by libpk_backend_dnf,
+ * otherwise we can't link it.
+ */
+
+void
+pk_backend_job_package_full (PkBackendJob *job,
+			     PkInfoEnum info,
+			     const gchar *package_id,
+			     const gchar *summary,
+			     PkInfoEnum update_severity)
+{
+}
@@ -0,0 +1,749 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include <libdnf/libdnf.h>
+#include <libdnf/hy-goal.h>
+#include <libdnf/hy-query.h>
+
+#include "dnf-backend.h"
+#include "dnf-sack-pool.h"
+#include "pk-backend-dnf-common.h"
+
+#define DNF_TEST_RELEASE_VER	"test"
+
+static void
+dnf_test_remove_dir (const gchar *path)
+{
+	const gchar *name;
+	g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *child = g_build_filename (path, name, NULL);
+		if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+		    !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+			dnf_test_remove_dir (child);
+		else
+			g_unlink (child);
+	}
+	g_rmdir (path);
+}
+
+static void
+dnf_test_write_file (const gchar *filename, const gchar *contents)
+{
+	g_autofree gchar *dirname = g_path_get_dirname (filename);
+	g_autoptr(GError) error = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (dirname, 0755), ==, 0);
+	g_assert_true (g_file_set_contents (filename, contents, -1, &error));
+	g_assert_no_error (error);
+}
+
+/*
+ * Writes an uncompressed rpm-md repo with @n_packages noarch packages below
+ * @root/repos/@repo_id and a .repo file pointing at it with a file:// URL.
+ */
+static void
+dnf_test_write_repo (const gchar *root, const gchar *repo_id, guint n_packages)
+{
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *primary_fn = NULL;
+	g_autofree gchar *repo_dir = NULL;
+	g_autofree gchar *repo_fn = NULL;
+	g_autofree gchar *repo_conf = NULL;
+	g_autofree gchar *repomd = NULL;
+	g_autofree gchar *repomd_fn = NULL;
+	g_autoptr(GString) primary = g_string_new (NULL);
+
+	g_string_append_printf (primary,
+				"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				"<metadata xmlns=\"http://linux.duke.edu/metadata/common\" "
+				"xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\" packages=\"%u\">\n",
+				n_packages);
+	for (guint i = 0; i < n_packages; i++) {
+		g_autofree gchar *name = g_strdup_printf ("%s-pkg%u", repo_id, i);
+		g_autofree gchar *pkgid = g_compute_checksum_for_string (G_CHECKSUM_SHA256, name, -1);
+		g_string_append_printf (primary,
+					"<package type=\"rpm\">\n"
+					"  <name>%s</name>\n"
+					"  <arch>noarch</arch>\n"
+					"  <version epoch=\"0\" ver=\"1.0\" rel=\"1\"/>\n"
+					"  <checksum type=\"sha256\" pkgid=\"YES\">%s</checksum>\n"
+					"  <summary>Test package %u</summary>\n"
+					"  <description>Test package %u of %s</description>\n"
+					"  <packager/>\n"
+					"  <url/>\n"
+					"  <time file=\"1\" build=\"1\"/>\n"
+					"  <size package=\"1\" installed=\"1\" archive=\"1\"/>\n"
+					"  <location href=\"%s-1.0-1.noarch.rpm\"/>\n"
+					"  <format>\n"
+					"    <rpm:license>GPLv2+</rpm:license>\n"
+					"    <rpm:provides>\n"
+					"      <rpm:entry name=\"%s\" flags=\"EQ\" epoch=\"0\" ver=\"1.0\" rel=\"1\"/>\n"
+					"    </rpm:provides>\n"
+					"  </format>\n"
+					"</package>\n",
+					name, pkgid, i, i, repo_id, name, name);
+	}
+	g_string_append (primary, "</metadata>\n");
+
+	repo_dir = g_build_filename (root, "repos", repo_id, NULL);
+	primary_fn = g_build_filename (repo_dir, "repodata", "primary.xml", NULL);
+	dnf_test_write_file (primary_fn, primary->str);
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, primary->str, primary->len);
+	repomd = g_strdup_printf ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				  "<repomd xmlns=\"http://linux.duke.edu/metadata/repo\" "
+				  "xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\">\n"
+				  "  <revision>1</revision>\n"
+				  "  <data type=\"primary\">\n"
+				  "    <checksum type=\"sha256\">%s</checksum>\n"
+				  "    <open-checksum type=\"sha256\">%s</open-checksum>\n"
+				  "    <location href=\"repodata/primary.xml\"/>\n"
+				  "    <timestamp>1</timestamp>\n"
+				  "    <size>%" G_GSIZE_FORMAT "</size>\n"
+				  "    <open-size>%" G_GSIZE_FORMAT "</open-size>\n"
+				  "  </data>\n"
+				  "</repomd>\n",
+				  checksum, checksum, primary->len, primary->len);
+	repomd_fn = g_build_filename (repo_dir, "repodata", "repomd.xml", NULL);
+	dnf_test_write_file (repomd_fn, repomd);
+
+	repo_conf = g_strdup_printf ("[%s]\n"
+				     "name=%s\n"
+				     "baseurl=file://%s\n"
+				     "enabled=1\n"
+				     "gpgcheck=0\n",
+				     repo_id, repo_id, repo_dir);
+	repo_fn = g_strdup_printf ("%s/etc/yum.repos.d/%s.repo", root, repo_id);
+	dnf_test_write_file (repo_fn, repo_conf);
+}
+
+/* a context that only sees the repos written below @root */
+static DnfContext *
+dnf_test_context_new (const gchar *root)
+{
+	g_autoptr(DnfContext) context = dnf_context_new ();
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *cache_dir = g_build_filename (root, "cache", "metadata", NULL);
+	g_autofree gchar *lock_dir = g_build_filename (root, "run", NULL);
+	g_autofree gchar *repos_dir = g_build_filename (root, "etc", "yum.repos.d", NULL);
+	g_autofree gchar *solv_dir = g_build_filename (root, "cache", "hawkey", NULL);
+	const gchar *repos_dirs[] = { repos_dir, NULL };
+
+	g_assert_cmpint (g_mkdir_with_parents (lock_dir, 0755), ==, 0);
+	dnf_context_set_install_root (context, root);
+	dnf_context_set_repos_dir (context, repos_dirs);
+	dnf_context_set_cache_dir (context, cache_dir);
+	dnf_context_set_solv_dir (context, solv_dir);
+	dnf_context_set_lock_dir (context, lock_dir);
+	dnf_context_set_release_ver (context, DNF_TEST_RELEASE_VER);
+	g_assert_true (dnf_context_setup (context, NULL, &error));
+	g_assert_no_error (error);
+	return g_steal_pointer (&context);
+}
+
+static GPtrArray *
+dnf_test_get_repos (DnfContext *context)
+{
+	g_autoptr(GError) error = NULL;
+	GPtrArray *repos;
+
+	repos = dnf_repo_loader_get_repos (dnf_context_get_repo_loader (context), &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (repos);
+	return repos;
+}
+
+static void
+dnf_test_refresh_repos (GPtrArray *repos)
+{
+	for (guint i = 0; i < repos->len; i++) {
+		DnfRepo *repo = g_ptr_array_index (repos, i);
+		g_autoptr(DnfState) state = dnf_state_new ();
+		g_autoptr(GError) error = NULL;
+
+		g_assert_true (pk_backend_refresh_repo (0, repo, FALSE, state, &error));
+		g_assert_no_error (error);
+	}
+}
+
+/* loads the refreshed @repos into a new sack */
+static DnfSack *
+dnf_test_sack_new (const gchar *root, GPtrArray *repos)
+{
+	g_autofree gchar *solv_dir = g_build_filename (root, "cache", "hawkey", NULL);
+	g_autoptr(DnfSack) sack = dnf_sack_new ();
+	g_autoptr(GError) error = NULL;
+
+	dnf_sack_set_cachedir (sack, solv_dir);
+	g_assert_true (dnf_sack_setup (sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, &error));
+	g_assert_no_error (error);
+	for (guint i = 0; i < repos->len; i++) {
+		DnfRepo *repo = g_ptr_array_index (repos, i);
+		g_autoptr(DnfState) state_add = dnf_state_new ();
+
+		g_assert_true (dnf_sack_add_repo (sack, repo, G_MAXUINT,
+						  DNF_SACK_ADD_FLAG_NONE,
+						  state_add, &error));
+		g_assert_no_error (error);
+	}
+	return g_steal_pointer (&sack);
+}
+
+static gchar *
+dnf_test_package_id (const gchar *repo_id, guint i, const gchar *evr)
+{
+	g_autofree gchar *name = g_strdup_printf ("%s-pkg%u", repo_id, i);
+	return pk_package_id_build (name, evr, "noarch", repo_id);
+}
+
+static void
+dnf_test_refresh_file_repos (void)
+{
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(GPtrArray) repos = NULL;
+
+	dnf_test_write_repo (root, "pk-test-a", 3);
+	dnf_test_write_repo (root, "pk-test-b", 5);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	g_assert_cmpint (repos->len, ==, 2);
+
+	/* what the helper does for each repo */
+	for (guint i = 0; i < repos->len; i++) {
+		DnfRepo *repo = g_ptr_array_index (repos, i);
+		g_autoptr(DnfState) state = dnf_state_new ();
+		g_autoptr(DnfState) state_check = dnf_state_new ();
+		g_autoptr(GError) error = NULL;
+
+		g_assert_true (pk_backend_refresh_repo (0, repo, FALSE, state, &error));
+		g_assert_no_error (error);
+		g_assert_nonnull (dnf_repo_get_filename_md (repo, "primary"));
+
+		/* and the downloaded metadata is now current */
+		g_assert_true (dnf_repo_check (repo, G_MAXUINT, state_check, &error));
+		g_assert_no_error (error);
+	}
+
+	dnf_test_remove_dir (root);
+}
+
+/* what the backend sees of a refresh done by the helper */
+static void
+dnf_test_refresh_staged (void)
+{
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autofree gchar *packages = NULL;
+	g_autofree gchar *staging = NULL;
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(DnfState) state = dnf_state_new ();
+	g_autoptr(DnfState) state_check = dnf_state_new ();
+	g_autoptr(DnfState) state_swapped = dnf_state_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) repos = NULL;
+	DnfRepo *repo;
+
+	dnf_test_write_repo (root, "pk-test-a", 3);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	g_assert_cmpint (repos->len, ==, 1);
+	repo = g_ptr_array_index (repos, 0);
+	packages = g_build_filename (dnf_repo_get_location (repo), "packages", "pk-test-a-pkg0.rpm", NULL);
+	dnf_test_write_file (packages, "cached");
+
+	/* the new metadata are kept aside, the current ones stay usable */
+	g_assert_true (pk_backend_refresh_repo (0, repo, TRUE, state, &error));
+	g_assert_no_error (error);
+	staging = g_strdup_printf ("%s.pk-staged", dnf_repo_get_location (repo));
+	g_assert_true (g_file_test (staging, G_FILE_TEST_IS_DIR));
+	g_assert_false (dnf_repo_check (repo, G_MAXUINT, state_check, NULL));
+
+	/* swapping them in keeps the downloaded packages */
+	g_assert_true (pk_backend_refresh_repo_swap (repo, &error));
+	g_assert_no_error (error);
+	g_assert_false (g_file_test (staging, G_FILE_TEST_EXISTS));
+	g_assert_true (g_file_test (packages, G_FILE_TEST_EXISTS));
+	g_assert_true (dnf_repo_check (repo, G_MAXUINT, state_swapped, &error));
+	g_assert_no_error (error);
+
+	/* nothing to do without a staged refresh */
+	g_assert_true (pk_backend_refresh_repo_swap (repo, &error));
+	g_assert_no_error (error);
+
+	dnf_test_remove_dir (root);
+}
+
+static void
+dnf_test_refresh_percentage_cb (DnfState *state, guint percentage, gpointer user_data)
+{
+	guint *last = user_data;
+
+	g_assert_cmpint (percentage, >=, *last);
+	*last = percentage;
+}
+
+/* stands in for packagekit-dnf-refresh-repo, failing one repo */
+static const gchar dnf_test_helper[] =
+	"#!/bin/sh\n"
+	"echo 50\n"
+	"if [ \"$2\" = pk-test-broken ]; then\n"
+	"\techo \"metadata of $2 is corrupt\" >&2\n"
+	"\texit 1\n"
+	"fi\n"
+	"echo 100\n";
+
+static void
+dnf_test_refresh_helper_failure (void)
+{
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autofree gchar *helper = g_build_filename (root, "refresh-repo.sh", NULL);
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(DnfState) state = dnf_state_new ();
+	g_autoptr(DnfState) state_ok = dnf_state_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) repos = NULL;
+	g_autoptr(GPtrArray) repos_ok = g_ptr_array_new ();
+	guint last = 0;
+
+	dnf_test_write_file (helper, dnf_test_helper);
+	g_assert_cmpint (g_chmod (helper, 0755), ==, 0);
+	dnf_test_write_repo (root, "pk-test-a", 1);
+	dnf_test_write_repo (root, "pk-test-b", 1);
+	dnf_test_write_repo (root, "pk-test-broken", 1);
+	dnf_test_write_repo (root, "pk-test-c", 1);
+	dnf_test_write_repo (root, "pk-test-d", 1);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	g_assert_cmpint (repos->len, ==, 5);
+
+	/* the other repos are still refreshed, the failure names the broken one */
+	g_signal_connect (state, "percentage-changed",
+			  G_CALLBACK (dnf_test_refresh_percentage_cb), &last);
+	g_assert_false (pk_backend_refresh_repos (helper, repos, "0",
+						  DNF_TEST_RELEASE_VER,
+						  state, &error));
+	g_assert_error (error, DNF_ERROR, DNF_ERROR_CANNOT_FETCH_SOURCE);
+	g_assert_nonnull (strstr (error->message,
+				  "pk-test-broken: metadata of pk-test-broken is corrupt"));
+	g_assert_null (strstr (error->message, "pk-test-a"));
+	g_assert_cmpint (last, >=, 50);
+	g_clear_error (&error);
+
+	/* without it the refresh succeeds */
+	for (guint i = 0; i < repos->len; i++) {
+		DnfRepo *repo = g_ptr_array_index (repos, i);
+		if (g_strcmp0 (dnf_repo_get_id (repo), "pk-test-broken") != 0)
+			g_ptr_array_add (repos_ok, repo);
+	}
+	g_assert_true (pk_backend_refresh_repos (helper, repos_ok, "0",
+						 DNF_TEST_RELEASE_VER,
+						 state_ok, &error));
+	g_assert_no_error (error);
+
+	dnf_test_remove_dir (root);
+}
+
+static void
+dnf_test_package_ids_epoch (void)
+{
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(DnfSack) sack = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) hash = NULL;
+	g_autoptr(GPtrArray) repos = NULL;
+	g_auto(GStrv) package_ids = g_new0 (gchar *, 6);
+	DnfPackage *pkg;
+
+	dnf_test_write_repo (root, "pk-test-a", 3);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	dnf_test_refresh_repos (repos);
+	sack = dnf_test_sack_new (root, repos);
+
+	/* the same package with and without the zero epoch, a duplicate,
+	 * another package and one that does not exist */
+	package_ids[0] = dnf_test_package_id ("pk-test-a", 0, "1.0-1");
+	package_ids[1] = dnf_test_package_id ("pk-test-a", 0, "0:1.0-1");
+	package_ids[2] = dnf_test_package_id ("pk-test-a", 0, "1.0-1");
+	package_ids[3] = dnf_test_package_id ("pk-test-a", 1, "1.0-1");
+	package_ids[4] = dnf_test_package_id ("pk-test-a", 9, "1.0-1");
+	hash = dnf_utils_find_package_ids (sack, package_ids, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (hash);
+	g_assert_cmpint (g_hash_table_size (hash), ==, 3);
+
+	pkg = g_hash_table_lookup (hash, package_ids[0]);
+	g_assert_nonnull (pkg);
+	g_assert_true (g_hash_table_lookup (hash, package_ids[1]) == pkg);
+	g_assert_cmpstr (dnf_package_get_name (pkg), ==, "pk-test-a-pkg0");
+	pkg = g_hash_table_lookup (hash, package_ids[3]);
+	g_assert_nonnull (pkg);
+	g_assert_cmpstr (dnf_package_get_name (pkg), ==, "pk-test-a-pkg1");
+	g_assert_null (g_hash_table_lookup (hash, package_ids[4]));
+
+	dnf_test_remove_dir (root);
+}
+
+#define DNF_TEST_BENCHMARK_PACKAGES	2500
+
+static void
+dnf_test_package_ids_benchmark (void)
+{
+	const gchar *repo_ids[] = { "pk-test-a", "pk-test-b", NULL };
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(DnfSack) sack = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) hash = NULL;
+	g_autoptr(GPtrArray) package_ids = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) repos = NULL;
+	gdouble ms;
+	gdouble ms_single;
+
+	for (guint i = 0; repo_ids[i] != NULL; i++)
+		dnf_test_write_repo (root, repo_ids[i], DNF_TEST_BENCHMARK_PACKAGES);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	dnf_test_refresh_repos (repos);
+	sack = dnf_test_sack_new (root, repos);
+	for (guint i = 0; repo_ids[i] != NULL; i++) {
+		for (guint j = 0; j < DNF_TEST_BENCHMARK_PACKAGES; j++)
+			g_ptr_array_add (package_ids, dnf_test_package_id (repo_ids[i], j, "1.0-1"));
+	}
+	g_ptr_array_add (package_ids, NULL);
+
+	/* check we resolved every package-id quickly */
+	g_test_timer_start ();
+	hash = dnf_utils_find_package_ids (sack, (gchar **) package_ids->pdata, &error);
+	ms = g_test_timer_elapsed ();
+	g_assert_no_error (error);
+	g_assert_nonnull (hash);
+	g_assert_cmpint (g_hash_table_size (hash), ==, package_ids->len - 1);
+	g_test_message ("resolved %u package-ids in %.3fs", package_ids->len - 1, ms);
+	g_assert_cmpfloat (ms, <, 2.0);
+
+	/* compare with one query per package-id */
+	if (g_test_perf ()) {
+		g_test_timer_start ();
+		for (guint i = 0; i < package_ids->len - 1; i++) {
+			g_auto(GStrv) split = pk_package_id_split (g_ptr_array_index (package_ids, i));
+			g_autoptr(GPtrArray) pkglist = NULL;
+			HyQuery query = hy_query_create (sack);
+
+			hy_query_filter (query, HY_PKG_NAME, HY_EQ, split[PK_PACKAGE_ID_NAME]);
+			hy_query_filter (query, HY_PKG_EVR, HY_EQ, split[PK_PACKAGE_ID_VERSION]);
+			hy_query_filter (query, HY_PKG_ARCH, HY_EQ, split[PK_PACKAGE_ID_ARCH]);
+			hy_query_filter (query, HY_PKG_REPONAME, HY_EQ, split[PK_PACKAGE_ID_DATA]);
+			pkglist = hy_query_run (query);
+			hy_query_free (query);
+			g_assert_cmpint (pkglist->len, ==, 1);
+		}
+		ms_single = g_test_timer_elapsed ();
+		g_test_minimized_result (ms_single,
+					 "one query per package-id: %.3fs, batched: %.3fs",
+					 ms_single, ms);
+	}
+
+	dnf_test_remove_dir (root);
+}
+
+static void
+dnf_test_sack_pool_claim (void)
+{
+	gint owner_a;
+	gint owner_b;
+	g_autoptr(DnfSackPool) pool = dnf_sack_pool_new ();
+	g_autoptr(DnfSack) sack1 = dnf_sack_new ();
+	g_autoptr(DnfSack) sack2 = dnf_sack_new ();
+	g_autoptr(DnfSack) sack3 = dnf_sack_new ();
+	DnfSack *sack;
+
+	/* nothing cached yet */
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owner_a));
+
+	/* a sack is only handed to the owner that claimed it */
+	dnf_sack_pool_add (pool, "key", sack1, &owner_a, FALSE);
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owner_b));
+	sack = dnf_sack_pool_claim (pool, "key", &owner_a);
+	g_assert_true (sack == sack1);
+	g_object_unref (sack);
+
+	/* another sack for the same key is used by the next owner */
+	dnf_sack_pool_add (pool, "key", sack2, &owner_b, FALSE);
+	dnf_sack_pool_release (pool, &owner_a);
+	sack = dnf_sack_pool_claim (pool, "key", &owner_a);
+	g_assert_true (sack == sack1);
+	g_object_unref (sack);
+	dnf_sack_pool_release (pool, &owner_a);
+	dnf_sack_pool_release (pool, &owner_b);
+	sack = dnf_sack_pool_claim (pool, "key", &owner_b);
+	g_assert_true (sack == sack1);
+	g_object_unref (sack);
+	sack = dnf_sack_pool_claim (pool, "key", &owner_a);
+	g_assert_true (sack == sack2);
+	g_object_unref (sack);
+	dnf_sack_pool_release (pool, &owner_a);
+	dnf_sack_pool_release (pool, &owner_b);
+
+	/* replacing drops the old sacks */
+	dnf_sack_pool_add (pool, "key", sack3, &owner_a, TRUE);
+	dnf_sack_pool_release (pool, &owner_a);
+	sack = dnf_sack_pool_claim (pool, "key", &owner_b);
+	g_assert_true (sack == sack3);
+	g_object_unref (sack);
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owner_a));
+
+	/* clearing keeps the claimed sack alive for its owner */
+	dnf_sack_pool_clear (pool);
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owner_a));
+	g_assert_cmpint (G_OBJECT (sack3)->ref_count, ==, 2);
+	dnf_sack_pool_release (pool, &owner_b);
+	g_assert_cmpint (G_OBJECT (sack3)->ref_count, ==, 1);
+
+	/* unused keys expire */
+	dnf_sack_pool_add (pool, "key", sack1, NULL, FALSE);
+	dnf_sack_pool_expire (pool, 3600);
+	sack = dnf_sack_pool_claim (pool, "key", &owner_a);
+	g_assert_true (sack == sack1);
+	g_object_unref (sack);
+	dnf_sack_pool_release (pool, &owner_a);
+	dnf_sack_pool_expire (pool, 0);
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owner_a));
+}
+
+/* after a burst of jobs only a few of their sacks are kept */
+static void
+dnf_test_sack_pool_idle (void)
+{
+	gint owners[4];
+	g_autoptr(DnfSackPool) pool = dnf_sack_pool_new ();
+	g_autoptr(GPtrArray) sacks = g_ptr_array_new_with_free_func (g_object_unref);
+	DnfSack *sack;
+
+	for (guint i = 0; i < G_N_ELEMENTS (owners); i++) {
+		g_ptr_array_add (sacks, dnf_sack_new ());
+		dnf_sack_pool_add (pool, "key", g_ptr_array_index (sacks, i), &owners[i], FALSE);
+	}
+
+	/* claimed sacks are kept until released */
+	dnf_sack_pool_release (pool, &owners[0]);
+	dnf_sack_pool_release (pool, &owners[1]);
+	dnf_sack_pool_release (pool, &owners[2]);
+	g_assert_cmpint (G_OBJECT (g_ptr_array_index (sacks, 3))->ref_count, ==, 3);
+	g_assert_cmpint (G_OBJECT (g_ptr_array_index (sacks, 2))->ref_count, ==, 1);
+	dnf_sack_pool_release (pool, &owners[3]);
+	g_assert_cmpint (G_OBJECT (g_ptr_array_index (sacks, 3))->ref_count, ==, 1);
+
+	/* the first two are still there for the next jobs */
+	sack = dnf_sack_pool_claim (pool, "key", &owners[0]);
+	g_assert_true (sack == g_ptr_array_index (sacks, 0));
+	g_object_unref (sack);
+	sack = dnf_sack_pool_claim (pool, "key", &owners[1]);
+	g_assert_true (sack == g_ptr_array_index (sacks, 1));
+	g_object_unref (sack);
+	g_assert_null (dnf_sack_pool_claim (pool, "key", &owners[2]));
+}
+
+#define DNF_TEST_STRESS_READERS		8
+#define DNF_TEST_STRESS_ROUNDS		50
+#define DNF_TEST_STRESS_INSTALLS	20
+
+typedef struct {
+	const gchar	*root;
+	GPtrArray	*repos;
+	DnfSackPool	*pool;
+	GMutex		 create_mutex;	/* the context of the backend */
+	GMutex		 busy_mutex;
+	GHashTable	*busy;		/* of DnfSack */
+	guint		 n_name;
+	guint		 n_provides;
+} DnfTestStress;
+
+static DnfSack *
+dnf_test_stress_sack_new (DnfTestStress *stress)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stress->create_mutex);
+	return dnf_test_sack_new (stress->root, stress->repos);
+}
+
+static void
+dnf_test_stress_search (DnfSack *sack, guint *n_name, guint *n_provides)
+{
+	const gchar *provides[] = { "pk-test-b-pkg7", "pk-test-c-pkg42", NULL };
+	g_autoptr(GPtrArray) by_name = NULL;
+	g_autoptr(GPtrArray) by_provides = NULL;
+	HyQuery query;
+
+	query = hy_query_create (sack);
+	hy_query_filter (query, HY_PKG_NAME, HY_SUBSTR, "pkg1");
+	by_name = hy_query_run (query);
+	hy_query_free (query);
+
+	query = hy_query_create (sack);
+	hy_query_filter_provides_in (query, (gchar **) provides);
+	by_provides = hy_query_run (query);
+	hy_query_free (query);
+
+	*n_name = by_name->len;
+	*n_provides = by_provides->len;
+}
+
+/* what a read-only job does with a cached sack */
+static gpointer
+dnf_test_stress_reader (gpointer user_data)
+{
+	DnfTestStress *stress = user_data;
+	gint owner;
+
+	for (guint i = 0; i < DNF_TEST_STRESS_ROUNDS; i++) {
+		guint n_name;
+		guint n_provides;
+		g_autoptr(DnfSack) sack = NULL;
+
+		sack = dnf_sack_pool_claim (stress->pool, "stress", &owner);
+		if (sack == NULL) {
+			sack = dnf_test_stress_sack_new (stress);
+			dnf_sack_pool_add (stress->pool, "stress", sack, &owner, FALSE);
+		}
+
+		/* no other job may query the same sack */
+		g_mutex_lock (&stress->busy_mutex);
+		g_assert_false (g_hash_table_contains (stress->busy, sack));
+		g_hash_table_add (stress->busy, sack);
+		g_mutex_unlock (&stress->busy_mutex);
+
+		dnf_test_stress_search (sack, &n_name, &n_provides);
+		g_assert_cmpint (n_name, ==, stress->n_name);
+		g_assert_cmpint (n_provides, ==, stress->n_provides);
+
+		g_mutex_lock (&stress->busy_mutex);
+		g_hash_table_remove (stress->busy, sack);
+		g_mutex_unlock (&stress->busy_mutex);
+		dnf_sack_pool_release (stress->pool, &owner);
+	}
+	return NULL;
+}
+
+/* what a simulated install does: a sack of its own, then invalidation */
+static gpointer
+dnf_test_stress_installer (gpointer user_data)
+{
+	DnfTestStress *stress = user_data;
+
+	for (guint i = 0; i < DNF_TEST_STRESS_INSTALLS; i++) {
+		g_autofree gchar *name = g_strdup_printf ("pk-test-a-pkg%u", i);
+		g_autoptr(DnfSack) sack = dnf_test_stress_sack_new (stress);
+		g_autoptr(GPtrArray) installs = NULL;
+		g_autoptr(GPtrArray) pkglist = NULL;
+		HyGoal goal;
+		HyQuery query;
+
+		query = hy_query_create (sack);
+		hy_query_filter (query, HY_PKG_NAME, HY_EQ, name);
+		pkglist = hy_query_run (query);
+		hy_query_free (query);
+		g_assert_cmpint (pkglist->len, ==, 1);
+
+		goal = hy_goal_create (sack);
+		hy_goal_install (goal, g_ptr_array_index (pkglist, 0));
+		g_assert_cmpint (hy_goal_run_flags (goal, DNF_NONE), ==, 0);
+		installs = hy_goal_list_installs (goal, NULL);
+		g_assert_nonnull (installs);
+		g_assert_cmpint (installs->len, ==, 1);
+		hy_goal_free (goal);
+
+		dnf_sack_pool_clear (stress->pool);
+	}
+	return NULL;
+}
+
+static void
+dnf_test_sack_pool_stress (void)
+{
+	const gchar *repo_ids[] = { "pk-test-a", "pk-test-b", "pk-test-c", NULL };
+	g_autofree gchar *root = g_dir_make_tmp ("pk-dnf-test-XXXXXX", NULL);
+	g_autoptr(DnfContext) context = NULL;
+	g_autoptr(DnfSack) sack = NULL;
+	g_autoptr(GPtrArray) readers = g_ptr_array_new ();
+	g_autoptr(GPtrArray) repos = NULL;
+	DnfTestStress stress = { 0 };
+	GThread *installer;
+
+	for (guint i = 0; repo_ids[i] != NULL; i++)
+		dnf_test_write_repo (root, repo_ids[i], 300);
+	context = dnf_test_context_new (root);
+	repos = dnf_test_get_repos (context);
+	dnf_test_refresh_repos (repos);
+
+	stress.root = root;
+	stress.repos = repos;
+	stress.pool = dnf_sack_pool_new ();
+	stress.busy = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_mutex_init (&stress.create_mutex);
+	g_mutex_init (&stress.busy_mutex);
+
+	/* the expected results, this also writes the solv caches */
+	sack = dnf_test_sack_new (root, repos);
+	dnf_test_stress_search (sack, &stress.n_name, &stress.n_provides);
+	g_assert_cmpint (stress.n_name, ==, 3 * 111);
+	g_assert_cmpint (stress.n_provides, ==, 2);
+
+	/* many searches while packages are being installed */
+	installer = g_thread_new ("installer", dnf_test_stress_installer, &stress);
+	for (guint i = 0; i < DNF_TEST_STRESS_READERS; i++)
+		g_ptr_array_add (readers, g_thread_new ("reader", dnf_test_stress_reader, &stress));
+	for (guint i = 0; i < readers->len; i++)
+		g_thread_join (g_ptr_array_index (readers, i));
+	g_thread_join (installer);
+	g_assert_cmpint (g_hash_table_size (stress.busy), ==, 0);
+
+	g_hash_table_unref (stress.busy);
+	dnf_sack_pool_free (stress.pool);
+	g_mutex_clear (&stress.create_mutex);
+	g_mutex_clear (&stress.busy_mutex);
+	dnf_test_remove_dir (root);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_setenv ("G_MESSAGES_DEBUG", "all", TRUE);
+	g_test_init (&argc, &argv, NULL);
+
+	/* tests go here */
+	g_test_add_func ("/dnf/refresh/file-repos", dnf_test_refresh_file_repos);
+	g_test_add_func ("/dnf/refresh/staged", dnf_test_refresh_staged);
+	g_test_add_func ("/dnf/refresh/helper-failure", dnf_test_refresh_helper_failure);
+	g_test_add_func ("/dnf/package-ids/epoch", dnf_test_package_ids_epoch);
+	g_test_add_func ("/dnf/package-ids/benchmark", dnf_test_package_ids_benchmark);
+	g_test_add_func ("/dnf/sack-pool/claim", dnf_test_sack_pool_claim);
+	g_test_add_func ("/dnf/sack-pool/idle", dnf_test_sack_pool_idle);
+	g_test_add_func ("/dnf/sack-pool/stress", dnf_test_sack_pool_stress);
+
+	return g_test_run ();
+}
@@ -35,22 +35,55 @@
 #include <nix/experimental-features.hh>
 #include <nix/installables.hh>
 
+#include <glib/gstdio.h>
 #include <pwd.h>
+#include <mutex>
 #include <regex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "nix-lib-plus.hh"
 
+#define NIX_ATTR_INDEX_DIR	"/var/cache/PackageKit/nix/"
+#define NIX_ATTR_INDEX_VERSION	"2"
+
+/* one package of the default flake, as listed by search and resolve */
+struct NixAttrEntry {
+	std::string attrPath;
+	std::string name;
+	std::string version;
+	std::string system;
+	std::string description;
+	bool supported;
+};
+
+/* the versions of the installed profile elements by name, an empty one
+ * stands for all versions as with nix::DrvName::matches */
+typedef std::unordered_map<std::string, std::unordered_set<std::string>> NixInstalledNames;
+
+/* all packages of one revision of the default flake, evaluated once and
+ * kept in memory and in NIX_ATTR_INDEX_DIR */
+struct NixAttrIndex {
+	std::string key;
+	std::vector<NixAttrEntry> entries;
+	std::vector<std::string> foldedNames;
+	std::vector<std::string> foldedAttrPaths;
+	std::vector<std::string> foldedDescriptions;
+	std::unordered_multimap<std::string, size_t> byName;
+};
+
 typedef struct {
 	nix::ref<nix::EvalState> state;
 	std::string defaultFlake;
+	std::shared_ptr<NixAttrIndex> attrIndex;
+	std::mutex attrIndexLock;
 } PkBackendNixPrivate;
 static PkBackendNixPrivate* priv;
 
 void
 pk_backend_initialize (GKeyFile* conf, PkBackend* backend)
 {
-	priv = g_new0 (PkBackendNixPrivate, 1);
-
 	nix::loadConfFile ();
 	nix::initGC ();
 
@@ -60,16 +93,17 @@ pk_backend_initialize (GKeyFile* conf, PkBackend* backend)
 	nix::evalSettings.pureEval = true;
 
 	const nix::Strings searchPath;
-	priv->state = nix::ref<nix::EvalState> (std::make_shared<nix::EvalState>(searchPath, nix::openStore ()));
+	auto state = nix::ref<nix::EvalState> (std::make_shared<nix::EvalState>(searchPath, nix::openStore ()));
 
-	// this might be useful as a configuration setting in the future
-	priv->defaultFlake = "nixpkgs";
+	// the default flake might be useful as a configuration setting in the future
+	priv = new PkBackendNixPrivate { state, "nixpkgs" };
 }
 
 void
 pk_backend_destroy (PkBackend* backend)
 {
-	g_free (priv);
+	delete priv;
+	priv = NULL;
 }
 
 gboolean
@@ -134,17 +168,27 @@ pk_backend_get_mime_types (PkBackend* backend)
 	return g_strdupv ((gchar **) mime_types);
 }
 
-static nix::OrSuggestions<nix::ref<nix::eval_cache::AttrCursor>>
-nix_get_attr_or_suggestions (nix::EvalState & state, std::string flake, std::string attrPath)
+static std::shared_ptr<nix::flake::LockedFlake>
+nix_lock_flake (nix::EvalState & state, std::string flake)
 {
 	nix::flake::LockFlags lockFlags;
-	auto lockedFlake = std::make_shared<nix::flake::LockedFlake> (nix::flake::lockFlake (state, nix::parseFlakeRef(flake), lockFlags));
+	return std::make_shared<nix::flake::LockedFlake> (nix::flake::lockFlake (state, nix::parseFlakeRef(flake), lockFlags));
+}
 
+static nix::OrSuggestions<nix::ref<nix::eval_cache::AttrCursor>>
+nix_get_attr_or_suggestions (nix::EvalState & state, std::shared_ptr<nix::flake::LockedFlake> lockedFlake, std::string attrPath)
+{
 	auto evalCache = nix::openEvalCache (state, lockedFlake);
 
 	return evalCache->getRoot()->findAlongAttrPath (nix::parseAttrPath (state, attrPath));
 }
 
+static nix::OrSuggestions<nix::ref<nix::eval_cache::AttrCursor>>
+nix_get_attr_or_suggestions (nix::EvalState & state, std::string flake, std::string attrPath)
+{
+	return nix_get_attr_or_suggestions (state, nix_lock_flake (state, flake), attrPath);
+}
+
 static void
 pk_backend_get_details_thread (PkBackendJob* job, GVariant* params, gpointer p)
 {
@@ -225,64 +269,109 @@ nix_get_user_profile (PkBackendJob* job)
 	return std::string(uid_ent->pw_dir) + "/.nix-profile";
 }
 
-static void
-nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
+static std::string
+nix_fold (const std::string & s)
 {
-	const gchar **search;
-	PkBitfield filters;
-
-	PkRoleEnum role = pk_backend_job_get_role (job);
+	g_autofree gchar* folded = g_ascii_strdown (s.c_str (), -1);
+	return folded;
+}
 
-	switch(role) {
-	case PK_ROLE_ENUM_GET_PACKAGES:
-		g_variant_get (params, "(t)", &filters);
-		break;
-	case PK_ROLE_ENUM_SEARCH_NAME:
-	case PK_ROLE_ENUM_SEARCH_DETAILS:
-	case PK_ROLE_ENUM_RESOLVE:
-		g_variant_get (params, "(t^a&s)", &filters, &search);
-		break;
-	default:
-		break;
+static void
+nix_attr_index_finish (NixAttrIndex & index)
+{
+	index.foldedNames.reserve (index.entries.size ());
+	index.foldedAttrPaths.reserve (index.entries.size ());
+	index.foldedDescriptions.reserve (index.entries.size ());
+
+	for (size_t i = 0; i < index.entries.size (); i++) {
+		auto & entry = index.entries[i];
+		index.foldedNames.push_back (nix_fold (entry.name));
+		index.foldedAttrPaths.push_back (nix_fold (entry.attrPath));
+		index.foldedDescriptions.push_back (nix_fold (entry.description));
+		index.byName.emplace (entry.attrPath, i);
+		if (entry.name != entry.attrPath)
+			index.byName.emplace (entry.name, i);
 	}
+}
 
-	std::string attrPath = "legacyPackages." + nix::settings.thisSystem.get () + ".";
-	auto attrOrSuggestions = nix_get_attr_or_suggestions (*priv->state, priv->defaultFlake, attrPath);
-	auto cursor = *attrOrSuggestions;
+static std::shared_ptr<NixAttrIndex>
+nix_attr_index_load (const std::string & key)
+{
+	std::string filename = NIX_ATTR_INDEX_DIR + key + ".attrs";
+	g_autofree gchar* contents = NULL;
+	gsize length;
+
+	if (!g_file_get_contents (filename.c_str (), &contents, &length, NULL))
+		return nullptr;
+
+	auto index = std::make_shared<NixAttrIndex> ();
+	index->key = key;
+
+	std::istringstream stream (std::string (contents, length));
+	std::string line;
+	if (!std::getline (stream, line) || line != NIX_ATTR_INDEX_VERSION)
+		return nullptr;
+
+	while (std::getline (stream, line)) {
+		std::vector<std::string> fields;
+		size_t pos = 0, tab;
+		while ((tab = line.find ('\t', pos)) != std::string::npos) {
+			fields.push_back (line.substr (pos, tab - pos));
+			pos = tab + 1;
+		}
+		fields.push_back (line.substr (pos));
 
-	if (pk_backend_job_is_cancelled (job))
-		return;
+		if (fields.size () != 6) {
+			g_warning ("ignoring corrupt attribute cache %s", filename.c_str ());
+			return nullptr;
+		}
 
-	std::vector<std::regex> regexes;
-	if (search)
-		for (; *search != NULL; search++)
-			regexes.push_back (std::regex (*search, std::regex::extended | std::regex::icase));
+		index->entries.push_back ({fields[0], fields[1], fields[2], fields[3],
+					   fields[4], fields[5] == "1"});
+	}
 
-	nix::DrvInfos installedDrvs;
+	nix_attr_index_finish (*index);
+	return index;
+}
 
-	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_INSTALLED)
-		|| pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
-		std::optional<nix::PathSet> oldAllowedPaths = priv->state->allowedPaths;
-		priv->state->allowedPaths = std::nullopt;
-
-		std::string userProfile = nix_get_user_profile (job);
-		if (nix::pathExists (userProfile + "/manifest.nix")) {
-			nix::Value v;
-			priv->state->evalFile (userProfile + "/manifest.nix", v);
-			nix::Bindings & bindings (*priv->state->allocBindings(0));
-			nix::getDerivations (*priv->state, v, "", bindings, installedDrvs, false);
-		}
+static void
+nix_attr_index_save (const NixAttrIndex & index)
+{
+	std::string filename = NIX_ATTR_INDEX_DIR + index.key + ".attrs";
+	g_autoptr(GError) error = NULL;
+	std::string contents = NIX_ATTR_INDEX_VERSION "\n";
+
+	for (auto & entry : index.entries) {
+		contents += entry.attrPath + "\t" + entry.name + "\t" + entry.version + "\t"
+			+ entry.system + "\t" + entry.description + "\t"
+			+ (entry.supported ? "1" : "0") + "\n";
+	}
 
-		std::string defaultProfile = nix::settings.nixStateDir + "/profiles/default";
-		if (nix::pathExists (defaultProfile + "/manifest.nix")) {
-			nix::Value v;
-			priv->state->evalFile (defaultProfile + "/manifest.nix", v);
-			nix::Bindings & bindings (*priv->state->allocBindings(0));
-			nix::getDerivations (*priv->state, v, "", bindings, installedDrvs, false);
-		}
+	if (g_mkdir_with_parents (NIX_ATTR_INDEX_DIR, 0755) < 0
+		|| !g_file_set_contents (filename.c_str (), contents.c_str (), contents.size (), &error)) {
+		g_warning ("failed to write attribute cache %s: %s", filename.c_str (),
+			   error ? error->message : g_strerror (errno));
+		return;
+	}
 
-		priv->state->allowedPaths = oldAllowedPaths;
+	/* caches of older revisions are never used again */
+	g_autoptr(GDir) dir = g_dir_open (NIX_ATTR_INDEX_DIR, 0, NULL);
+	const gchar* name;
+	while (dir && (name = g_dir_read_name (dir)) != NULL) {
+		if (g_str_has_suffix (name, ".attrs") && index.key + ".attrs" != name)
+			g_unlink ((NIX_ATTR_INDEX_DIR + std::string (name)).c_str ());
 	}
+}
+
+static std::shared_ptr<NixAttrIndex>
+nix_attr_index_build (PkBackendJob* job, std::shared_ptr<nix::flake::LockedFlake> lockedFlake, const std::string & key)
+{
+	std::string attrPath = "legacyPackages." + nix::settings.thisSystem.get () + ".";
+	auto attrOrSuggestions = nix_get_attr_or_suggestions (*priv->state, lockedFlake, attrPath);
+	auto cursor = *attrOrSuggestions;
+
+	auto index = std::make_shared<NixAttrIndex> ();
+	index->key = key;
 
 	int totalDrvs = 0;
 	int foundDrvs = 0;
@@ -290,8 +379,8 @@ nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
 	std::function<void(nix::eval_cache::AttrCursor & cursor, const std::vector<nix::Symbol> & attrPath)> visit;
 	visit = [&](nix::eval_cache::AttrCursor & cursor, const std::vector<nix::Symbol> & attrPath) {
 		try {
-		     if (pk_backend_job_is_cancelled (job))
-			     return;
+			if (pk_backend_job_is_cancelled (job))
+				return;
 
 			auto recurse = [&] () {
 				auto attrs = cursor.getAttrs ();
@@ -311,8 +400,6 @@ nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
 			if (cursor.isDerivation ()) {
 				foundDrvs++;
 
-				size_t found = 0;
-
 				nix::DrvName name (cursor.getAttr ("name")->getString());
 
 				auto aMeta = cursor.maybeGetAttr ("meta");
@@ -320,75 +407,19 @@ nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
 
 				auto description = aDescription ? aDescription->getString() : "";
 				std::replace (description.begin (), description.end (), '\n', ' ');
-
-				auto attrPath2 = concatStringsSep (".", priv->state->symbols.resolve(attrPath));
-
-				for (auto & regex : regexes) {
-					switch (role) {
-					case PK_ROLE_ENUM_SEARCH_NAME:
-					case PK_ROLE_ENUM_RESOLVE: {
-						std::smatch nameMatch;
-						std::regex_search (name.name, nameMatch, regex);
-						std::smatch attrMatch;
-						std::regex_search (attrPath2, attrMatch, regex);
-						if (!nameMatch.empty () || !attrMatch.empty())
-							found++;
-						break;
-					}
-					case PK_ROLE_ENUM_SEARCH_DETAILS: {
-						std::smatch descriptionMatch;
-						std::regex_search (description, descriptionMatch, regex);
-						if (!descriptionMatch.empty ())
-							found++;
-						break;
-					}
-					default:
-						found++;
-						break;
-					}
-				}
-
-				if (found == regexes.size () || regexes.empty ()) {
-					bool isInstalled = false;
-					for (auto drv : installedDrvs) {
-						if (nix::DrvName (drv.queryName ()).matches(name)) {
-							isInstalled = true;
-							break;
-						}
-					}
-
-					if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_INSTALLED) && isInstalled)
-						return;
-					if (pk_bitfield_contain (filters, PK_FILTER_ENUM_INSTALLED) && !isInstalled)
-						return;
-
-					auto available = aMeta ? aMeta->maybeGetAttr ("available") : NULL;
-					bool isSupported = available ? available->getBool () : true;
-
-					if (pk_bitfield_contain (filters, PK_FILTER_ENUM_SUPPORTED) && !isSupported)
-						return;
-					if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_SUPPORTED) && isSupported)
-						return;
-
-					std::string system = cursor.getAttr ("system")->getString();
-
-					PkInfoEnum info = PK_INFO_ENUM_UNKNOWN;
-					if (isSupported)
-						info = PK_INFO_ENUM_AVAILABLE;
-					if (isInstalled)
-						info = PK_INFO_ENUM_INSTALLED;
-
-					if (totalDrvs > 0)
-						pk_backend_job_set_percentage (job, 100 * foundDrvs / totalDrvs);
-
-					pk_backend_job_package (job,
-								info,
-								pk_package_id_build (attrPath2.c_str (),
-										     name.version.c_str (),
-										     system.c_str (),
-										     priv->defaultFlake.c_str ()),
-								description.c_str());
-				}
+				std::replace (description.begin (), description.end (), '\t', ' ');
+
+				auto available = aMeta ? aMeta->maybeGetAttr ("available") : NULL;
+				bool isSupported = available ? available->getBool () : true;
+
+				index->entries.push_back ({
+					concatStringsSep (".", priv->state->symbols.resolve(attrPath)),
+					name.name,
+					name.version,
+					cursor.getAttr ("system")->getString(),
+					description,
+					isSupported,
+				});
 			}
 
 			else if (attrPath.size() == 0)
@@ -401,8 +432,218 @@ nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
 			}
 		} catch (nix::EvalError & e) {
 		}
-        };
+	};
 	visit(*cursor, {});
+
+	if (pk_backend_job_is_cancelled (job))
+		return nullptr;
+
+	nix_attr_index_finish (*index);
+	return index;
+}
+
+/* the index of the current revision of the default flake, evaluating it
+ * only if it isn't cached yet */
+static std::shared_ptr<NixAttrIndex>
+nix_get_attr_index (PkBackendJob* job)
+{
+	auto lockedFlake = nix_lock_flake (*priv->state, priv->defaultFlake);
+	std::string key = lockedFlake->getFingerprint ().to_string (nix::Base16, false)
+		+ "-" + nix::settings.thisSystem.get ();
+
+	std::lock_guard<std::mutex> lock (priv->attrIndexLock);
+	if (priv->attrIndex && priv->attrIndex->key == key)
+		return priv->attrIndex;
+
+	auto index = nix_attr_index_load (key);
+	if (!index) {
+		pk_backend_job_set_status (job, PK_STATUS_ENUM_LOADING_CACHE);
+		index = nix_attr_index_build (job, lockedFlake, key);
+		if (!index)
+			return nullptr;
+		nix_attr_index_save (*index);
+	}
+
+	priv->attrIndex = index;
+	return index;
+}
+
+/* a package counts as installed if a profile element has its name and
+ * version; their output paths would need every package to be
+ * instantiated while building the index */
+static NixInstalledNames
+nix_get_installed_names (PkBackendJob* job)
+{
+	NixInstalledNames installedNames;
+	nix::DrvInfos installedDrvs;
+
+	std::optional<nix::PathSet> oldAllowedPaths = priv->state->allowedPaths;
+	priv->state->allowedPaths = std::nullopt;
+
+	std::string userProfile = nix_get_user_profile (job);
+	if (nix::pathExists (userProfile + "/manifest.nix")) {
+		nix::Value v;
+		priv->state->evalFile (userProfile + "/manifest.nix", v);
+		nix::Bindings & bindings (*priv->state->allocBindings(0));
+		nix::getDerivations (*priv->state, v, "", bindings, installedDrvs, false);
+	}
+
+	std::string defaultProfile = nix::settings.nixStateDir + "/profiles/default";
+	if (nix::pathExists (defaultProfile + "/manifest.nix")) {
+		nix::Value v;
+		priv->state->evalFile (defaultProfile + "/manifest.nix", v);
+		nix::Bindings & bindings (*priv->state->allocBindings(0));
+		nix::getDerivations (*priv->state, v, "", bindings, installedDrvs, false);
+	}
+
+	priv->state->allowedPaths = oldAllowedPaths;
+
+	for (auto & drv : installedDrvs) {
+		nix::DrvName name (drv.queryName ());
+		installedNames[name.name].insert (name.version);
+	}
+
+	return installedNames;
+}
+
+/* a search term is a POSIX regular expression, but most are plain words
+ * that a substring search finds much faster */
+struct NixAttrMatcher {
+	std::string folded;
+	std::optional<std::regex> regex;
+};
+
+static bool
+nix_attr_matches (const NixAttrMatcher & matcher, const std::string & value, const std::string & folded)
+{
+	if (matcher.regex)
+		return std::regex_search (value, *matcher.regex);
+	return folded.find (matcher.folded) != std::string::npos;
+}
+
+static void
+nix_emit_attr (PkBackendJob* job, PkBitfield filters, const NixAttrEntry & entry,
+	       const NixInstalledNames & installedNames)
+{
+	auto installed = installedNames.find (entry.name);
+	bool isInstalled = installed != installedNames.end ()
+		&& (installed->second.count (entry.version) > 0 || installed->second.count ("") > 0);
+
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_INSTALLED) && isInstalled)
+		return;
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_INSTALLED) && !isInstalled)
+		return;
+
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_SUPPORTED) && !entry.supported)
+		return;
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_SUPPORTED) && entry.supported)
+		return;
+
+	PkInfoEnum info = PK_INFO_ENUM_UNKNOWN;
+	if (entry.supported)
+		info = PK_INFO_ENUM_AVAILABLE;
+	if (isInstalled)
+		info = PK_INFO_ENUM_INSTALLED;
+
+	g_autofree gchar* package_id = pk_package_id_build (entry.attrPath.c_str (),
+							    entry.version.c_str (),
+							    entry.system.c_str (),
+							    priv->defaultFlake.c_str ());
+	pk_backend_job_package (job, info, package_id, entry.description.c_str ());
+}
+
+static void
+nix_search_thread (PkBackendJob* job, GVariant* params, gpointer p)
+{
+	const gchar **search = NULL;
+	PkBitfield filters = 0;
+
+	PkRoleEnum role = pk_backend_job_get_role (job);
+
+	switch(role) {
+	case PK_ROLE_ENUM_GET_PACKAGES:
+		g_variant_get (params, "(t)", &filters);
+		break;
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_RESOLVE:
+		g_variant_get (params, "(t^a&s)", &filters, &search);
+		break;
+	default:
+		break;
+	}
+
+	std::shared_ptr<NixAttrIndex> index;
+	NixInstalledNames installedNames;
+	try {
+		index = nix_get_attr_index (job);
+		installedNames = nix_get_installed_names (job);
+	} catch (nix::Error & e) {
+		pk_backend_job_error_code (job,
+					   PK_ERROR_ENUM_UNKNOWN,
+					   "failed to evaluate %s: %s",
+					   priv->defaultFlake.c_str (), e.what ());
+		return;
+	}
+
+	if (!index || pk_backend_job_is_cancelled (job))
+		return;
+
+	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
+
+	/* resolve looks up exact attribute paths and names */
+	if (role == PK_ROLE_ENUM_RESOLVE) {
+		std::unordered_set<size_t> seen;
+		for (; search && *search != NULL; search++) {
+			auto range = index->byName.equal_range (*search);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (seen.insert (it->second).second)
+					nix_emit_attr (job, filters, index->entries[it->second], installedNames);
+			}
+		}
+		pk_backend_job_set_percentage (job, 100);
+		return;
+	}
+
+	std::vector<NixAttrMatcher> matchers;
+	for (; search && *search != NULL; search++) {
+		NixAttrMatcher matcher;
+		matcher.folded = nix_fold (*search);
+		if (strpbrk (*search, "^$.[]()|*+?{}\\") != NULL)
+			matcher.regex = std::regex (*search, std::regex::extended | std::regex::icase);
+		matchers.push_back (matcher);
+	}
+
+	for (size_t i = 0; i < index->entries.size (); i++) {
+		auto & entry = index->entries[i];
+		bool found = true;
+
+		if (i % 1000 == 0) {
+			if (pk_backend_job_is_cancelled (job))
+				return;
+			pk_backend_job_set_percentage (job, 100 * i / index->entries.size ());
+		}
+
+		for (auto & matcher : matchers) {
+			switch (role) {
+			case PK_ROLE_ENUM_SEARCH_NAME:
+				found = nix_attr_matches (matcher, entry.name, index->foldedNames[i])
+					|| nix_attr_matches (matcher, entry.attrPath, index->foldedAttrPaths[i]);
+				break;
+			case PK_ROLE_ENUM_SEARCH_DETAILS:
+				found = nix_attr_matches (matcher, entry.description, index->foldedDescriptions[i]);
+				break;
+			default:
+				break;
+			}
+			if (!found)
+				break;
+		}
+
+		if (found)
+			nix_emit_attr (job, filters, entry, installedNames);
+	}
+
 	pk_backend_job_set_percentage (job, 100);
 }
 
@@ -436,8 +677,16 @@ pk_backend_resolve(PkBackend* self, PkBackendJob* job, PkBitfield filters, gchar
 static void
 nix_refresh_thread (PkBackendJob* job, GVariant* params, gpointer p)
 {
+	/* fetch the latest revision and index it if it is new */
 	nix::settings.tarballTtl = 0;
-	nix_search_thread (job, params, p);
+	try {
+		nix_get_attr_index (job);
+	} catch (nix::Error & e) {
+		pk_backend_job_error_code (job,
+					   PK_ERROR_ENUM_UNKNOWN,
+					   "failed to evaluate %s: %s",
+					   priv->defaultFlake.c_str (), e.what ());
+	}
 	nix::settings.tarballTtl = 60 * 60;
 
 	pk_backend_job_set_percentage (job, 100);
@@ -450,6 +699,42 @@ pk_backend_refresh_cache (PkBackend* backend, PkBackendJob* job, gboolean force)
 	pk_backend_job_thread_create (job, nix_refresh_thread, NULL, NULL);
 }
 
+/* the elements of a profile generation, indexed by package name */
+struct NixProfileIndex {
+	std::string lockToken;
+	nix::DrvInfos elems;
+	std::unordered_map<std::string, std::vector<size_t>> byName;
+};
+
+static void
+nix_profile_index_load (NixProfileIndex & index, nix::EvalState & state, const nix::Path & profile)
+{
+	index.lockToken = nix::optimisticLockProfile (profile);
+	index.elems = nix::queryInstalled (state, profile);
+	index.byName.clear ();
+
+	size_t n = 0;
+	for (auto & elem : index.elems)
+		index.byName[nix::DrvName (elem.queryName ()).name].push_back (n++);
+}
+
+/* marks the profile elements with the same name as one of @elems */
+static std::vector<bool>
+nix_profile_index_match (const NixProfileIndex & index, nix::DrvInfos & elems)
+{
+	std::vector<bool> matched (index.elems.size (), false);
+
+	for (auto & elem : elems) {
+		auto it = index.byName.find (nix::DrvName (elem.queryName ()).name);
+		if (it == index.byName.end ())
+			continue;
+		for (auto n : it->second)
+			matched[n] = true;
+	}
+
+	return matched;
+}
+
 static void
 nix_install_thread (PkBackendJob* job, GVariant* params, gpointer p)
 {
@@ -517,21 +802,17 @@ nix_install_thread (PkBackendJob* job, GVariant* params, gpointer p)
 	std::optional<nix::PathSet> oldAllowedPaths = priv->state->allowedPaths;
 	priv->state->allowedPaths = std::nullopt;
 
+	/* the profile is only read again if it changes while we are busy */
+	NixProfileIndex profileIndex;
+
 	while (true) {
 		if (pk_backend_job_is_cancelled (job)) {
 			priv->state->allowedPaths = oldAllowedPaths;
 			return;
 		}
 
-		std::string lockToken = nix::optimisticLockProfile (profile);
-
-		nix::DrvInfos allElems (newElems);
-
-		/* Add in the already installed derivations, unless they have
-		   the same name as a to-be-installed element. */
-		nix::DrvInfos installedElems;
 		try {
-			installedElems = nix::queryInstalled (*priv->state, profile);
+			nix_profile_index_load (profileIndex, *priv->state, profile);
 		} catch (nix::Error & e) {
 			priv->state->allowedPaths = oldAllowedPaths;
 			pk_backend_job_error_code (job,
@@ -540,22 +821,19 @@ nix_install_thread (PkBackendJob* job, GVariant* params, gpointer p)
 			return;
 		}
 
-		for (auto & i : installedElems) {
-			bool found = false;
-
-			for (auto & j : newElems) {
-				if (nix::DrvName(i.queryName ()).name == nix::DrvName (j.queryName ()).name) {
-					found = true;
-					break;
-				}
-			}
+		nix::DrvInfos allElems (newElems);
 
-			if (!found)
+		/* Add in the already installed derivations, unless they have
+		   the same name as a to-be-installed element. */
+		auto replaced = nix_profile_index_match (profileIndex, newElems);
+		size_t n = 0;
+		for (auto & i : profileIndex.elems) {
+			if (!replaced[n++])
 				allElems.push_back (i);
 		}
 
 		try {
-			if (nix::createUserEnv (*priv->state, allElems, profile, false, lockToken))
+			if (nix::createUserEnv (*priv->state, allElems, profile, false, profileIndex.lockToken))
 				break;
 		} catch (nix::Error & e) {
 			priv->state->allowedPaths = oldAllowedPaths;
@@ -632,34 +910,36 @@ nix_remove_thread (PkBackendJob* job, GVariant* params, gpointer p)
 	std::optional<nix::PathSet> oldAllowedPaths = priv->state->allowedPaths;
 	priv->state->allowedPaths = std::nullopt;
 
+	/* the profile is only read again if it changes while we are busy */
+	NixProfileIndex profileIndex;
+
 	while (true) {
 		if (pk_backend_job_is_cancelled (job)) {
 			priv->state->allowedPaths = oldAllowedPaths;
 			return;
 		}
 
-		std::string lockToken = nix::optimisticLockProfile (profile);
-
-		nix::DrvInfos installedElems = nix::queryInstalled (*priv->state, profile);
-		nix::DrvInfos newElems;
-
-		for (auto & i : installedElems) {
-			bool found = false;
-
-
-			for (auto & j : elemsToDelete) {
-				if (nix::DrvName (i.queryName ()).name == nix::DrvName (j.queryName ()).name) {
-					found = true;
-					break;
-				}
+		/* all packages are removed in one new generation */
+		try {
+			nix_profile_index_load (profileIndex, *priv->state, profile);
+
+			auto removed = nix_profile_index_match (profileIndex, elemsToDelete);
+			nix::DrvInfos newElems;
+			size_t n = 0;
+			for (auto & i : profileIndex.elems) {
+				if (!removed[n++])
+					newElems.push_back (i);
 			}
 
-			if (!found)
-				newElems.push_back (i);
+			if (nix::createUserEnv (*priv->state, newElems, profile, false, profileIndex.lockToken))
+				break;
+		} catch (nix::Error & e) {
+			priv->state->allowedPaths = oldAllowedPaths;
+			pk_backend_job_error_code (job,
+						   PK_ERROR_ENUM_UNKNOWN,
+						   "failed to create new environment: %s", e.what ());
+			return;
 		}
-
-		if (nix::createUserEnv (*priv->state, newElems, profile, false, lockToken))
-			break;
 	}
 
 	priv->state->allowedPaths = oldAllowedPaths;
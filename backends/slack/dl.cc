@@ -58,16 +58,16 @@ Dl::collect_cache_info (const gchar *tmpl) noexcept
  * @job: A #PkBackendJob.
  * @tmpl: temporary directory for downloading the files.
  *
- * Download files needed to get the information like the list of packages
- * in available repositories, updates, package descriptions and so on.
+ * Updates the cache of this repository from the downloaded index file.
+ * Has to be called inside a transaction.
  *
- * Returns: List of files needed for building the cache.
+ * Returns: %TRUE on success, %FALSE otherwise.
  **/
-void
+gboolean
 Dl::generate_cache(PkBackendJob *job, const gchar *tmpl) noexcept
 {
 	gchar **line_tokens, **pkg_tokens, *line, *collection_name = NULL, *list_filename;
-	gboolean skip = FALSE;
+	gboolean skip = FALSE, ret = FALSE;
 	GFile *list_file;
 	GFileInputStream *fin;
 	GDataInputStream *data_in = NULL;
@@ -86,35 +86,14 @@ Dl::generate_cache(PkBackendJob *job, const gchar *tmpl) noexcept
 	}
 	data_in = g_data_input_stream_new(G_INPUT_STREAM(fin));
 
-	/* Remove the old entries from this repository */
-	if (sqlite3_prepare_v2(job_data->db,
-						   "DELETE FROM repos WHERE repo LIKE @repo",
-						   -1,
-						   &stmt,
-						   NULL) == SQLITE_OK) {
-		sqlite3_bind_text(stmt, 1, this->get_name (), -1, SQLITE_TRANSIENT);
-		sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
-	}
-	if (sqlite3_prepare_v2(job_data->db,
-	                       "INSERT INTO repos (repo_order, repo) VALUES (@repo_order, @repo)",
-	                       -1,
-	                       &stmt,
-	                       NULL) != SQLITE_OK)
-	{
-		goto out;
-	}
-	sqlite3_bind_int(stmt, 1, this->get_order ());
-	sqlite3_bind_text(stmt, 2, this->get_name (), -1, SQLITE_TRANSIENT);
-	sqlite3_step(stmt);
-	if (sqlite3_finalize(stmt) != SQLITE_OK)
+	if (!this->stage_cache (job_data->db))
 	{
 		goto out;
 	}
 
-	/* Insert new records */
+	/* Collect the packages in the staging table */
 	if ((sqlite3_prepare_v2(job_data->db,
-	                        "INSERT INTO pkglist (full_name, name, ver, arch, "
+	                        "INSERT INTO temp.pkglist_new (full_name, name, ver, arch, "
 	                        "summary, desc, compressed, uncompressed, cat, repo_order, ext) "
 	                        "VALUES (@full_name, @name, @ver, @arch, @summary, "
 	                        "@desc, @compressed, @uncompressed, @cat, @repo_order, @ext)",
@@ -124,7 +103,6 @@ Dl::generate_cache(PkBackendJob *job, const gchar *tmpl) noexcept
 	{
 		goto out;
 	}
-	sqlite3_exec(job_data->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
 	while ((line = g_data_input_stream_read_line(data_in, NULL, NULL, NULL)))
 	{
@@ -184,11 +162,12 @@ Dl::generate_cache(PkBackendJob *job, const gchar *tmpl) noexcept
 		g_strfreev(line_tokens);
 		g_free(line);
 	}
+	sqlite3_finalize(stmt);
 
 	/* Create a collection entry */
 	if (collection_name && g_seekable_seek(G_SEEKABLE(data_in), 0, G_SEEK_SET, NULL, NULL)
 	 && (sqlite3_prepare_v2(job_data->db,
-	                        "INSERT INTO collections (name, repo_order, collection_pkg) "
+	                        "INSERT INTO temp.collections_new (name, repo_order, collection_pkg) "
 	                        "VALUES (@name, @repo_order, @collection_pkg)",
 	                        -1,
 	                        &stmt,
@@ -221,7 +200,7 @@ Dl::generate_cache(PkBackendJob *job, const gchar *tmpl) noexcept
 	}
 	g_free(collection_name);
 
-	sqlite3_exec(job_data->db, "END TRANSACTION", NULL, NULL, NULL);
+	ret = this->apply_cache (job_data->db);
 
 out:
 	if (data_in)
@@ -234,6 +213,8 @@ out:
 	}
 	g_object_unref(list_file);
 	g_free(list_filename);
+
+	return ret;
 }
 
 Dl::~Dl () noexcept
@@ -0,0 +1,327 @@
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include "fetch.h"
+
+namespace slack {
+
+/*
+ * Feeds the content of an existing file into the checksum, so a resumed
+ * transfer can be verified as a whole.
+ */
+static gboolean
+checksum_file (GChecksum *checksum, const gchar *path)
+{
+	guchar buf[8192];
+	gsize read_len;
+	FILE *fin = fopen(path, "rb");
+
+	if (!fin)
+	{
+		return FALSE;
+	}
+	while ((read_len = fread(buf, 1, sizeof(buf), fin)))
+	{
+		g_checksum_update(checksum, buf, read_len);
+	}
+	fclose(fin);
+
+	return TRUE;
+}
+
+/**
+ * slack::Fetcher::Fetcher:
+ *
+ * Constructor.
+ *
+ * Returns: New #slack::Fetcher.
+ **/
+Fetcher::Fetcher () noexcept
+{
+	if ((this->multi = curl_multi_init ()))
+	{
+		curl_multi_setopt (this->multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_host_connections);
+		curl_multi_setopt (this->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_total_connections);
+	}
+}
+
+Fetcher::~Fetcher () noexcept
+{
+	for (auto &transfer : this->transfers)
+	{
+		if (transfer.curl)
+		{
+			curl_multi_remove_handle (this->multi, transfer.curl);
+			curl_easy_cleanup (transfer.curl);
+		}
+		if (transfer.fout)
+		{
+			fclose (transfer.fout);
+		}
+		if (transfer.checksum)
+		{
+			g_checksum_free (transfer.checksum);
+		}
+		g_free (transfer.source_url);
+		g_free (transfer.dest);
+		g_free (transfer.part);
+		g_free (transfer.md5);
+	}
+	if (this->multi)
+	{
+		curl_multi_cleanup (this->multi);
+	}
+}
+
+/**
+ * slack::Fetcher::add:
+ * @source_url: Source URL.
+ * @dest: Destination file or directory.
+ * @md5: Expected MD5 checksum or %NULL.
+ *
+ * Queues a file for download. If @dest is a directory, the file is saved
+ * in it under the name from the @source_url.
+ *
+ * Returns: Transfer ID to query the result with.
+ **/
+guint
+Fetcher::add (const gchar *source_url, const gchar *dest,
+		const gchar *md5) noexcept
+{
+	Transfer transfer = {};
+
+	transfer.source_url = g_strdup (source_url);
+	if (g_file_test (dest, G_FILE_TEST_IS_DIR))
+	{
+		gchar *basename = g_path_get_basename (source_url);
+
+		transfer.dest = g_build_filename (dest, basename, NULL);
+		g_free (basename);
+	}
+	else
+	{
+		transfer.dest = g_strdup (dest);
+	}
+	transfer.part = g_strconcat (transfer.dest, ".part", NULL);
+	if (md5 && *md5)
+	{
+		transfer.md5 = g_ascii_strdown (md5, -1);
+	}
+	transfer.result = CURLE_FAILED_INIT;
+
+	this->transfers.push_back (transfer);
+
+	return this->transfers.size () - 1;
+}
+
+/**
+ * slack::Fetcher::run:
+ *
+ * Downloads all queued files and waits until they are finished.
+ *
+ * Returns: %TRUE if all files were downloaded, %FALSE otherwise.
+ **/
+gboolean
+Fetcher::run () noexcept
+{
+	gint running = 0, queued;
+	gboolean ret = TRUE;
+	CURLMcode mc = CURLM_OK;
+	CURLMsg *msg;
+
+	for (auto &transfer : this->transfers)
+	{
+		if (transfer.result == CURLE_FAILED_INIT)
+		{
+			this->start (transfer);
+		}
+	}
+
+	do
+	{
+		mc = curl_multi_perform (this->multi, &running);
+		if ((mc == CURLM_OK) && running)
+		{
+			mc = curl_multi_wait (this->multi, NULL, 0, 1000, NULL);
+		}
+
+		while ((msg = curl_multi_info_read (this->multi, &queued)))
+		{
+			if (msg->msg == CURLMSG_DONE)
+			{
+				char *transfer;
+				CURL *curl = msg->easy_handle;
+				CURLcode result = msg->data.result;
+
+				curl_easy_getinfo (curl, CURLINFO_PRIVATE, &transfer);
+				this->finish (*reinterpret_cast<Transfer *> (transfer), result);
+			}
+		}
+	}
+	while ((mc == CURLM_OK) && this->active);
+
+	for (auto &transfer : this->transfers)
+	{
+		if (transfer.curl) /* Interrupted by a multi handle error */
+		{
+			this->finish (transfer, CURLE_FAILED_INIT);
+		}
+		if (transfer.result != CURLE_OK)
+		{
+			ret = FALSE;
+		}
+	}
+	return ret;
+}
+
+/**
+ * slack::Fetcher::get_result:
+ * @id: Transfer ID.
+ *
+ * Returns: CURLE_OK (zero) if the file was downloaded, non-zero otherwise.
+ **/
+CURLcode
+Fetcher::get_result (guint id) const noexcept
+{
+	return this->transfers[id].result;
+}
+
+/**
+ * slack::Fetcher::get_dest:
+ * @id: Transfer ID.
+ *
+ * Returns: Path the file is saved to.
+ **/
+const gchar *
+Fetcher::get_dest (guint id) const noexcept
+{
+	return this->transfers[id].dest;
+}
+
+size_t
+Fetcher::write_cb (char *ptr, size_t size, size_t nmemb, void *userdata) noexcept
+{
+	auto transfer = static_cast<Transfer *> (userdata);
+
+	if (transfer->checksum)
+	{
+		g_checksum_update (transfer->checksum, reinterpret_cast<guchar *> (ptr), size * nmemb);
+	}
+	return fwrite (ptr, size, nmemb, transfer->fout);
+}
+
+gboolean
+Fetcher::start (Transfer &transfer) noexcept
+{
+	GStatBuf st;
+
+	if (!this->multi)
+	{
+		return FALSE;
+	}
+	if (g_stat (transfer.part, &st) == 0)
+	{
+		transfer.resume_from = st.st_size;
+	}
+	if (transfer.md5)
+	{
+		transfer.checksum = g_checksum_new (G_CHECKSUM_MD5);
+		if ((transfer.resume_from > 0) && !checksum_file (transfer.checksum, transfer.part))
+		{
+			transfer.result = CURLE_READ_ERROR;
+			return FALSE;
+		}
+	}
+	if (!(transfer.fout = fopen (transfer.part, "ab")))
+	{
+		transfer.result = CURLE_WRITE_ERROR;
+		return FALSE;
+	}
+	if (!(transfer.curl = curl_easy_init ()))
+	{
+		fclose (transfer.fout);
+		transfer.fout = NULL;
+		return FALSE;
+	}
+
+	curl_easy_setopt (transfer.curl, CURLOPT_URL, transfer.source_url);
+	curl_easy_setopt (transfer.curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt (transfer.curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt (transfer.curl, CURLOPT_WRITEFUNCTION, write_cb);
+	curl_easy_setopt (transfer.curl, CURLOPT_WRITEDATA, &transfer);
+	curl_easy_setopt (transfer.curl, CURLOPT_PRIVATE, &transfer);
+	if (transfer.resume_from > 0)
+	{
+		curl_easy_setopt (transfer.curl, CURLOPT_RESUME_FROM_LARGE, transfer.resume_from);
+	}
+
+	if (curl_multi_add_handle (this->multi, transfer.curl) != CURLM_OK)
+	{
+		curl_easy_cleanup (transfer.curl);
+		transfer.curl = NULL;
+		fclose (transfer.fout);
+		transfer.fout = NULL;
+		return FALSE;
+	}
+	this->active++;
+
+	return TRUE;
+}
+
+void
+Fetcher::finish (Transfer &transfer, CURLcode result) noexcept
+{
+	curl_multi_remove_handle (this->multi, transfer.curl);
+	curl_easy_cleanup (transfer.curl);
+	transfer.curl = NULL;
+	this->active--;
+
+	if (fclose (transfer.fout) && (result == CURLE_OK))
+	{
+		result = CURLE_WRITE_ERROR;
+	}
+	transfer.fout = NULL;
+
+	if ((result == CURLE_RANGE_ERROR) && (transfer.resume_from > 0))
+	{
+		/* The server can't resume the partial file, start over */
+		g_unlink (transfer.part);
+		transfer.resume_from = 0;
+		if (transfer.checksum)
+		{
+			g_checksum_free (transfer.checksum);
+			transfer.checksum = NULL;
+		}
+		if (this->start (transfer))
+		{
+			return;
+		}
+	}
+
+	if ((result == CURLE_OK) && transfer.checksum
+	 && g_strcmp0 (g_checksum_get_string (transfer.checksum), transfer.md5))
+	{
+		/* The caller reports the failed transfer */
+		g_debug ("%s: checksum mismatch", transfer.source_url);
+		g_unlink (transfer.part);
+		result = CURLE_WRITE_ERROR;
+	}
+	else if (result == CURLE_OK)
+	{
+		if (g_rename (transfer.part, transfer.dest))
+		{
+			result = CURLE_WRITE_ERROR;
+		}
+	}
+	else if ((result == CURLE_HTTP_RETURNED_ERROR)
+	      || (result == CURLE_REMOTE_FILE_NOT_FOUND)
+	      || (result == CURLE_FILE_COULDNT_READ_FILE)
+	      || (result == CURLE_RANGE_ERROR)
+	      || (result == CURLE_BAD_DOWNLOAD_RESUME))
+	{
+		/* There is nothing to resume from */
+		g_unlink (transfer.part);
+	}
+	transfer.result = result;
+}
+
+}
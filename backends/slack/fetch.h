@@ -0,0 +1,65 @@
+#ifndef __SLACK_FETCH_H
+#define __SLACK_FETCH_H
+
+#include <curl/curl.h>
+#include <vector>
+#include <glib.h>
+
+namespace slack {
+
+/**
+ * slack::Fetcher:
+ *
+ * Downloads a batch of files concurrently with a curl multi handle.
+ *
+ * Every file is written to "dest.part" first and renamed when the transfer
+ * is complete, so an interrupted download is resumed on the next run. If an
+ * MD5 checksum is given, it is computed while the data arrive and a file
+ * that doesn't match is discarded.
+ **/
+class Fetcher
+{
+public:
+	static const glong max_host_connections = 4;
+	static const glong max_total_connections = 16;
+
+	Fetcher () noexcept;
+	~Fetcher () noexcept;
+
+	Fetcher (const Fetcher &) = delete;
+	Fetcher &operator= (const Fetcher &) = delete;
+
+	guint add (const gchar *source_url, const gchar *dest,
+			const gchar *md5 = NULL) noexcept;
+	gboolean run () noexcept;
+
+	CURLcode get_result (guint id) const noexcept;
+	const gchar *get_dest (guint id) const noexcept;
+
+private:
+	struct Transfer
+	{
+		gchar *source_url;
+		gchar *dest;
+		gchar *part;
+		gchar *md5;
+		FILE *fout;
+		GChecksum *checksum;
+		CURL *curl;
+		curl_off_t resume_from;
+		CURLcode result;
+	};
+
+	CURLM *multi = NULL;
+	guint active = 0;
+	std::vector<Transfer> transfers;
+
+	static size_t write_cb (char *ptr, size_t size, size_t nmemb, void *userdata) noexcept;
+
+	gboolean start (Transfer &transfer) noexcept;
+	void finish (Transfer &transfer, CURLcode result) noexcept;
+};
+
+}
+
+#endif /* __SLACK_FETCH_H */
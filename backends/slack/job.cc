@@ -20,14 +20,158 @@ filter_package (PkBitfield filters, bool is_installed)
 	return false;
 }
 
-static std::string
-generate_query(PkBitfield filters)
+static bool
+has_table (sqlite3 *db, const gchar *name)
+{
+	sqlite3_stmt *stmt;
+	bool ret = false;
+
+	if (sqlite3_prepare_v2 (db,
+			"SELECT name FROM sqlite_master WHERE name = @name",
+			-1, &stmt, NULL) == SQLITE_OK)
+	{
+		sqlite3_bind_text (stmt, 1, name, -1, SQLITE_STATIC);
+		ret = sqlite3_step (stmt) == SQLITE_ROW;
+		sqlite3_finalize (stmt);
+	}
+	return ret;
+}
+
+/**
+ * slack::create_search_index:
+ * @db: Metadata database.
+ *
+ * Creates the tables used to speed up the package search if they don't exist
+ * yet and fills them from the current cache: pkg_winner holds the repository
+ * with the lowest order for every package name, pkg_fts and file_fts are
+ * trigram indexes over the package names, descriptions, groups and file
+ * names. The full-text indexes are skipped if SQLite is built without FTS5.
+ *
+ * Returns: %true if the full-text indexes are available, %false otherwise.
+ **/
+bool
+create_search_index (sqlite3 *db)
+{
+	bool created = false;
+
+	if (!has_table (db, "pkg_winner"))
+	{
+		created = sqlite3_exec (db,
+				"CREATE TABLE pkg_winner (name VARCHAR PRIMARY KEY, "
+				"repo_order INTEGER NOT NULL) WITHOUT ROWID",
+				NULL, NULL, NULL) == SQLITE_OK;
+	}
+	if (!has_table (db, "pkg_fts"))
+	{
+		if (sqlite3_exec (db,
+				"CREATE VIRTUAL TABLE pkg_fts USING fts5(name, desc, cat, "
+				"content='pkglist', tokenize='trigram');"
+				"CREATE VIRTUAL TABLE file_fts USING fts5(filename, "
+				"content='filelist', tokenize='trigram')",
+				NULL, NULL, NULL) == SQLITE_OK)
+		{
+			created = true;
+		}
+		else
+		{
+			g_debug ("Full-text search isn't available: %s", sqlite3_errmsg (db));
+		}
+	}
+	if (created)
+	{
+		rebuild_search_index (db);
+	}
+	return has_search_index (db);
+}
+
+/**
+ * slack::rebuild_search_index:
+ * @db: Metadata database.
+ *
+ * Brings the search tables in line with pkglist and filelist. Has to be
+ * called after the cache was regenerated.
+ **/
+void
+rebuild_search_index (sqlite3 *db)
+{
+	sqlite3_exec (db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+	sqlite3_exec (db,
+			"DELETE FROM pkg_winner;"
+			"INSERT INTO pkg_winner (name, repo_order) "
+			"SELECT name, MIN(repo_order) FROM pkglist GROUP BY name",
+			NULL, NULL, NULL);
+	if (has_search_index (db))
+	{
+		sqlite3_exec (db,
+				"INSERT INTO pkg_fts (pkg_fts) VALUES ('rebuild');"
+				"INSERT INTO file_fts (file_fts) VALUES ('rebuild')",
+				NULL, NULL, NULL);
+	}
+	sqlite3_exec (db, "END TRANSACTION", NULL, NULL, NULL);
+}
+
+/**
+ * slack::has_search_index:
+ * @db: Metadata database.
+ *
+ * Returns: %true if the full-text indexes exist, %false otherwise.
+ **/
+bool
+has_search_index (sqlite3 *db)
+{
+	return has_table (db, "pkg_fts") && has_table (db, "file_fts");
+}
+
+/**
+ * slack::use_search_index:
+ * @db: Metadata database.
+ * @vals: Search terms.
+ *
+ * A trigram index can only narrow down patterns containing at least three
+ * consecutive characters, shorter terms are faster with a plain scan.
+ *
+ * Returns: %true if the search should go through the full-text index.
+ **/
+bool
+use_search_index (sqlite3 *db, gchar **vals)
+{
+	for (gchar **val = vals; *val; val++)
+	{
+		if (g_utf8_strlen (*val, -1) >= 3)
+		{
+			return has_search_index (db);
+		}
+	}
+	return false;
+}
+
+/**
+ * slack::generate_query:
+ * @filters: Search filters.
+ * @indexed: Whether the full-text index should be used.
+ *
+ * Builds the search query. It should be formatted with sqlite3_mprintf()
+ * with the column to search in and the search pattern.
+ *
+ * Returns: Query template.
+ **/
+std::string
+generate_query (PkBitfield filters, bool indexed)
 {
 	std::string query(
 			"SELECT (p1.name || ';' || p1.ver || ';' || p1.arch || ';' || r.repo), p1.summary, "
-			"p1.full_name FROM pkglist AS p1 NATURAL JOIN repos AS r "
-			"WHERE p1.%s LIKE '%%%q%%' AND p1.ext NOT LIKE 'obsolete' AND p1.repo_order = "
-			"(SELECT MIN(p2.repo_order) FROM pkglist AS p2 WHERE p2.name = p1.name GROUP BY p2.name)");
+			"p1.full_name FROM pkglist AS p1 NATURAL JOIN repos AS r NATURAL JOIN pkg_winner AS w ");
+
+	if (indexed)
+	{
+		query.append("WHERE p1.rowid IN "
+				"(SELECT rowid FROM pkg_fts WHERE pkg_fts.%s LIKE '%%%q%%') ");
+	}
+	else
+	{
+		query.append("WHERE p1.%s LIKE '%%%q%%' ");
+	}
+	query.append("AND p1.ext NOT LIKE 'obsolete'");
 
 	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_APPLICATION))
 	{
@@ -48,6 +192,89 @@ generate_query(PkBitfield filters)
 	return query;
 }
 
+/*
+ * Finds the positions of the last three dashes in a full package name
+ * (name-version-arch-build) of the given length.
+ */
+static bool
+find_version_dashes (const gchar *full_name, gint len, gint dashes[3])
+{
+	gint n = 3;
+
+	for (gint i = len - 1; (i > 0) && n; i--)
+	{
+		if (full_name[i] == '-')
+		{
+			dashes[--n] = i;
+		}
+	}
+	return n == 0;
+}
+
+static int
+collate_versions (void *user_data, int a_len, const void *a, int b_len, const void *b)
+{
+	auto a_name = static_cast<const gchar *> (a);
+	auto b_name = static_cast<const gchar *> (b);
+	gint a_dashes[3], b_dashes[3], ret;
+
+	if (!find_version_dashes (a_name, a_len, a_dashes)
+			|| !find_version_dashes (b_name, b_len, b_dashes))
+	{
+		return compare_versions (a_name, a_len, b_name, b_len);
+	}
+
+	/* Compare the versions first and then the build numbers */
+	ret = compare_versions (a_name + a_dashes[0] + 1, a_dashes[1] - a_dashes[0] - 1,
+			b_name + b_dashes[0] + 1, b_dashes[1] - b_dashes[0] - 1);
+	if (ret == 0)
+	{
+		ret = compare_versions (a_name + a_dashes[2] + 1, a_len - a_dashes[2] - 1,
+				b_name + b_dashes[2] + 1, b_len - b_dashes[2] - 1);
+	}
+	return ret;
+}
+
+/**
+ * slack::create_version_collation:
+ * @db: Metadata database.
+ *
+ * Registers the "slackver" collation, which orders full package names
+ * (name-version-arch-build) by their version and build number, see
+ * slack::compare_versions().
+ *
+ * Returns: %true on success, %false otherwise.
+ **/
+bool
+create_version_collation (sqlite3 *db)
+{
+	return sqlite3_create_collation (db, "slackver", SQLITE_UTF8,
+			NULL, collate_versions) == SQLITE_OK;
+}
+
+/**
+ * slack::updates_query:
+ *
+ * Joins the installed packages staged with
+ * slack::InstalledPackages::stage() with the packages from the repository
+ * with the lowest order. A row is returned for every installed package that
+ * has a newer version or is obsolete. Needs the "slackver" collation.
+ *
+ * Returns: Query selecting full_name, name, ver, arch, repo, summary and ext
+ *          of the repository package and name, ver and arch of the installed
+ *          one.
+ **/
+const gchar *
+updates_query ()
+{
+	return "SELECT p1.full_name, p1.name, p1.ver, p1.arch, r.repo, p1.summary, p1.ext, "
+		"i.name, i.ver, i.arch "
+		"FROM pkglist AS p1 NATURAL JOIN repos AS r NATURAL JOIN pkg_winner AS w "
+		"JOIN temp.installed AS i ON i.name = p1.name "
+		"WHERE p1.ext = 'obsolete' OR p1.full_name > i.full_name COLLATE slackver "
+		"ORDER BY p1.name";
+}
+
 }
 
 void
@@ -63,16 +290,19 @@ pk_backend_search_thread (PkBackendJob *job, GVariant *params, gpointer user_dat
 	g_variant_get (params, "(t^a&s)", &filters, &vals);
 	gchar *search = g_strjoinv ("%", vals);
 
-	gchar *query = sqlite3_mprintf (slack::generate_query(filters).c_str(),
+	gchar *query = sqlite3_mprintf (slack::generate_query (filters,
+				slack::use_search_index (job_data->db, vals)).c_str(),
 			user_data, search);
 
 	sqlite3_stmt *stmt;
 	if ((sqlite3_prepare_v2 (job_data->db, query, -1, &stmt, NULL) == SQLITE_OK))
 	{
+		auto installed = slack::InstalledPackages::get ();
+
 		/* Now we're ready to output all packages */
 		while (sqlite3_step (stmt) == SQLITE_ROW)
 		{
-			PkInfoEnum info = slack::is_installed (
+			PkInfoEnum info = installed->lookup (
 					reinterpret_cast<const gchar *> (sqlite3_column_text (stmt, 2)));
 
 			if ((info == PK_INFO_ENUM_INSTALLED || info == PK_INFO_ENUM_UPDATING)
@@ -3,11 +3,22 @@
 
 #include <pk-backend.h>
 #include <sqlite3.h>
+#include <string>
 
 namespace slack {
 
 bool filter_package (PkBitfield filters, bool is_installed);
 
+bool create_search_index (sqlite3 *db);
+void rebuild_search_index (sqlite3 *db);
+bool has_search_index (sqlite3 *db);
+bool use_search_index (sqlite3 *db, gchar **vals);
+
+std::string generate_query (PkBitfield filters, bool indexed);
+
+bool create_version_collation (sqlite3 *db);
+const gchar *updates_query ();
+
 }
 
 extern "C" {
@@ -9,6 +9,7 @@
 #include <sqlite3.h>
 #include "job.h"
 #include "dl.h"
+#include "fetch.h"
 #include "pkgtools.h"
 #include "slackpkg.h"
 #include "utils.h"
@@ -17,6 +18,12 @@ using namespace slack;
 
 static GSList *repos = NULL;
 
+/* Columns added to the shipped metadata.db schema */
+static const gchar *new_columns[][2] = {
+	{ "repos", "checksum" },
+	{ "pkglist", "md5" },
+};
+
 void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 {
 	gchar *path, **groups;
@@ -86,6 +93,20 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 
 	g_object_unref(file_info);
 	g_object_unref(conf_file);
+
+	/* Caches created by older versions don't have the checksums and the search tables yet */
+	for (auto column : new_columns)
+	{
+		if (sqlite3_table_column_metadata(db, NULL, column[0], column[1],
+		                                  NULL, NULL, NULL, NULL, NULL) != SQLITE_OK)
+		{
+			gchar *query = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN %s VARCHAR DEFAULT NULL",
+			                               column[0], column[1]);
+			sqlite3_exec(db, query, NULL, NULL, NULL);
+			sqlite3_free(query);
+		}
+	}
+	create_search_index(db);
 	sqlite3_close_v2(db);
 	g_free(path);
 
@@ -202,6 +223,7 @@ pk_backend_start_job(PkBackend *backend, PkBackendJob *job)
 	db_filename = g_build_filename(LOCALSTATEDIR, "cache", "PackageKit", "metadata", "metadata.db", NULL);
 	if (sqlite3_open(db_filename, &job_data->db) == SQLITE_OK) { /* Some SQLite settings */
 		sqlite3_exec(job_data->db, "PRAGMA foreign_keys = ON", NULL, NULL, NULL);
+		create_version_collation(job_data->db);
 	}
 	else
 	{
@@ -224,11 +246,6 @@ pk_backend_stop_job(PkBackend *backend, PkBackendJob *job)
 {
 	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
 
-	if (job_data->curl)
-	{
-		curl_easy_cleanup(job_data->curl);
-	}
-
 	sqlite3_close(job_data->db);
 	g_free(job_data);
 	pk_backend_job_set_user_data(job, NULL);
@@ -267,16 +284,28 @@ pk_backend_search_files_thread(PkBackendJob *job, GVariant *params, gpointer use
 	g_variant_get(params, "(t^a&s)", NULL, &vals);
 	search = g_strjoinv("%", vals);
 
-	query = sqlite3_mprintf("SELECT (p.name || ';' || p.ver || ';' || p.arch || ';' || r.repo), p.summary, "
-							"p.full_name FROM filelist AS f NATURAL JOIN pkglist AS p NATURAL JOIN repos AS r "
-							"WHERE f.filename LIKE '%%%q%%' GROUP BY f.full_name", search);
+	if (use_search_index(job_data->db, vals))
+	{
+		query = sqlite3_mprintf("SELECT (p.name || ';' || p.ver || ';' || p.arch || ';' || r.repo), p.summary, "
+								"p.full_name FROM filelist AS f NATURAL JOIN pkglist AS p NATURAL JOIN repos AS r "
+								"WHERE f.rowid IN (SELECT rowid FROM file_fts WHERE filename LIKE '%%%q%%') "
+								"GROUP BY f.full_name", search);
+	}
+	else
+	{
+		query = sqlite3_mprintf("SELECT (p.name || ';' || p.ver || ';' || p.arch || ';' || r.repo), p.summary, "
+								"p.full_name FROM filelist AS f NATURAL JOIN pkglist AS p NATURAL JOIN repos AS r "
+								"WHERE f.filename LIKE '%%%q%%' GROUP BY f.full_name", search);
+	}
 
 	if ((sqlite3_prepare_v2(job_data->db, query, -1, &stmt, NULL) == SQLITE_OK))
 	{
+		auto installed = InstalledPackages::get();
+
 		/* Now we're ready to output all packages */
 		while (sqlite3_step(stmt) == SQLITE_ROW)
 		{
-			ret = is_installed((gchar*) sqlite3_column_text(stmt, 2));
+			ret = installed->lookup((gchar*) sqlite3_column_text(stmt, 2));
 			if ((ret == PK_INFO_ENUM_INSTALLED) || (ret == PK_INFO_ENUM_UPDATING))
 			{
 				pk_backend_job_package(job, PK_INFO_ENUM_INSTALLED,
@@ -412,12 +441,13 @@ pk_backend_resolve_thread(PkBackendJob *job, GVariant *params, gpointer user_dat
 
 	if ((sqlite3_prepare_v2(job_data->db,
 							"SELECT (p1.name || ';' || p1.ver || ';' || p1.arch || ';' || r.repo), p1.summary, "
-						   	"p1.full_name FROM pkglist AS p1 NATURAL JOIN repos AS r "
-							"WHERE p1.name LIKE @search AND p1.repo_order = "
-							"(SELECT MIN(p2.repo_order) FROM pkglist AS p2 WHERE p2.name = p1.name GROUP BY p2.name)",
+						   	"p1.full_name FROM pkglist AS p1 NATURAL JOIN repos AS r NATURAL JOIN pkg_winner AS w "
+							"WHERE p1.name LIKE @search",
 							-1,
 							&stmt,
 							NULL) == SQLITE_OK)) {
+		auto installed = InstalledPackages::get();
+
 		/* Output packages matching each pattern */
 		for (val = vals; *val; val++)
 		{
@@ -425,7 +455,7 @@ pk_backend_resolve_thread(PkBackendJob *job, GVariant *params, gpointer user_dat
 
 			while (sqlite3_step(stmt) == SQLITE_ROW)
 			{
-				ret = is_installed((gchar*) sqlite3_column_text(stmt, 2));
+				ret = installed->lookup((gchar*) sqlite3_column_text(stmt, 2));
 				if ((ret == PK_INFO_ENUM_INSTALLED) || (ret == PK_INFO_ENUM_UPDATING))
 				{
 					pk_backend_job_package(job, PK_INFO_ENUM_INSTALLED,
@@ -460,9 +490,11 @@ pk_backend_resolve(PkBackend *backend, PkBackendJob *job, PkBitfield filters, gc
 static void
 pk_backend_download_packages_thread(PkBackendJob *job, GVariant *params, gpointer user_data)
 {
-	gchar *dir_path, *path, **pkg_ids, *to_strv[] = {NULL, NULL};
+	gchar *dir_path, **pkg_ids, *to_strv[] = {NULL, NULL};
 	guint i;
 	sqlite3_stmt *stmt;
+	Fetcher fetcher;
+	GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
 	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
 
 	g_variant_get(params, "(^a&ss)", &pkg_ids, &dir_path);
@@ -495,12 +527,9 @@ pk_backend_download_packages_thread(PkBackendJob *job, GVariant *params, gpointe
 				pk_backend_job_package(job, PK_INFO_ENUM_DOWNLOADING,
 									   pkg_ids[i],
 									   (gchar *) sqlite3_column_text(stmt, 0));
-				static_cast<Pkgtools *> (repo->data)->download (job,
+				static_cast<Pkgtools *> (repo->data)->download (job, fetcher,
 						dir_path, tokens[PK_PACKAGE_ID_NAME]);
-				path = g_build_filename(dir_path, (gchar *) sqlite3_column_text(stmt, 1), NULL);
-				to_strv[0] = path;
-				pk_backend_job_files(job, NULL, to_strv);
-				g_free(path);
+				g_ptr_array_add(paths, g_build_filename(dir_path, (gchar *) sqlite3_column_text(stmt, 1), NULL));
 			}
 		}
 		sqlite3_clear_bindings(stmt);
@@ -508,7 +537,22 @@ pk_backend_download_packages_thread(PkBackendJob *job, GVariant *params, gpointe
 		g_strfreev(tokens);
 	}
 
+	/* Fetch all packages at once */
+	if (!fetcher.run ())
+	{
+		pk_backend_job_error_code(job, PK_ERROR_ENUM_PACKAGE_DOWNLOAD_FAILED, "Failed to download packages");
+	}
+	for (i = 0; i < paths->len; i++)
+	{
+		if (g_file_test(static_cast<gchar *> (g_ptr_array_index(paths, i)), G_FILE_TEST_EXISTS))
+		{
+			to_strv[0] = static_cast<gchar *> (g_ptr_array_index(paths, i));
+			pk_backend_job_files(job, NULL, to_strv);
+		}
+	}
+
 out:
+	g_ptr_array_unref(paths);
 	sqlite3_finalize(stmt);
 }
 
@@ -529,6 +573,7 @@ pk_backend_install_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 	sqlite3_stmt *pkglist_stmt = NULL, *collection_stmt = NULL;
     PkBitfield transaction_flags = 0;
 	PkInfoEnum ret;
+	std::shared_ptr<const InstalledPackages> installed;
 	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
 
 	g_variant_get(params, "(t^a&s)", &transaction_flags, &pkg_ids);
@@ -583,9 +628,13 @@ pk_backend_install_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 				sqlite3_bind_text(collection_stmt, 1, tokens[PK_PACKAGE_ID_NAME], -1, SQLITE_TRANSIENT);
 				sqlite3_bind_text(collection_stmt, 2, tokens[PK_PACKAGE_ID_DATA], -1, SQLITE_TRANSIENT);
 
+				if (!installed)
+				{
+					installed = InstalledPackages::get();
+				}
 				while (sqlite3_step(collection_stmt) == SQLITE_ROW)
 				{
-					ret = is_installed((gchar*) sqlite3_column_text(collection_stmt, 2));
+					ret = installed->lookup((gchar*) sqlite3_column_text(collection_stmt, 2));
 					if ((ret == PK_INFO_ENUM_INSTALLING) || (ret == PK_INFO_ENUM_UPDATING))
 					{
 						if ((pk_bitfield_contain(transaction_flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE)) &&
@@ -618,6 +667,8 @@ pk_backend_install_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 
 	if (install_list && !pk_bitfield_contain(transaction_flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE))
 	{
+		Fetcher fetcher;
+
 		/* / 2 means total percentage for installing and for downloading */
 		percent_step = 100.0 / g_slist_length(install_list) / 2;
 
@@ -629,19 +680,24 @@ pk_backend_install_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 			gchar **tokens;
 			GSList *repo;
 
-			pk_backend_job_set_percentage(job, percent_step * i);
 			tokens = pk_package_id_split((gchar *)(l->data));
 			repo = g_slist_find_custom(repos, tokens[PK_PACKAGE_ID_DATA], cmp_repo);
 
 			if (repo)
 			{
-				static_cast<Pkgtools *> (repo->data)->download (job,
+				static_cast<Pkgtools *> (repo->data)->download (job, fetcher,
 						dest_dir_name, tokens[PK_PACKAGE_ID_NAME]);
 			}
 			g_strfreev(tokens);
 		}
 		g_free(dest_dir_name);
 
+		if (!fetcher.run ())
+		{
+			pk_backend_job_error_code(job, PK_ERROR_ENUM_PACKAGE_DOWNLOAD_FAILED, "Failed to download packages");
+			goto out;
+		}
+
 		/* Install the packages */
 		pk_backend_job_set_status(job, PK_STATUS_ENUM_INSTALL);
 		for (l = install_list; l; l = g_slist_next(l), i++)
@@ -660,9 +716,9 @@ pk_backend_install_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 			g_strfreev(tokens);
 		}
 	}
-	g_slist_free_full(install_list, g_free);
 
 out:
+	g_slist_free_full(install_list, g_free);
 	sqlite3_finalize(pkglist_stmt);
 	sqlite3_finalize(collection_stmt);
 }
@@ -739,102 +795,53 @@ pk_backend_remove_packages(PkBackend *backend,
 static void
 pk_backend_get_updates_thread(PkBackendJob *job, GVariant *params, gpointer user_data)
 {
-	gchar *pkg_id, *full_name, *desc;
-	const gchar *pkg_metadata_filename;
-	GFile *pkg_metadata_dir;
-	GFileEnumerator *pkg_metadata_enumerator;
-	GFileInfo *pkg_metadata_file_info;
-	GError *err = NULL;
-	sqlite3_stmt *stmt;
+	gchar *pkg_id;
+	sqlite3_stmt *stmt = NULL;
 	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
+	auto installed = InstalledPackages::get();
 
 	pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
 
-	if ((sqlite3_prepare_v2(job_data->db,
-							"SELECT p1.full_name, p1.name, p1.ver, p1.arch, r.repo, p1.summary, p1.ext "
-							"FROM pkglist AS p1 NATURAL JOIN repos AS r "
-							"WHERE p1.name LIKE @name AND p1.repo_order = "
-							"(SELECT MIN(p2.repo_order) FROM pkglist AS p2 WHERE p2.name = p1.name GROUP BY p2.name)",
-							-1,
-							&stmt,
-							NULL) != SQLITE_OK))
+	if (!installed->is_valid())
 	{
-		pk_backend_job_error_code(job, PK_ERROR_ENUM_CANNOT_GET_FILELIST, "%s", sqlite3_errmsg(job_data->db));
+		pk_backend_job_error_code(job, PK_ERROR_ENUM_NO_CACHE, "/var/log/packages: Failed to read the directory");
 		goto out;
 	}
 
-	/* Read the package metadata directory and comprare all installed packages with ones in the cache */
-	pkg_metadata_dir = g_file_new_for_path("/var/log/packages");
-	pkg_metadata_enumerator = g_file_enumerate_children(pkg_metadata_dir, "standard::name",
-														 G_FILE_QUERY_INFO_NONE,
-														 NULL,
-														 &err);
-	g_object_unref(pkg_metadata_dir);
-	if (err)
+	/* Compare all installed packages with ones in the cache in one query */
+	if (!installed->stage(job_data->db)
+	 || (sqlite3_prepare_v2(job_data->db, updates_query(), -1, &stmt, NULL) != SQLITE_OK))
 	{
-		pk_backend_job_error_code(job, PK_ERROR_ENUM_NO_CACHE, "/var/log/packages: %s", err->message);
-		g_error_free(err);
+		pk_backend_job_error_code(job, PK_ERROR_ENUM_CANNOT_GET_FILELIST, "%s", sqlite3_errmsg(job_data->db));
 		goto out;
 	}
 
-	while ((pkg_metadata_file_info = g_file_enumerator_next_file(pkg_metadata_enumerator, NULL, NULL)))
+	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		gchar **tokens;
-
-		pkg_metadata_filename = g_file_info_get_name(pkg_metadata_file_info);
-		tokens = split_package_name(pkg_metadata_filename);
-
-		/* Select the package from the database */
-		sqlite3_bind_text(stmt, 1, tokens[0], -1, SQLITE_TRANSIENT);
-
-		/* If there are more packages with the same name, remember the one from the
-		 * repository with the lowest order. */
-		if ((sqlite3_step(stmt) == SQLITE_ROW)
-		 || g_slist_find_custom(repos, ((gchar *) sqlite3_column_text(stmt, 4)), cmp_repo))
-		{
-
-			full_name = g_strdup((gchar *) sqlite3_column_text(stmt, 0));
-
-			if (!g_strcmp0((gchar *) sqlite3_column_text(stmt, 6), "obsolete"))
-			{ /* Remove if obsolete */
-				pkg_id = pk_package_id_build(tokens[PK_PACKAGE_ID_NAME],
-											 tokens[PK_PACKAGE_ID_VERSION],
-											 tokens[PK_PACKAGE_ID_ARCH],
-											 "obsolete");
-				/* TODO:
-				 * 1: Use the repository name instead of "obsolete" above and check in pk_backend_update_packages()
-				      if the package is obsolete or not
-				 * 2: Get description from /var/log/packages, not from the database */
-				desc = g_strdup((gchar *) sqlite3_column_text(stmt, 5));
-
-				pk_backend_job_package(job, PK_INFO_ENUM_REMOVING, pkg_id, desc);
-
-				g_free(desc);
-				g_free(pkg_id);
-			}
-			else if (g_strcmp0(pkg_metadata_filename, full_name))
-			{ /* Update available */
-				pkg_id = pk_package_id_build((gchar *) sqlite3_column_text(stmt, 1),
-											 (gchar *) sqlite3_column_text(stmt, 2),
-											 (gchar *) sqlite3_column_text(stmt, 3),
-											 (gchar *) sqlite3_column_text(stmt, 4));
-				desc = g_strdup((gchar *) sqlite3_column_text(stmt, 5));
-
-				pk_backend_job_package(job, PK_INFO_ENUM_NORMAL, pkg_id, desc);
-
-				g_free(desc);
-				g_free(pkg_id);
-			}
-			g_free(full_name);
+		if (!g_strcmp0((gchar *) sqlite3_column_text(stmt, 6), "obsolete"))
+		{ /* Remove if obsolete */
+			pkg_id = pk_package_id_build((gchar *) sqlite3_column_text(stmt, 7),
+										 (gchar *) sqlite3_column_text(stmt, 8),
+										 (gchar *) sqlite3_column_text(stmt, 9),
+										 "obsolete");
+			/* TODO:
+			 * 1: Use the repository name instead of "obsolete" above and check in pk_backend_update_packages()
+			      if the package is obsolete or not
+			 * 2: Get description from /var/log/packages, not from the database */
+			pk_backend_job_package(job, PK_INFO_ENUM_REMOVING, pkg_id,
+								   (gchar *) sqlite3_column_text(stmt, 5));
 		}
-
-		sqlite3_clear_bindings(stmt);
-		sqlite3_reset(stmt);
-
-		g_strfreev(tokens);
-		g_object_unref(pkg_metadata_file_info);
+		else
+		{ /* Update available */
+			pkg_id = pk_package_id_build((gchar *) sqlite3_column_text(stmt, 1),
+										 (gchar *) sqlite3_column_text(stmt, 2),
+										 (gchar *) sqlite3_column_text(stmt, 3),
+										 (gchar *) sqlite3_column_text(stmt, 4));
+			pk_backend_job_package(job, PK_INFO_ENUM_NORMAL, pkg_id,
+								   (gchar *) sqlite3_column_text(stmt, 5));
+		}
+		g_free(pkg_id);
 	}
-	g_object_unref(pkg_metadata_enumerator);
 
 out:
 	sqlite3_finalize(stmt);
@@ -856,6 +863,8 @@ pk_backend_update_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 	g_variant_get(params, "(t^a&s)", &transaction_flags, &pkg_ids);
 
 	if (!pk_bitfield_contain(transaction_flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE)) {
+		Fetcher fetcher;
+
 		pk_backend_job_set_status(job, PK_STATUS_ENUM_DOWNLOAD);
 
 		/* Download the packages */
@@ -870,7 +879,7 @@ pk_backend_update_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 
 				if (repo)
 				{
-					static_cast<Pkgtools *> (repo->data)->download (job,
+					static_cast<Pkgtools *> (repo->data)->download (job, fetcher,
 							dest_dir_name, tokens[PK_PACKAGE_ID_NAME]);
 				}
 			}
@@ -879,6 +888,12 @@ pk_backend_update_packages_thread(PkBackendJob *job, GVariant *params, gpointer
 		}
 		g_free(dest_dir_name);
 
+		if (!fetcher.run ())
+		{
+			pk_backend_job_error_code(job, PK_ERROR_ENUM_PACKAGE_DOWNLOAD_FAILED, "Failed to download packages");
+			return;
+		}
+
 		/* Install the packages */
 		pk_backend_job_set_status(job, PK_STATUS_ENUM_UPDATE);
 		for (i = 0; pkg_ids[i]; i++)
@@ -922,7 +937,7 @@ pk_backend_refresh_cache_thread(PkBackendJob *job, GVariant *params, gpointer us
 {
 	gchar *tmp_dir_name, *db_err, *path = NULL;
 	gint ret;
-	gboolean force;
+	gboolean force, changed;
 	GSList *file_list = NULL;
 	GFile *db_file = NULL;
 	GFileInfo *file_info = NULL;
@@ -994,19 +1009,34 @@ pk_backend_refresh_cache_thread(PkBackendJob *job, GVariant *params, gpointer us
 	/* Download repository */
 	pk_backend_job_set_status(job, PK_STATUS_ENUM_DOWNLOAD_REPOSITORY);
 
-	for (GSList *l = file_list; l; l = g_slist_next(l))
+	/* Missing optional files are fine, update_cache() checks what is there */
 	{
-		get_file(&job_data->curl, static_cast<gchar **> (l->data)[0],
-				static_cast<gchar **> (l->data)[1]);
+		Fetcher fetcher;
+
+		for (GSList *l = file_list; l; l = g_slist_next(l))
+		{
+			fetcher.add (static_cast<gchar **> (l->data)[0],
+					static_cast<gchar **> (l->data)[1]);
+		}
+		fetcher.run ();
 	}
 	g_slist_free_full(file_list, (GDestroyNotify)g_strfreev);
 
 	/* Refresh cache */
 	pk_backend_job_set_status(job, PK_STATUS_ENUM_REFRESH_CACHE);
 
+	/* Repositories whose metadata didn't change since the last refresh are skipped */
+	changed = force;
 	for (GSList *l = repos; l; l = g_slist_next(l))
 	{
-		static_cast<Pkgtools *> (l->data)->generate_cache (job, tmp_dir_name);
+		if (static_cast<Pkgtools *> (l->data)->update_cache (job, tmp_dir_name))
+		{
+			changed = TRUE;
+		}
+	}
+	if (changed)
+	{
+		rebuild_search_index(job_data->db);
 	}
 
 out:
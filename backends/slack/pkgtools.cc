@@ -1,5 +1,7 @@
 #include <curl/curl.h>
 #include <sqlite3.h>
+#include <stdio.h>
+#include <string.h>
 #include "pkgtools.h"
 #include "utils.h"
 
@@ -8,25 +10,25 @@ namespace slack {
 /**
  * slack::Pkgtools::download:
  * @job: A #PkBackendJob.
+ * @fetcher: Fetcher to queue the download in.
  * @dest_dir_name: Destination directory.
  * @pkg_name: Package name.
  *
- * Download a package.
+ * Queue a package for download unless it is already in @dest_dir_name.
  *
- * Returns: %TRUE on success, %FALSE otherwise.
+ * Returns: %TRUE if the package was queued or is already downloaded, %FALSE otherwise.
  **/
 gboolean
-Pkgtools::download (PkBackendJob *job,
+Pkgtools::download (PkBackendJob *job, Fetcher &fetcher,
 		gchar *dest_dir_name, gchar *pkg_name) noexcept
 {
 	gchar *dest_filename, *source_url;
 	gboolean ret = FALSE;
 	sqlite3_stmt *statement = NULL;
-	CURL *curl = NULL;
 	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
 
 	if ((sqlite3_prepare_v2(job_data->db,
-							"SELECT location, (full_name || '.' || ext) FROM pkglist "
+							"SELECT location, (full_name || '.' || ext), md5 FROM pkglist "
 							"WHERE name LIKE @name AND repo_order = @repo_order",
 							-1,
 							&statement,
@@ -47,20 +49,11 @@ Pkgtools::download (PkBackendJob *job,
 
 		if (!g_file_test(dest_filename, G_FILE_TEST_EXISTS))
 		{
-			if (get_file(&curl, source_url, dest_filename) == CURLE_OK)
-			{
-				ret = TRUE;
-			}
-		}
-		else
-		{
-			ret = TRUE;
+			fetcher.add (source_url, dest_filename,
+					(const gchar *) sqlite3_column_text(statement, 2));
 		}
+		ret = TRUE;
 
-		if (curl)
-		{
-			curl_easy_cleanup(curl);
-		}
 		g_free(source_url);
 		g_free(dest_filename);
 	}
@@ -113,6 +106,237 @@ Pkgtools::install (PkBackendJob *job, gchar *pkg_name) noexcept
 	sqlite3_finalize(statement);
 }
 
+/**
+ * slack::Pkgtools::cache_checksum:
+ * @tmpl: temporary directory the metadata were downloaded to.
+ *
+ * Computes a checksum over the downloaded metadata of this repository and
+ * the repository settings the cache is generated with.
+ *
+ * Returns: SHA-256 checksum or %NULL if nothing was downloaded. Free with g_free().
+ **/
+gchar *
+Pkgtools::cache_checksum (const gchar *tmpl) const noexcept
+{
+	gchar buf[8192], *dir_name, *ret = NULL;
+	const gchar *entry;
+	gsize read_len;
+	GSList *filenames = NULL;
+	GDir *dir;
+	GChecksum *checksum;
+
+	dir_name = g_build_filename(tmpl, this->get_name (), NULL);
+	if (!(dir = g_dir_open(dir_name, 0, NULL)))
+	{
+		g_free(dir_name);
+		return NULL;
+	}
+	while ((entry = g_dir_read_name(dir)))
+	{
+		filenames = g_slist_insert_sorted(filenames, g_strdup(entry), (GCompareFunc) g_strcmp0);
+	}
+	g_dir_close(dir);
+
+	checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(checksum, (const guchar *) this->get_name (), -1);
+	g_checksum_update(checksum, &this->order, sizeof(this->order));
+	if (this->blacklist)
+	{
+		g_checksum_update(checksum, (const guchar *) g_regex_get_pattern(this->blacklist), -1);
+	}
+
+	for (GSList *l = filenames; l; l = g_slist_next(l))
+	{
+		gchar *path = g_build_filename(dir_name, static_cast<gchar *> (l->data), NULL);
+		FILE *fin = fopen(path, "rb");
+
+		g_free(path);
+		if (!fin)
+		{
+			continue;
+		}
+		/* Include the file name, so the content can't be attributed to another file */
+		g_checksum_update(checksum, static_cast<guchar *> (l->data), strlen(static_cast<gchar *> (l->data)) + 1);
+		while ((read_len = fread(buf, 1, sizeof(buf), fin)))
+		{
+			g_checksum_update(checksum, (const guchar *) buf, read_len);
+		}
+		fclose(fin);
+	}
+	if (filenames)
+	{
+		ret = g_strdup(g_checksum_get_string(checksum));
+	}
+
+	g_checksum_free(checksum);
+	g_slist_free_full(filenames, g_free);
+	g_free(dir_name);
+
+	return ret;
+}
+
+/**
+ * slack::Pkgtools::update_cache:
+ * @job: A #PkBackendJob.
+ * @tmpl: temporary directory the metadata were downloaded to.
+ *
+ * Regenerates the cache of this repository in a single transaction, unless
+ * the downloaded metadata are the same the cache was last generated from.
+ * The checksum isn't kept while another repository provides some of the
+ * packages, so they are taken back once the other repository drops them.
+ *
+ * Returns: %TRUE if the cache was changed, %FALSE otherwise.
+ **/
+gboolean
+Pkgtools::update_cache (PkBackendJob *job, const gchar *tmpl) noexcept
+{
+	gchar *checksum;
+	gboolean ret = FALSE;
+	sqlite3_stmt *statement = NULL;
+	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
+
+	if (!(checksum = this->cache_checksum (tmpl)))
+	{
+		return FALSE;
+	}
+
+	if (sqlite3_prepare_v2(job_data->db,
+	                       "SELECT checksum FROM repos WHERE repo_order = @repo_order AND repo LIKE @repo",
+	                       -1,
+	                       &statement,
+	                       NULL) == SQLITE_OK)
+	{
+		sqlite3_bind_int(statement, 1, this->get_order ());
+		sqlite3_bind_text(statement, 2, this->get_name (), -1, SQLITE_TRANSIENT);
+		if ((sqlite3_step(statement) == SQLITE_ROW)
+		 && !g_strcmp0((const gchar *) sqlite3_column_text(statement, 0), checksum))
+		{
+			g_debug("%s: metadata unchanged, skipping", this->get_name ());
+			goto out;
+		}
+		sqlite3_finalize(statement);
+		statement = NULL;
+	}
+
+	sqlite3_exec(job_data->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+	if (this->generate_cache (job, tmpl)
+	 && (sqlite3_prepare_v2(job_data->db,
+	                        "UPDATE repos SET checksum = CASE WHEN EXISTS (SELECT 1 "
+	                        "FROM temp.pkglist_new AS n JOIN pkglist AS p ON p.full_name = n.full_name "
+	                        "WHERE p.repo_order != n.repo_order) THEN NULL ELSE @checksum END "
+	                        "WHERE repo_order = @repo_order",
+	                        -1,
+	                        &statement,
+	                        NULL) == SQLITE_OK))
+	{
+		sqlite3_bind_text(statement, 1, checksum, -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(statement, 2, this->get_order ());
+		ret = sqlite3_step(statement) == SQLITE_DONE;
+	}
+	sqlite3_exec(job_data->db, ret ? "END TRANSACTION" : "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+
+out:
+	sqlite3_finalize(statement);
+	g_free(checksum);
+
+	return ret;
+}
+
+/**
+ * slack::Pkgtools::stage_cache:
+ * @db: Metadata database.
+ *
+ * Makes sure the repository is registered with its current order and
+ * prepares empty staging tables. generate_cache() inserts the parsed
+ * packages and collections into pkglist_new and collections_new, and
+ * apply_cache() merges them into the cache afterwards.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ **/
+gboolean
+Pkgtools::stage_cache (sqlite3 *db) noexcept
+{
+	gint ret;
+	gchar *query;
+
+	query = sqlite3_mprintf("DELETE FROM repos WHERE (repo LIKE %Q AND repo_order != %u) "
+	                        "OR (repo_order = %u AND repo NOT LIKE %Q);"
+	                        "INSERT OR IGNORE INTO repos (repo_order, repo) VALUES (%u, %Q);"
+	                        "CREATE TEMP TABLE IF NOT EXISTS pkglist_new (full_name VARCHAR NOT NULL UNIQUE,"
+	                        "name VARCHAR NOT NULL,ver VARCHAR NOT NULL,arch VARCHAR DEFAULT NULL,"
+	                        "ext VARCHAR DEFAULT NULL,location VARCHAR DEFAULT '.',summary VARCHAR DEFAULT '',"
+	                        "desc TEXT DEFAULT '',compressed INT DEFAULT 0,uncompressed INT DEFAULT 0,"
+	                        "cat VARCHAR DEFAULT 'unknown',repo_order INTEGER,md5 VARCHAR DEFAULT NULL,"
+	                        "PRIMARY KEY (name, repo_order));"
+	                        "CREATE TEMP TABLE IF NOT EXISTS collections_new (name VARCHAR NOT NULL,"
+	                        "repo_order INTEGER NOT NULL,collection_pkg VARCHAR NOT NULL,"
+	                        "PRIMARY KEY (name, repo_order, collection_pkg));"
+	                        "DELETE FROM temp.pkglist_new;"
+	                        "DELETE FROM temp.collections_new",
+	                        this->get_name (), this->get_order (),
+	                        this->get_order (), this->get_name (),
+	                        this->get_order (), this->get_name ());
+	ret = sqlite3_exec(db, query, NULL, NULL, NULL);
+	sqlite3_free(query);
+
+	return ret == SQLITE_OK;
+}
+
+/**
+ * slack::Pkgtools::apply_cache:
+ * @db: Metadata database.
+ *
+ * Merges the staged packages into the cache: removes the packages that are
+ * gone, updates changed ones in place and inserts the new ones. Rows that
+ * didn't change aren't touched, so their file lists are kept as well.
+ *
+ * Package names are unique across the repositories. As with a full refresh,
+ * the repository with the higher order gets the package. A repository
+ * losing a package to this one is read again on the next refresh.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ **/
+gboolean
+Pkgtools::apply_cache (sqlite3 *db) noexcept
+{
+	gint ret;
+	gchar *query;
+
+	query = sqlite3_mprintf("DELETE FROM pkglist WHERE repo_order = %u "
+	                        "AND full_name NOT IN (SELECT full_name FROM temp.pkglist_new);"
+	                        "UPDATE pkglist SET (ver, arch, ext, location, summary, desc, "
+	                        "compressed, uncompressed, cat, md5) = "
+	                        "(SELECT n.ver, n.arch, n.ext, n.location, n.summary, n.desc, "
+	                        "n.compressed, n.uncompressed, n.cat, n.md5 "
+	                        "FROM temp.pkglist_new AS n WHERE n.full_name = pkglist.full_name) "
+	                        "WHERE repo_order = %u AND EXISTS (SELECT 1 FROM temp.pkglist_new AS n "
+	                        "WHERE n.full_name = pkglist.full_name AND (n.ver, n.arch, n.ext, "
+	                        "n.location, n.summary, n.desc, n.compressed, n.uncompressed, n.cat, n.md5) IS NOT "
+	                        "(pkglist.ver, pkglist.arch, pkglist.ext, pkglist.location, pkglist.summary, "
+	                        "pkglist.desc, pkglist.compressed, pkglist.uncompressed, pkglist.cat, pkglist.md5));"
+	                        "UPDATE repos SET checksum = NULL WHERE repo_order IN (SELECT p.repo_order "
+	                        "FROM pkglist AS p JOIN temp.pkglist_new AS n ON p.full_name = n.full_name "
+	                        "WHERE p.repo_order < n.repo_order);"
+	                        "INSERT OR REPLACE INTO pkglist (full_name, name, ver, arch, ext, location, "
+	                        "summary, desc, compressed, uncompressed, cat, repo_order, md5) "
+	                        "SELECT n.full_name, n.name, n.ver, n.arch, n.ext, n.location, n.summary, "
+	                        "n.desc, n.compressed, n.uncompressed, n.cat, n.repo_order, n.md5 "
+	                        "FROM temp.pkglist_new AS n WHERE NOT EXISTS (SELECT 1 FROM pkglist AS p "
+	                        "WHERE p.full_name = n.full_name AND p.repo_order >= n.repo_order);"
+	                        "DELETE FROM collections WHERE repo_order = %u AND (name, collection_pkg) "
+	                        "NOT IN (SELECT name, collection_pkg FROM temp.collections_new);"
+	                        "INSERT OR IGNORE INTO collections (name, repo_order, collection_pkg) "
+	                        "SELECT c.name, c.repo_order, c.collection_pkg FROM temp.collections_new AS c "
+	                        "WHERE EXISTS (SELECT 1 FROM pkglist AS p "
+	                        "WHERE p.name = c.name AND p.repo_order = c.repo_order)",
+	                        this->get_order (), this->get_order (), this->get_order ());
+	ret = sqlite3_exec(db, query, NULL, NULL, NULL);
+	sqlite3_free(query);
+
+	return ret == SQLITE_OK;
+}
+
 Pkgtools::~Pkgtools () noexcept
 {
 }
@@ -3,6 +3,8 @@
 
 #include <glib-object.h>
 #include <pk-backend.h>
+#include <sqlite3.h>
+#include "fetch.h"
 
 namespace slack {
 
@@ -16,15 +18,21 @@ public:
 
 	virtual ~Pkgtools () noexcept;
 
-	gboolean download (PkBackendJob *job,
+	gboolean download (PkBackendJob *job, Fetcher &fetcher,
 			gchar *dest_dir_name, gchar *pkg_name) noexcept;
 	void install (PkBackendJob *job, gchar *pkg_name) noexcept;
 
+	gchar *cache_checksum (const gchar *tmpl) const noexcept;
+	gboolean update_cache (PkBackendJob *job, const gchar *tmpl) noexcept;
+
 	virtual GSList *collect_cache_info (const gchar *tmpl) noexcept = 0;
-	virtual void generate_cache (PkBackendJob *job,
+	virtual gboolean generate_cache (PkBackendJob *job,
 			const gchar *tmpl) noexcept = 0;
 
 protected:
+	gboolean stage_cache (sqlite3 *db) noexcept;
+	gboolean apply_cache (sqlite3 *db) noexcept;
+
 	gchar *name = NULL;
 	gchar *mirror = NULL;
 	guint8 order;
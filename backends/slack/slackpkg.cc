@@ -14,12 +14,14 @@ GHashTable *Slackpkg::cat_map = NULL;
  * @job:      a #PkBackendJob.
  * @tmpl:     temporary directory.
  * @filename: manifest filename
+ * @missing:  full names of the packages without a file list.
  *
- * Parse the manifest file and save the file list in the database.
+ * Parse the manifest file and save the file lists of the @missing packages
+ * in the database.
  */
 void
-Slackpkg::manifest (PkBackendJob *job,
-		const gchar *tmpl, gchar *filename) noexcept
+Slackpkg::manifest (PkBackendJob *job, const gchar *tmpl,
+		gchar *filename, GHashTable *missing) noexcept
 {
 	FILE *manifest;
 	gint err, read_len;
@@ -68,7 +70,7 @@ Slackpkg::manifest (PkBackendJob *job,
 
 	/* Prepare SQL statements */
 	if (sqlite3_prepare_v2(job_data->db,
-						   "INSERT INTO filelist (full_name, filename) VALUES (@full_name, @filename)",
+						   "INSERT OR IGNORE INTO filelist (full_name, filename) VALUES (@full_name, @filename)",
 						   -1,
 						   &statement,
 						   NULL) != SQLITE_OK)
@@ -76,7 +78,6 @@ Slackpkg::manifest (PkBackendJob *job,
 		goto out;
 	}
 
-	sqlite3_exec(job_data->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 	while ((read_len = BZ2_bzRead(&err, manifest_bz2, buf, max_buf_size - 1)))
 	{
 		if ((err != BZ_OK) && (err != BZ_STREAM_END))
@@ -104,14 +105,18 @@ Slackpkg::manifest (PkBackendJob *job,
 		{
 			if (g_regex_match(pkg_expr, *line, static_cast<GRegexMatchFlags> (0), &match_info))
 			{
+				g_free(full_name);
+				full_name = NULL;
+
+				/* If the extension matches and the files aren't known yet */
 				if (g_match_info_get_match_count(match_info) > 2)
-				{ /* If the extension matches */
-					g_free(full_name);
-					full_name = g_match_info_fetch(match_info, 1);
-				}
-				else
 				{
-					full_name = NULL;
+					full_name = g_match_info_fetch(match_info, 1);
+					if (!g_hash_table_contains(missing, full_name))
+					{
+						g_free(full_name);
+						full_name = NULL;
+					}
 				}
 			}
 			g_match_info_free(match_info);
@@ -132,7 +137,6 @@ Slackpkg::manifest (PkBackendJob *job,
 		g_strfreev(lines);
 	}
 
-	sqlite3_exec(job_data->db, "END TRANSACTION", NULL, NULL, NULL);
 	g_free(full_name);
 	BZ2_bzReadClose(&err, manifest_bz2);
 
@@ -149,6 +153,74 @@ out:
 	fclose(manifest);
 }
 
+/*
+ * slack::Slackpkg::checksums:
+ * @job:  a #PkBackendJob.
+ * @tmpl: temporary directory.
+ *
+ * Parse CHECKSUMS.md5 and assign the checksums to the staged packages.
+ */
+void
+Slackpkg::checksums (PkBackendJob *job, const gchar *tmpl) noexcept
+{
+	gchar *path, *line;
+	GFile *checksums_file;
+	GFileInputStream *fin;
+	GDataInputStream *data_in;
+	sqlite3_stmt *statement = NULL;
+	auto job_data = static_cast<JobData *> (pk_backend_job_get_user_data(job));
+
+	path = g_build_filename(tmpl, this->get_name (), "CHECKSUMS.md5", NULL);
+	checksums_file = g_file_new_for_path(path);
+	fin = g_file_read(checksums_file, NULL, NULL);
+	g_object_unref(checksums_file);
+	g_free(path);
+
+	if (!fin)
+	{
+		return;
+	}
+	if ((sqlite3_exec(job_data->db,
+	                  "CREATE TEMP TABLE IF NOT EXISTS checksums_new "
+	                  "(filename VARCHAR PRIMARY KEY, md5 VARCHAR NOT NULL);"
+	                  "DELETE FROM temp.checksums_new",
+	                  NULL, NULL, NULL) != SQLITE_OK)
+	 || (sqlite3_prepare_v2(job_data->db,
+	                        "INSERT OR REPLACE INTO temp.checksums_new (filename, md5) VALUES (@filename, @md5)",
+	                        -1,
+	                        &statement,
+	                        NULL) != SQLITE_OK))
+	{
+		g_object_unref(fin);
+		return;
+	}
+
+	/* Lines look like "<md5>  ./slackware64/a/aaa_base-15.0-x86_64-4.txz" */
+	data_in = g_data_input_stream_new(G_INPUT_STREAM(fin));
+	while ((line = g_data_input_stream_read_line(data_in, NULL, NULL, NULL)))
+	{
+		const gchar *filename = strrchr(line, '/');
+
+		if ((strlen(line) > 34) && (line[32] == ' ') && filename)
+		{
+			sqlite3_bind_text(statement, 1, filename + 1, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(statement, 2, line, 32, SQLITE_TRANSIENT);
+			sqlite3_step(statement);
+			sqlite3_clear_bindings(statement);
+			sqlite3_reset(statement);
+		}
+		g_free(line);
+	}
+	sqlite3_finalize(statement);
+	g_object_unref(data_in);
+	g_object_unref(fin);
+
+	sqlite3_exec(job_data->db,
+	             "UPDATE temp.pkglist_new SET md5 = (SELECT c.md5 FROM temp.checksums_new AS c "
+	             "WHERE c.filename = pkglist_new.full_name || '.' || pkglist_new.ext)",
+	             NULL, NULL, NULL);
+}
+
 /**
  * slack::Slackpkg::collect_cache_info:
  * @tmpl: temporary directory for downloading the files.
@@ -171,6 +243,16 @@ Slackpkg::collect_cache_info (const gchar *tmpl) noexcept
 	repo_tmp_dir = g_file_get_child(tmp_dir, this->get_name ());
 	g_file_make_directory(repo_tmp_dir, NULL, NULL);
 
+	/* Package checksums are optional, they are verified while downloading if available */
+	source_dest = static_cast<gchar **> (g_malloc_n(3, sizeof(gchar *)));
+	source_dest[0] = g_strconcat(this->get_mirror (), "CHECKSUMS.md5", NULL);
+	source_dest[1] = g_build_filename(tmpl,
+	                                  this->get_name (),
+	                                  "CHECKSUMS.md5",
+	                                  NULL);
+	source_dest[2] = NULL;
+	file_list = g_slist_prepend(file_list, source_dest);
+
 	/* Download PACKAGES.TXT. These files are most important, break if some of them couldn't be found */
 	for (gchar **cur_priority = this->priority; *cur_priority; cur_priority++)
 	{
@@ -193,6 +275,7 @@ Slackpkg::collect_cache_info (const gchar *tmpl) noexcept
 		{
 			g_strfreev(source_dest);
 			g_slist_free_full(file_list, (GDestroyNotify)g_strfreev);
+			file_list = NULL;
 			goto out;
 		}
 
@@ -232,19 +315,21 @@ out:
  * @job: A #PkBackendJob.
  * @tmpl: temporary directory for downloading the files.
  *
- * Download files needed to get the information like the list of packages
- * in available repositories, updates, package descriptions and so on.
+ * Updates the cache of this repository from the downloaded PACKAGES.TXT
+ * and MANIFEST.bz2 files. Has to be called inside a transaction.
  *
- * Returns: List of files needed for building the cache.
+ * Returns: %TRUE on success, %FALSE otherwise.
  **/
-void
+gboolean
 Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 {
 	gchar **pkg_tokens = NULL;
 	gchar *query = NULL, *filename = NULL, *location = NULL, *summary = NULL, *line, *packages_txt;
 	guint pkg_compressed = 0, pkg_uncompressed = 0;
 	gushort pkg_name_len;
+	gboolean ret = FALSE;
 	GString *desc;
+	GHashTable *missing;
 	GFile *list_file;
 	GFileInputStream *fin = NULL;
 	GDataInputStream *data_in = NULL;
@@ -264,41 +349,14 @@ Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 	{
 		goto out;
 	}
-	/* Remove the old entries from this repository */
-	if (sqlite3_prepare_v2(job_data->db,
-	                       "DELETE FROM repos WHERE repo LIKE @repo",
-	                       -1,
-	                       &statement,
-	                       NULL) == SQLITE_OK)
-	{
-		sqlite3_bind_text(statement,
-		                  1,
-		                  this->get_name (),
-		                  -1,
-		                  SQLITE_TRANSIENT);
-		sqlite3_step(statement);
-		sqlite3_finalize(statement);
-	}
-	if (sqlite3_prepare_v2(job_data->db,
-	                       "INSERT INTO repos (repo_order, repo) VALUES (@repo_order, @repo)",
-	                       -1,
-	                       &statement,
-	                       NULL) != SQLITE_OK)
+	if (!this->stage_cache (job_data->db))
 	{
 		goto out;
 	}
-	sqlite3_bind_int(statement, 1, this->get_order ());
-	sqlite3_bind_text(statement,
-	                  2,
-	                  this->get_name (),
-	                  -1,
-	                  SQLITE_TRANSIENT);
-	sqlite3_step(statement);
-	sqlite3_finalize(statement);
 
-	/* Insert new records */
+	/* Collect the packages in the staging table */
 	if ((sqlite3_prepare_v2(job_data->db,
-	                        "INSERT OR REPLACE INTO pkglist (full_name, ver, arch, ext, location, "
+	                        "INSERT OR REPLACE INTO temp.pkglist_new (full_name, ver, arch, ext, location, "
 	                        "summary, desc, compressed, uncompressed, name, repo_order, cat) "
 	                        "VALUES (@full_name, @ver, @arch, @ext, @location, @summary, "
 	                        "@desc, @compressed, @uncompressed, @name, @repo_order, @cat)",
@@ -306,7 +364,7 @@ Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 	                        &insert_statement,
 	                        NULL) != SQLITE_OK)
 	 || (sqlite3_prepare_v2(job_data->db,
-	                    "INSERT OR REPLACE INTO pkglist (full_name, ver, arch, ext, location, "
+	                    "INSERT OR REPLACE INTO temp.pkglist_new (full_name, ver, arch, ext, location, "
 	                    "summary, desc, compressed, uncompressed, name, repo_order) "
 	                    "VALUES (@full_name, @ver, @arch, @ext, @location, @summary, "
 	                    "@desc, @compressed, @uncompressed, @name, @repo_order)",
@@ -316,7 +374,7 @@ Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 	{
 		goto out;
 	}
-	query = sqlite3_mprintf("UPDATE pkglist SET full_name = @full_name, ver = @ver, arch = @arch, "
+	query = sqlite3_mprintf("UPDATE temp.pkglist_new SET full_name = @full_name, ver = @ver, arch = @arch, "
 	                        "ext = @ext, location = @location, summary = @summary, "
 	                        "desc = @desc, compressed = @compressed, uncompressed = @uncompressed "
 	                        "WHERE name LIKE @name AND repo_order = %u",
@@ -329,8 +387,6 @@ Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 	data_in = g_data_input_stream_new(G_INPUT_STREAM(fin));
 	desc = g_string_new("");
 
-	sqlite3_exec(job_data->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
-
 	while ((line = g_data_input_stream_read_line(data_in, NULL, NULL, NULL)))
 	{
 		if (!strncmp(line, "PACKAGE NAME:  ", 15))
@@ -424,18 +480,39 @@ Slackpkg::generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept
 		}
 		g_free(line);
 	}
-	sqlite3_exec(job_data->db, "END TRANSACTION", NULL, NULL, NULL);
-
 	g_string_free(desc, TRUE);
 	g_object_unref(data_in);
 
-	/* Parse MANIFEST.bz2 */
-	for (gchar **p = this->priority; *p; p++)
+	checksums (job, tmpl);
+	if (!this->apply_cache (job_data->db))
+	{
+		goto out;
+	}
+
+	/* Parse MANIFEST.bz2 only for the packages whose files aren't known yet */
+	missing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (sqlite3_prepare_v2(job_data->db,
+	                       "SELECT full_name FROM pkglist AS p WHERE repo_order = @repo_order "
+	                       "AND NOT EXISTS (SELECT 1 FROM filelist AS f WHERE f.full_name = p.full_name)",
+	                       -1,
+	                       &statement,
+	                       NULL) == SQLITE_OK)
+	{
+		sqlite3_bind_int(statement, 1, this->get_order ());
+		while (sqlite3_step(statement) == SQLITE_ROW)
+		{
+			g_hash_table_add(missing, g_strdup((gchar *) sqlite3_column_text(statement, 0)));
+		}
+		sqlite3_finalize(statement);
+	}
+	for (gchar **p = this->priority; *p && g_hash_table_size(missing); p++)
 	{
 		filename = g_strconcat(*p, "-MANIFEST.bz2", NULL);
-		manifest (job, tmpl, filename);
+		manifest (job, tmpl, filename, missing);
 		g_free(filename);
 	}
+	g_hash_table_unref(missing);
+	ret = TRUE;
 out:
 	sqlite3_finalize(update_statement);
 	sqlite3_free(query);
@@ -446,6 +523,7 @@ out:
 	{
 		g_object_unref(fin);
 	}
+	return ret;
 }
 
 Slackpkg::~Slackpkg () noexcept
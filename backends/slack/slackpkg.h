@@ -14,15 +14,16 @@ public:
 	~Slackpkg () noexcept;
 
 	GSList *collect_cache_info (const gchar *tmpl) noexcept;
-	void generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept;
+	gboolean generate_cache (PkBackendJob *job, const gchar *tmpl) noexcept;
 
 private:
 	static GHashTable *cat_map;
 	static const std::size_t max_buf_size = 8192;
 	gchar **priority = NULL;
 
-	void manifest (PkBackendJob *job,
-			const gchar *tmpl, gchar *filename) noexcept;
+	void manifest (PkBackendJob *job, const gchar *tmpl,
+			gchar *filename, GHashTable *missing) noexcept;
+	void checksums (PkBackendJob *job, const gchar *tmpl) noexcept;
 };
 
 }
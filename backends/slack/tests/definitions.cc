@@ -1,15 +1,53 @@
+#include <glib/gstdio.h>
 #include "pk-backend.h"
 #include <pk-backend-job.h>
+#include "definitions.h"
+
+/*
+ * Removes a temporary directory created by a test together with its
+ * contents and frees @dir_name.
+ */
+void
+slack_test_remove_dir (gchar *dir_name)
+{
+	const gchar *entry;
+	GDir *dir = g_dir_open (dir_name, 0, NULL);
+
+	while (dir && (entry = g_dir_read_name (dir)))
+	{
+		gchar *path = g_build_filename (dir_name, entry, NULL);
+
+		if (g_file_test (path, G_FILE_TEST_IS_DIR) && !g_file_test (path, G_FILE_TEST_IS_SYMLINK))
+		{
+			slack_test_remove_dir (path);
+		}
+		else
+		{
+			g_unlink (path);
+			g_free (path);
+		}
+	}
+	if (dir)
+	{
+		g_dir_close (dir);
+	}
+	g_rmdir (dir_name);
+	g_free (dir_name);
+}
+
+/* Tests pass the job data, e.g. the database to work on, this way */
+static gpointer job_user_data = NULL;
 
 gpointer
 pk_backend_job_get_user_data (PkBackendJob *job)
 {
-	return NULL;
+	return job_user_data;
 }
 
 void
 pk_backend_job_set_user_data (PkBackendJob *job, gpointer user_data)
 {
+	job_user_data = user_data;
 }
 
 void
@@ -0,0 +1,8 @@
+#ifndef __SLACK_TEST_DEFINITIONS_H
+#define __SLACK_TEST_DEFINITIONS_H
+
+#include <glib.h>
+
+void slack_test_remove_dir (gchar *dir_name);
+
+#endif /* __SLACK_TEST_DEFINITIONS_H */
@@ -0,0 +1,208 @@
+#include <string.h>
+#include "definitions.h"
+#include "fetch.h"
+
+using namespace slack;
+
+static const gsize large_size = 256 * 1024;
+
+struct FetchFixture
+{
+	gchar *mirror_dir;
+	gchar *dest_dir;
+	gchar *small_uri;
+	gchar *large_uri;
+	gchar *large_contents;
+	gchar *large_md5;
+};
+
+static gchar *
+slack_test_mirror_file (const gchar *dir_name, const gchar *name,
+		const gchar *contents, gssize len)
+{
+	gchar *path = g_build_filename (dir_name, name, NULL);
+	gchar *uri;
+
+	g_assert_true (g_file_set_contents (path, contents, len, NULL));
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (path);
+
+	return uri;
+}
+
+static void
+slack_test_fetch_setup (FetchFixture *fixture, gconstpointer user_data)
+{
+	fixture->mirror_dir = g_dir_make_tmp ("pk-slack-mirror-XXXXXX", NULL);
+	fixture->dest_dir = g_dir_make_tmp ("pk-slack-dest-XXXXXX", NULL);
+	g_assert_nonnull (fixture->mirror_dir);
+	g_assert_nonnull (fixture->dest_dir);
+
+	fixture->large_contents = static_cast<gchar *> (g_malloc (large_size));
+	for (gsize i = 0; i < large_size; i++)
+	{
+		fixture->large_contents[i] = 'a' + i % 26;
+	}
+	fixture->large_md5 = g_compute_checksum_for_data (G_CHECKSUM_MD5,
+			reinterpret_cast<guchar *> (fixture->large_contents), large_size);
+
+	fixture->small_uri = slack_test_mirror_file (fixture->mirror_dir,
+			"small-1.0-x86_64-1.txz", "small", -1);
+	fixture->large_uri = slack_test_mirror_file (fixture->mirror_dir,
+			"large-1.0-x86_64-1.txz", fixture->large_contents, large_size);
+}
+
+static void
+slack_test_fetch_teardown (FetchFixture *fixture, gconstpointer user_data)
+{
+	slack_test_remove_dir (fixture->mirror_dir);
+	slack_test_remove_dir (fixture->dest_dir);
+	g_free (fixture->small_uri);
+	g_free (fixture->large_uri);
+	g_free (fixture->large_contents);
+	g_free (fixture->large_md5);
+}
+
+static void
+slack_test_assert_file (const gchar *path, const gchar *expected, gsize expected_len)
+{
+	gchar *contents, *part;
+	gsize len;
+
+	g_assert_true (g_file_get_contents (path, &contents, &len, NULL));
+	g_assert_cmpmem (contents, len, expected, expected_len);
+	g_free (contents);
+
+	part = g_strconcat (path, ".part", NULL);
+	g_assert_false (g_file_test (part, G_FILE_TEST_EXISTS));
+	g_free (part);
+}
+
+static void
+slack_test_fetch_file_mirror (FetchFixture *fixture, gconstpointer user_data)
+{
+	Fetcher fetcher;
+	gchar *small_path = g_build_filename (fixture->dest_dir, "small.txz", NULL);
+	guint small_id = fetcher.add (fixture->small_uri, small_path);
+	guint large_id = fetcher.add (fixture->large_uri, fixture->dest_dir, fixture->large_md5);
+
+	g_assert_true (fetcher.run ());
+	g_assert_cmpint (fetcher.get_result (small_id), ==, CURLE_OK);
+	g_assert_cmpint (fetcher.get_result (large_id), ==, CURLE_OK);
+
+	/* A directory as destination keeps the file name */
+	g_assert_true (g_str_has_suffix (fetcher.get_dest (large_id), "/large-1.0-x86_64-1.txz"));
+
+	slack_test_assert_file (small_path, "small", 5);
+	slack_test_assert_file (fetcher.get_dest (large_id), fixture->large_contents, large_size);
+
+	g_free (small_path);
+}
+
+static void
+slack_test_fetch_checksum_mismatch (FetchFixture *fixture, gconstpointer user_data)
+{
+	Fetcher fetcher;
+	guint id = fetcher.add (fixture->small_uri, fixture->dest_dir,
+			"00000000000000000000000000000000");
+	gchar *part;
+
+	g_assert_false (fetcher.run ());
+	g_assert_cmpint (fetcher.get_result (id), !=, CURLE_OK);
+	g_assert_false (g_file_test (fetcher.get_dest (id), G_FILE_TEST_EXISTS));
+
+	part = g_strconcat (fetcher.get_dest (id), ".part", NULL);
+	g_assert_false (g_file_test (part, G_FILE_TEST_EXISTS));
+	g_free (part);
+}
+
+static void
+slack_test_fetch_resume (FetchFixture *fixture, gconstpointer user_data)
+{
+	Fetcher fetcher;
+	gchar *dest = g_build_filename (fixture->dest_dir, "large-1.0-x86_64-1.txz", NULL);
+	gchar *part = g_strconcat (dest, ".part", NULL);
+	guint id;
+
+	/* Left over from an interrupted download */
+	g_assert_true (g_file_set_contents (part, fixture->large_contents, large_size / 3, NULL));
+
+	id = fetcher.add (fixture->large_uri, dest, fixture->large_md5);
+	g_assert_true (fetcher.run ());
+	g_assert_cmpint (fetcher.get_result (id), ==, CURLE_OK);
+	slack_test_assert_file (dest, fixture->large_contents, large_size);
+
+	g_free (part);
+	g_free (dest);
+}
+
+static void
+slack_test_fetch_resume_tail (FetchFixture *fixture, gconstpointer user_data)
+{
+	Fetcher fetcher;
+	gchar *dest = g_build_filename (fixture->dest_dir, "large-1.0-x86_64-1.txz", NULL);
+	gchar *part = g_strconcat (dest, ".part", NULL);
+	gchar *expected = static_cast<gchar *> (g_memdup2 (fixture->large_contents, large_size));
+	guint id;
+
+	/*
+	 * The partial file differs from the mirror, so it only survives if just
+	 * the missing tail is requested
+	 */
+	memset (expected, 'Z', large_size / 3);
+	g_assert_true (g_file_set_contents (part, expected, large_size / 3, NULL));
+
+	id = fetcher.add (fixture->large_uri, dest);
+	g_assert_true (fetcher.run ());
+	g_assert_cmpint (fetcher.get_result (id), ==, CURLE_OK);
+	slack_test_assert_file (dest, expected, large_size);
+
+	g_free (expected);
+	g_free (part);
+	g_free (dest);
+}
+
+static void
+slack_test_fetch_missing (FetchFixture *fixture, gconstpointer user_data)
+{
+	Fetcher fetcher;
+	gchar *missing_uri = g_strconcat (fixture->small_uri, ".missing", NULL);
+	guint missing_id = fetcher.add (missing_uri, fixture->dest_dir);
+	guint small_id = fetcher.add (fixture->small_uri, fixture->dest_dir);
+	gchar *part;
+
+	/* One failed transfer doesn't stop the others */
+	g_assert_false (fetcher.run ());
+	g_assert_cmpint (fetcher.get_result (missing_id), !=, CURLE_OK);
+	g_assert_cmpint (fetcher.get_result (small_id), ==, CURLE_OK);
+
+	part = g_strconcat (fetcher.get_dest (missing_id), ".part", NULL);
+	g_assert_false (g_file_test (part, G_FILE_TEST_EXISTS));
+	g_free (part);
+	g_free (missing_uri);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gint ret;
+
+	g_test_init (&argc, &argv, NULL);
+	curl_global_init (CURL_GLOBAL_DEFAULT);
+
+	g_test_add ("/slack/fetch/file_mirror", FetchFixture, NULL,
+			slack_test_fetch_setup, slack_test_fetch_file_mirror, slack_test_fetch_teardown);
+	g_test_add ("/slack/fetch/checksum_mismatch", FetchFixture, NULL,
+			slack_test_fetch_setup, slack_test_fetch_checksum_mismatch, slack_test_fetch_teardown);
+	g_test_add ("/slack/fetch/resume", FetchFixture, NULL,
+			slack_test_fetch_setup, slack_test_fetch_resume, slack_test_fetch_teardown);
+	g_test_add ("/slack/fetch/resume_tail", FetchFixture, NULL,
+			slack_test_fetch_setup, slack_test_fetch_resume_tail, slack_test_fetch_teardown);
+	g_test_add ("/slack/fetch/missing", FetchFixture, NULL,
+			slack_test_fetch_setup, slack_test_fetch_missing, slack_test_fetch_teardown);
+
+	ret = g_test_run ();
+	curl_global_cleanup ();
+
+	return ret;
+}
@@ -1,7 +1,104 @@
+#include <glib/gstdio.h>
+#include "definitions.h"
 #include "job.h"
+#include "slackpkg.h"
+#include "utils.h"
 
 using namespace slack;
 
+static const guint n_packages = 20000;
+
+/* Schema of the shipped metadata.db */
+static const gchar *cache_schema =
+	"CREATE TABLE repos (repo_order INTEGER PRIMARY KEY AUTOINCREMENT,repo VARCHAR NOT NULL);"
+	"CREATE TABLE pkglist (full_name VARCHAR NOT NULL UNIQUE,name VARCHAR NOT NULL,"
+	"ver VARCHAR NOT NULL,arch VARCHAR DEFAULT NULL,ext VARCHAR DEFAULT NULL,"
+	"location VARCHAR DEFAULT '.',summary VARCHAR DEFAULT '',desc TEXT DEFAULT '',"
+	"compressed INT DEFAULT 0,uncompressed INT DEFAULT 0,cat VARCHAR DEFAULT 'unknown',"
+	"repo_order INTEGER REFERENCES repos(repo_order) ON DELETE CASCADE,"
+	"PRIMARY KEY (name, repo_order));"
+	"CREATE TABLE filelist (full_name VARCHAR NOT NULL REFERENCES pkglist(full_name) "
+	"ON DELETE CASCADE,filename VARCHAR NOT NULL,PRIMARY KEY (full_name, filename));"
+	"INSERT INTO repos (repo_order, repo) VALUES (1, 'slackware'), (2, 'extra');";
+
+/*
+ * Every third package is available in both repositories, the first one
+ * should win.
+ */
+static sqlite3 *
+test_cache_new (guint n)
+{
+	sqlite3 *db;
+	sqlite3_stmt *pkg_stmt, *file_stmt;
+
+	g_assert_cmpint (sqlite3_open (":memory:", &db), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_exec (db, cache_schema, NULL, NULL, NULL), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"INSERT INTO pkglist (full_name, name, ver, arch, ext, summary, desc, repo_order) "
+				"VALUES (?, ?, ?, 'x86_64', 'txz', 'Summary', ?, ?)",
+				-1, &pkg_stmt, NULL), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"INSERT INTO filelist (full_name, filename) VALUES (?, ?)",
+				-1, &file_stmt, NULL), ==, SQLITE_OK);
+
+	sqlite3_exec (db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+	for (guint i = 0; i < n; i++)
+	{
+		for (guint repo_order = 1; repo_order <= ((i % 3) ? 1 : 2); repo_order++)
+		{
+			gchar *name = g_strdup_printf ("package%u", i);
+			gchar *ver = g_strdup_printf ("1.%u", i);
+			gchar *full_name = g_strdup_printf ("%s-%s-x86_64-%u", name, ver, repo_order);
+			gchar *desc = g_strdup_printf ("Package number %u of the test repository (word%u)", i, i * 7);
+			gchar *filename = g_strdup_printf ("usr/bin/tool%u", i);
+
+			sqlite3_bind_text (pkg_stmt, 1, full_name, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (pkg_stmt, 2, name, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (pkg_stmt, 3, ver, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (pkg_stmt, 4, desc, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_int (pkg_stmt, 5, repo_order);
+			g_assert_cmpint (sqlite3_step (pkg_stmt), ==, SQLITE_DONE);
+			sqlite3_reset (pkg_stmt);
+
+			sqlite3_bind_text (file_stmt, 1, full_name, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (file_stmt, 2, filename, -1, SQLITE_TRANSIENT);
+			g_assert_cmpint (sqlite3_step (file_stmt), ==, SQLITE_DONE);
+			sqlite3_reset (file_stmt);
+
+			g_free (filename);
+			g_free (desc);
+			g_free (full_name);
+			g_free (ver);
+			g_free (name);
+		}
+	}
+	sqlite3_exec (db, "END TRANSACTION", NULL, NULL, NULL);
+
+	sqlite3_finalize (file_stmt);
+	sqlite3_finalize (pkg_stmt);
+
+	return db;
+}
+
+/* Runs the search query and returns the found package IDs joined by spaces */
+static gchar *
+test_search (sqlite3 *db, bool indexed, const gchar *column, const gchar *search)
+{
+	sqlite3_stmt *stmt;
+	GString *result = g_string_new (NULL);
+	gchar *query = sqlite3_mprintf (generate_query (0, indexed).c_str (), column, search);
+
+	g_assert_cmpint (sqlite3_prepare_v2 (db, query, -1, &stmt, NULL), ==, SQLITE_OK);
+	while (sqlite3_step (stmt) == SQLITE_ROW)
+	{
+		g_string_append_printf (result, "%s ", sqlite3_column_text (stmt, 0));
+	}
+	sqlite3_finalize (stmt);
+	sqlite3_free (query);
+
+	return g_string_free (result, FALSE);
+}
+
 static void
 test_filter_package_installed ()
 {
@@ -26,6 +123,424 @@ test_filter_package_none ()
 	g_assert_true (filter_package (filters, true));
 }
 
+static void
+test_search_index_winner ()
+{
+	sqlite3 *db = test_cache_new (4);
+	gchar *result;
+
+	create_search_index (db);
+
+	result = test_search (db, false, "name", "package3");
+	g_assert_cmpstr (result, ==, "package3;1.3;x86_64;slackware ");
+	g_free (result);
+
+	/* The index is refreshed together with the cache */
+	sqlite3_exec (db, "DELETE FROM pkglist WHERE name = 'package3' AND repo_order = 1",
+			NULL, NULL, NULL);
+	rebuild_search_index (db);
+
+	result = test_search (db, false, "name", "package3");
+	g_assert_cmpstr (result, ==, "package3;1.3;x86_64;extra ");
+	g_free (result);
+
+	sqlite3_close (db);
+}
+
+static void
+test_search_index_query ()
+{
+	sqlite3 *db = test_cache_new (100);
+	const gchar *searches[] = { "package1", "NUMBER 4%word", "word7", "number%repository", "xyz", NULL };
+
+	if (!create_search_index (db))
+	{
+		g_test_skip ("SQLite is built without FTS5");
+		sqlite3_close (db);
+		return;
+	}
+
+	for (const gchar **search = searches; *search; search++)
+	{
+		gchar *expected = test_search (db, false, "desc", *search);
+		gchar *result = test_search (db, true, "desc", *search);
+
+		g_assert_cmpstr (result, ==, expected);
+		g_free (result);
+		g_free (expected);
+	}
+
+	sqlite3_close (db);
+}
+
+static void
+test_search_index_use ()
+{
+	sqlite3 *db = test_cache_new (1);
+	gchar *short_vals[] = { (gchar *) "ab", (gchar *) "c", NULL };
+	gchar *long_vals[] = { (gchar *) "ab", (gchar *) "cde", NULL };
+	bool indexed = create_search_index (db);
+
+	g_assert_false (use_search_index (db, short_vals));
+	g_assert_true (use_search_index (db, long_vals) == indexed);
+
+	sqlite3_close (db);
+}
+
+/*
+ * A search used to scan the whole package list and look up the repository
+ * order for each row; the index only visits the matching packages.
+ */
+static void
+test_search_index_many ()
+{
+	sqlite3 *db = test_cache_new (n_packages);
+	GTimer *timer = g_timer_new ();
+	gchar *expected, *result;
+	gdouble scan_time, index_time;
+
+	if (!create_search_index (db))
+	{
+		g_test_skip ("SQLite is built without FTS5");
+		g_timer_destroy (timer);
+		sqlite3_close (db);
+		return;
+	}
+	g_test_message ("%u packages indexed in %.3fs", n_packages, g_timer_elapsed (timer, NULL));
+
+	g_timer_start (timer);
+	expected = test_search (db, false, "desc", "word7007");
+	scan_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	result = test_search (db, true, "desc", "word7007");
+	index_time = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpstr (result, ==, expected);
+	g_test_message ("Search without index: %.4fs, with index: %.4fs", scan_time, index_time);
+	if (g_test_perf ())
+	{
+		g_assert_cmpfloat (index_time, <, scan_time);
+	}
+
+	g_free (result);
+	g_free (expected);
+	g_timer_destroy (timer);
+	sqlite3_close (db);
+}
+
+static void
+test_updates_query ()
+{
+	sqlite3 *db = test_cache_new (4);
+	sqlite3_stmt *stmt;
+	GString *result = g_string_new (NULL);
+	gchar *dir_name = g_dir_make_tmp ("pk-slack-test-XXXXXX", NULL);
+	const gchar *installed_names[] = {
+		"package0-1.0-x86_64-1", /* Up to date */
+		"package1-0.9-x86_64-1", /* Older version */
+		"package2-1.10-x86_64-1", /* Newer than 1.2 */
+		"package3-1.3-x86_64-0", /* Older build */
+		"other-1.0-noarch-1", /* Not in the repositories */
+		NULL
+	};
+
+	g_assert_nonnull (dir_name);
+	for (const gchar **name = installed_names; *name; name++)
+	{
+		gchar *path = g_build_filename (dir_name, *name, NULL);
+
+		g_assert_true (g_file_set_contents (path, "", 0, NULL));
+		g_free (path);
+	}
+	InstalledPackages installed (dir_name);
+
+	create_search_index (db);
+	g_assert_true (create_version_collation (db));
+	g_assert_true (installed.stage (db));
+
+	g_assert_cmpint (sqlite3_prepare_v2 (db, updates_query (), -1, &stmt, NULL), ==, SQLITE_OK);
+	while (sqlite3_step (stmt) == SQLITE_ROW)
+	{
+		g_string_append_printf (result, "%s ", sqlite3_column_text (stmt, 0));
+	}
+	g_assert_cmpstr (result->str, ==, "package1-1.1-x86_64-1 package3-1.3-x86_64-1 ");
+
+	/* Obsolete packages are reported regardless of the version */
+	sqlite3_exec (db, "UPDATE pkglist SET ext = 'obsolete' WHERE name = 'package0'",
+			NULL, NULL, NULL);
+	g_string_truncate (result, 0);
+	sqlite3_reset (stmt);
+	while (sqlite3_step (stmt) == SQLITE_ROW)
+	{
+		g_string_append_printf (result, "%s:%s ", sqlite3_column_text (stmt, 7), sqlite3_column_text (stmt, 8));
+	}
+	g_assert_cmpstr (result->str, ==, "package0:1.0 package1:0.9 package3:1.3 ");
+	sqlite3_finalize (stmt);
+
+	slack_test_remove_dir (dir_name);
+	g_string_free (result, TRUE);
+	sqlite3_close (db);
+}
+
+/* Schema of the shipped metadata.db with the columns added on startup */
+static const gchar *metadata_schema =
+	"CREATE TABLE repos (repo_order INTEGER PRIMARY KEY AUTOINCREMENT,repo VARCHAR NOT NULL,"
+	"checksum VARCHAR DEFAULT NULL);"
+	"CREATE TABLE pkglist (full_name VARCHAR NOT NULL UNIQUE,name VARCHAR NOT NULL,"
+	"ver VARCHAR NOT NULL,arch VARCHAR DEFAULT NULL,ext VARCHAR DEFAULT NULL,"
+	"location VARCHAR DEFAULT '.',summary VARCHAR DEFAULT '',desc TEXT DEFAULT '',"
+	"compressed INT DEFAULT 0,uncompressed INT DEFAULT 0,cat VARCHAR DEFAULT 'unknown',"
+	"repo_order INTEGER REFERENCES repos(repo_order) ON DELETE CASCADE,"
+	"md5 VARCHAR DEFAULT NULL,PRIMARY KEY (name, repo_order));"
+	"CREATE TABLE collections (name VARCHAR NOT NULL,repo_order INTEGER NOT NULL,"
+	"collection_pkg VARCHAR NOT NULL,PRIMARY KEY (name, repo_order, collection_pkg)"
+	"FOREIGN KEY (name, repo_order) REFERENCES pkglist(name, repo_order) ON DELETE CASCADE);"
+	"CREATE TABLE filelist (full_name VARCHAR NOT NULL REFERENCES pkglist(full_name) "
+	"ON DELETE CASCADE,filename VARCHAR NOT NULL,PRIMARY KEY (full_name, filename));";
+
+static void
+test_write_packages_txt (const gchar *path, const gchar **packages)
+{
+	GString *contents = g_string_new (NULL);
+
+	/* Name, summary */
+	for (const gchar **package = packages; *package; package += 2)
+	{
+		gchar **tokens = split_package_name (*package);
+
+		g_string_append_printf (contents,
+				"PACKAGE NAME:  %s\n"
+				"PACKAGE LOCATION:  ./slackware64/a\n"
+				"PACKAGE SIZE (compressed):  100 K\n"
+				"PACKAGE SIZE (uncompressed):  200 K\n"
+				"PACKAGE DESCRIPTION:\n"
+				"%s: %s (%s)\n"
+				"%s:\n"
+				"%s: Test package.\n"
+				"\n",
+				*package, tokens[0], tokens[0], *(package + 1), tokens[0], tokens[0]);
+		g_strfreev (tokens);
+	}
+	g_assert_true (g_file_set_contents (path, contents->str, -1, NULL));
+	g_string_free (contents, TRUE);
+}
+
+/* Returns "full_name:summary" of all packages joined by spaces */
+static gchar *
+test_dump_pkglist (sqlite3 *db)
+{
+	sqlite3_stmt *stmt;
+	GString *result = g_string_new (NULL);
+
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"SELECT full_name, summary FROM pkglist ORDER BY full_name",
+				-1, &stmt, NULL), ==, SQLITE_OK);
+	while (sqlite3_step (stmt) == SQLITE_ROW)
+	{
+		g_string_append_printf (result, "%s:%s ",
+				sqlite3_column_text (stmt, 0),
+				sqlite3_column_text (stmt, 1));
+	}
+	sqlite3_finalize (stmt);
+
+	return g_string_free (result, FALSE);
+}
+
+/* The row ID tells whether a row was updated in place or inserted anew */
+static sqlite3_int64
+test_pkglist_rowid (sqlite3 *db, const gchar *full_name)
+{
+	sqlite3_stmt *stmt;
+	sqlite3_int64 rowid = 0;
+
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"SELECT rowid FROM pkglist WHERE full_name = @full_name",
+				-1, &stmt, NULL), ==, SQLITE_OK);
+	sqlite3_bind_text (stmt, 1, full_name, -1, SQLITE_STATIC);
+	if (sqlite3_step (stmt) == SQLITE_ROW)
+	{
+		rowid = sqlite3_column_int64 (stmt, 0);
+	}
+	sqlite3_finalize (stmt);
+
+	return rowid;
+}
+
+/*
+ * A changed PACKAGES.TXT is merged row by row: packages that are gone are
+ * deleted, changed ones are updated in place and only new ones inserted.
+ */
+static void
+test_apply_cache ()
+{
+	JobData job_data = {};
+	sqlite3 *db;
+	gchar *tmpl = g_dir_make_tmp ("pk-slack-test-XXXXXX", NULL);
+	gchar *repo_dir = g_build_filename (tmpl, "slackware", NULL);
+	gchar *packages_txt = g_build_filename (repo_dir, "PACKAGES.TXT", NULL);
+	gchar *result;
+	sqlite3_int64 keep_rowid, change_rowid, max_rowid;
+	auto slackpkg = new Slackpkg ("slackware", "file:///", 1, NULL,
+			g_strsplit ("slackware64", ",", 0));
+	const gchar *old_packages[] = {
+		"keep-1.0-x86_64-1.txz", "Unchanged",
+		"change-1.0-x86_64-1.txz", "Old summary",
+		"gone-1.0-x86_64-1.txz", "Removed",
+		NULL
+	};
+	const gchar *new_packages[] = {
+		"keep-1.0-x86_64-1.txz", "Unchanged",
+		"change-1.0-x86_64-1.txz", "New summary",
+		"new-1.0-x86_64-1.txz", "Added",
+		NULL
+	};
+
+	g_assert_cmpint (sqlite3_open (":memory:", &db), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_exec (db, metadata_schema, NULL, NULL, NULL), ==, SQLITE_OK);
+	job_data.db = db;
+	pk_backend_job_set_user_data (NULL, &job_data);
+
+	g_assert_cmpint (g_mkdir (repo_dir, 0755), ==, 0);
+	test_write_packages_txt (packages_txt, old_packages);
+	g_assert_true (slackpkg->update_cache (NULL, tmpl));
+
+	result = test_dump_pkglist (db);
+	g_assert_cmpstr (result, ==,
+			"change-1.0-x86_64-1:Old summary "
+			"gone-1.0-x86_64-1:Removed "
+			"keep-1.0-x86_64-1:Unchanged ");
+	g_free (result);
+	keep_rowid = test_pkglist_rowid (db, "keep-1.0-x86_64-1");
+	change_rowid = test_pkglist_rowid (db, "change-1.0-x86_64-1");
+	max_rowid = MAX (MAX (keep_rowid, change_rowid), test_pkglist_rowid (db, "gone-1.0-x86_64-1"));
+	sqlite3_exec (db, "INSERT INTO filelist (full_name, filename) "
+			"VALUES ('keep-1.0-x86_64-1', 'usr/bin/keep')", NULL, NULL, NULL);
+
+	/* Unchanged metadata aren't merged again */
+	g_assert_false (slackpkg->update_cache (NULL, tmpl));
+
+	test_write_packages_txt (packages_txt, new_packages);
+	g_assert_true (slackpkg->update_cache (NULL, tmpl));
+
+	result = test_dump_pkglist (db);
+	g_assert_cmpstr (result, ==,
+			"change-1.0-x86_64-1:New summary "
+			"keep-1.0-x86_64-1:Unchanged "
+			"new-1.0-x86_64-1:Added ");
+	g_free (result);
+
+	/* Existing rows were kept or updated in place, only the new one was inserted */
+	g_assert_cmpint (test_pkglist_rowid (db, "keep-1.0-x86_64-1"), ==, keep_rowid);
+	g_assert_cmpint (test_pkglist_rowid (db, "change-1.0-x86_64-1"), ==, change_rowid);
+	g_assert_cmpint (test_pkglist_rowid (db, "new-1.0-x86_64-1"), >, max_rowid);
+
+	/* The untouched package kept its file list */
+	sqlite3_stmt *stmt;
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"SELECT filename FROM filelist WHERE full_name = 'keep-1.0-x86_64-1'",
+				-1, &stmt, NULL), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_step (stmt), ==, SQLITE_ROW);
+	g_assert_cmpstr ((const gchar *) sqlite3_column_text (stmt, 0), ==, "usr/bin/keep");
+	sqlite3_finalize (stmt);
+
+	pk_backend_job_set_user_data (NULL, NULL);
+	delete slackpkg;
+	sqlite3_close (db);
+
+	slack_test_remove_dir (tmpl);
+	g_free (packages_txt);
+	g_free (repo_dir);
+}
+
+/*
+ * Two repositories providing the same package: the one with the higher
+ * order gets it, and a refresh of the other one doesn't take it away.
+ */
+static void
+test_apply_cache_shared ()
+{
+	JobData job_data = {};
+	sqlite3 *db;
+	gchar *tmpl = g_dir_make_tmp ("pk-slack-test-XXXXXX", NULL);
+	gchar *first_dir = g_build_filename (tmpl, "slackware", NULL);
+	gchar *second_dir = g_build_filename (tmpl, "extra", NULL);
+	gchar *first_txt = g_build_filename (first_dir, "PACKAGES.TXT", NULL);
+	gchar *second_txt = g_build_filename (second_dir, "PACKAGES.TXT", NULL);
+	gchar *result;
+	sqlite3_stmt *stmt;
+	auto first = new Slackpkg ("slackware", "file:///", 1, NULL,
+			g_strsplit ("slackware64", ",", 0));
+	auto second = new Slackpkg ("extra", "file:///", 2, NULL,
+			g_strsplit ("slackware64", ",", 0));
+	const gchar *first_packages[] = {
+		"shared-1.0-x86_64-1.txz", "First",
+		NULL
+	};
+	const gchar *first_changed[] = {
+		"shared-1.0-x86_64-1.txz", "First",
+		"first-1.0-x86_64-1.txz", "Added",
+		NULL
+	};
+	const gchar *second_packages[] = {
+		"shared-1.0-x86_64-1.txz", "Second",
+		NULL
+	};
+
+	g_assert_cmpint (sqlite3_open (":memory:", &db), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_exec (db, metadata_schema, NULL, NULL, NULL), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_exec (db, "PRAGMA foreign_keys = ON", NULL, NULL, NULL), ==, SQLITE_OK);
+	job_data.db = db;
+	pk_backend_job_set_user_data (NULL, &job_data);
+
+	g_assert_cmpint (g_mkdir (first_dir, 0755), ==, 0);
+	g_assert_cmpint (g_mkdir (second_dir, 0755), ==, 0);
+	test_write_packages_txt (first_txt, first_packages);
+	test_write_packages_txt (second_txt, second_packages);
+	g_assert_true (first->update_cache (NULL, tmpl));
+	g_assert_true (second->update_cache (NULL, tmpl));
+
+	result = test_dump_pkglist (db);
+	g_assert_cmpstr (result, ==, "shared-1.0-x86_64-1:Second ");
+	g_free (result);
+	g_assert_cmpint (sqlite3_exec (db, "INSERT INTO filelist (full_name, filename) "
+				"VALUES ('shared-1.0-x86_64-1', 'usr/bin/shared')", NULL, NULL, NULL), ==, SQLITE_OK);
+
+	/* The first repository changed, the second one is skipped */
+	test_write_packages_txt (first_txt, first_changed);
+	g_assert_true (first->update_cache (NULL, tmpl));
+	g_assert_false (second->update_cache (NULL, tmpl));
+
+	result = test_dump_pkglist (db);
+	g_assert_cmpstr (result, ==, "first-1.0-x86_64-1:Added shared-1.0-x86_64-1:Second ");
+	g_free (result);
+
+	/* The second repository kept its row and the file list */
+	g_assert_cmpint (sqlite3_prepare_v2 (db,
+				"SELECT p.repo_order, f.filename FROM pkglist AS p "
+				"JOIN filelist AS f ON f.full_name = p.full_name "
+				"WHERE p.full_name = 'shared-1.0-x86_64-1'",
+				-1, &stmt, NULL), ==, SQLITE_OK);
+	g_assert_cmpint (sqlite3_step (stmt), ==, SQLITE_ROW);
+	g_assert_cmpint (sqlite3_column_int (stmt, 0), ==, 2);
+	g_assert_cmpstr ((const gchar *) sqlite3_column_text (stmt, 1), ==, "usr/bin/shared");
+	sqlite3_finalize (stmt);
+
+	/* The first repository is read again until it gets the package back */
+	g_assert_true (first->update_cache (NULL, tmpl));
+
+	pk_backend_job_set_user_data (NULL, NULL);
+	delete first;
+	delete second;
+	sqlite3_close (db);
+
+	slack_test_remove_dir (tmpl);
+	g_free (second_txt);
+	g_free (first_txt);
+	g_free (second_dir);
+	g_free (first_dir);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -34,6 +549,13 @@ main (int argc, char *argv[])
 	g_test_add_func ("/slack/filter_package_installed", test_filter_package_installed);
 	g_test_add_func ("/slack/filter_package_not_installed", test_filter_package_not_installed);
 	g_test_add_func ("/slack/filter_package_none", test_filter_package_none);
+	g_test_add_func ("/slack/search_index/winner", test_search_index_winner);
+	g_test_add_func ("/slack/search_index/query", test_search_index_query);
+	g_test_add_func ("/slack/search_index/use", test_search_index_use);
+	g_test_add_func ("/slack/search_index/many", test_search_index_many);
+	g_test_add_func ("/slack/updates_query", test_updates_query);
+	g_test_add_func ("/slack/apply_cache", test_apply_cache);
+	g_test_add_func ("/slack/apply_cache/shared", test_apply_cache_shared);
 
 	return g_test_run ();
 }
@@ -1,3 +1,5 @@
+#include <glib/gstdio.h>
+#include "definitions.h"
 #include "slackpkg.h"
 
 using namespace slack;
@@ -15,11 +17,53 @@ slack_test_slackpkg_construct()
 	delete slackpkg;
 }
 
+static void
+slack_test_slackpkg_cache_checksum()
+{
+	gchar *tmpl = g_dir_make_tmp ("pk-slack-test-XXXXXX", NULL);
+	gchar *repo_dir = g_build_filename (tmpl, "some", NULL);
+	gchar *packages_txt = g_build_filename (repo_dir, "PACKAGES.TXT", NULL);
+	gchar *checksum, *other_checksum;
+	auto slackpkg = new Slackpkg ("some", "mirror", 1, NULL, NULL);
+	auto reordered = new Slackpkg ("some", "mirror", 2, NULL, NULL);
+
+	/* Nothing downloaded */
+	g_assert_null (slackpkg->cache_checksum (tmpl));
+
+	g_assert_cmpint (g_mkdir (repo_dir, 0755), ==, 0);
+	g_assert_true (g_file_set_contents (packages_txt, "PACKAGE NAME:  a-1.0-x86_64-1.txz\n", -1, NULL));
+
+	checksum = slackpkg->cache_checksum (tmpl);
+	g_assert_nonnull (checksum);
+	other_checksum = slackpkg->cache_checksum (tmpl);
+	g_assert_cmpstr (checksum, ==, other_checksum);
+	g_free (other_checksum);
+
+	/* The repository order changes the generated cache */
+	other_checksum = reordered->cache_checksum (tmpl);
+	g_assert_cmpstr (checksum, !=, other_checksum);
+	g_free (other_checksum);
+
+	g_assert_true (g_file_set_contents (packages_txt, "PACKAGE NAME:  a-1.1-x86_64-1.txz\n", -1, NULL));
+	other_checksum = slackpkg->cache_checksum (tmpl);
+	g_assert_cmpstr (checksum, !=, other_checksum);
+	g_free (other_checksum);
+
+	g_free (checksum);
+	delete reordered;
+	delete slackpkg;
+
+	slack_test_remove_dir (tmpl);
+	g_free (packages_txt);
+	g_free (repo_dir);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/slack/slackpkg/construct", slack_test_slackpkg_construct);
+	g_test_add_func("/slack/slackpkg/cache_checksum", slack_test_slackpkg_cache_checksum);
 
 	return g_test_run();
 }
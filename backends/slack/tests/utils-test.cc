@@ -0,0 +1,108 @@
+#include "definitions.h"
+#include "utils.h"
+
+using namespace slack;
+
+static const guint n_installed = 5000;
+
+static gchar *
+slack_test_fake_packages_new (guint n)
+{
+	gchar *dir_name = g_dir_make_tmp ("pk-slack-test-XXXXXX", NULL);
+
+	g_assert_nonnull (dir_name);
+
+	for (guint i = 0; i < n; i++)
+	{
+		gchar *pkg_fullname = g_strdup_printf ("package-%u-1.%u-x86_64-1", i, i);
+		gchar *path = g_build_filename (dir_name, pkg_fullname, NULL);
+
+		g_assert_true (g_file_set_contents (path, "", 0, NULL));
+
+		g_free (path);
+		g_free (pkg_fullname);
+	}
+	return dir_name;
+}
+
+static void
+slack_test_installed_packages_lookup ()
+{
+	gchar *dir_name = slack_test_fake_packages_new (3);
+	InstalledPackages installed (dir_name);
+
+	g_assert_true (installed.is_valid ());
+	g_assert_cmpint (installed.lookup ("package-1-1.1-x86_64-1"), ==, PK_INFO_ENUM_INSTALLED);
+	g_assert_cmpint (installed.lookup ("package-1-1.2-x86_64-1"), ==, PK_INFO_ENUM_UPDATING);
+	g_assert_cmpint (installed.lookup ("package-1-1.1-x86_64-2"), ==, PK_INFO_ENUM_UPDATING);
+	g_assert_cmpint (installed.lookup ("package-3-1.3-x86_64-1"), ==, PK_INFO_ENUM_INSTALLING);
+	g_assert_cmpint (installed.lookup ("package"), ==, PK_INFO_ENUM_UNKNOWN);
+
+	slack_test_remove_dir (dir_name);
+}
+
+static void
+slack_test_installed_packages_missing_dir ()
+{
+	InstalledPackages installed ("/nonexistent/var/log/packages");
+
+	g_assert_false (installed.is_valid ());
+	g_assert_cmpint (installed.lookup ("package-1-1.1-x86_64-1"), ==, PK_INFO_ENUM_UNKNOWN);
+}
+
+/*
+ * Looking up every installed package used to read the whole metadata
+ * directory per lookup; the index reads it once.
+ */
+static void
+slack_test_installed_packages_many ()
+{
+	gchar *dir_name = slack_test_fake_packages_new (n_installed);
+	GTimer *timer = g_timer_new ();
+	InstalledPackages installed (dir_name);
+	gdouble build_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (guint i = 0; i < n_installed; i++)
+	{
+		gchar *pkg_fullname = g_strdup_printf ("package-%u-1.%u-x86_64-2", i, i);
+
+		g_assert_cmpint (installed.lookup (pkg_fullname), ==, PK_INFO_ENUM_UPDATING);
+		g_free (pkg_fullname);
+	}
+	g_test_message ("%u packages: index built in %.3fs, %u lookups in %.3fs",
+			n_installed, build_time, n_installed, g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+	slack_test_remove_dir (dir_name);
+}
+
+static void
+slack_test_compare_versions ()
+{
+	g_assert_cmpint (compare_versions ("1.10", -1, "1.9", -1), >, 0);
+	g_assert_cmpint (compare_versions ("1.9", -1, "1.9rc1", -1), <, 0);
+	g_assert_cmpint (compare_versions ("1.9rc1", -1, "1.9rc2", -1), <, 0);
+	g_assert_cmpint (compare_versions ("2.0", -1, "2.0.1", -1), <, 0);
+	g_assert_cmpint (compare_versions ("1.01", -1, "1.1", -1), ==, 0);
+	g_assert_cmpint (compare_versions ("1_0", -1, "1.0", -1), ==, 0);
+	g_assert_cmpint (compare_versions ("1a", -1, "1.1", -1), <, 0);
+	g_assert_cmpint (compare_versions ("2_slack15.0", -1, "1_slack15.0", -1), >, 0);
+	g_assert_cmpint (compare_versions ("20240101", -1, "20231231", -1), >, 0);
+
+	/* Only the given length is compared */
+	g_assert_cmpint (compare_versions ("1.2.3", 3, "1.2", -1), ==, 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/slack/installed_packages/lookup", slack_test_installed_packages_lookup);
+	g_test_add_func ("/slack/installed_packages/missing_dir", slack_test_installed_packages_missing_dir);
+	g_test_add_func ("/slack/installed_packages/many", slack_test_installed_packages_many);
+	g_test_add_func ("/slack/compare_versions", slack_test_compare_versions);
+
+	return g_test_run ();
+}
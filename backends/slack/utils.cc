@@ -1,3 +1,4 @@
+#include <glib/gstdio.h>
 #include <sqlite3.h>
 #include <string.h>
 #include "utils.h"
@@ -118,103 +119,282 @@ split_package_name (const gchar *pkg_filename)
 	return pkg_tokens;
 }
 
+/*
+ * Returns the length of the package name in a full package name
+ * (name-version-arch-build), or -1 if it is malformed.
+ */
+static gssize
+package_name_length (const gchar *pkg_fullname)
+{
+	const gchar *it;
+	guint8 dashes = 0;
+
+	for (it = pkg_fullname + strlen(pkg_fullname); it != pkg_fullname; --it)
+	{
+		if (*it == '-')
+		{
+			if (dashes == 2)
+			{
+				return it - pkg_fullname;
+			}
+			++dashes;
+		}
+	}
+	return -1;
+}
+
 /**
- * slack::is_installed:
- * Checks if a package is already installed in the system.
+ * slack::InstalledPackages::InstalledPackages:
+ * @pkg_metadata_dir: Directory with a file per installed package.
+ **/
+InstalledPackages::InstalledPackages (const gchar *pkg_metadata_dir) noexcept
+{
+	GDir *dir;
+	const gchar *entry;
+
+	if (!(dir = g_dir_open(pkg_metadata_dir, 0, NULL)))
+	{
+		return;
+	}
+
+	while ((entry = g_dir_read_name(dir)))
+	{
+		gssize pkg_name = package_name_length(entry);
+
+		if (pkg_name > 0)
+		{
+			packages.emplace(std::string(entry, pkg_name), entry);
+		}
+	}
+	g_dir_close(dir);
+	valid = TRUE;
+}
+
+/**
+ * slack::InstalledPackages::get:
  *
- * Params:
- * 	pkg_fullname = Package name should be looked for.
+ * Returns the index of /var/log/packages. It is shared between jobs and
+ * only built again after a package has been installed or removed.
+ **/
+std::shared_ptr<const InstalledPackages>
+InstalledPackages::get () noexcept
+{
+	static GMutex mutex;
+	static std::shared_ptr<const InstalledPackages> cached;
+	static gint64 cached_mtime = -1;
+	GStatBuf st;
+	gint64 mtime = -1;
+
+	if (g_stat("/var/log/packages", &st) == 0)
+	{
+		mtime = st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+	}
+
+	g_mutex_lock(&mutex);
+	if (!cached || mtime == -1 || mtime != cached_mtime)
+	{
+		cached = std::make_shared<const InstalledPackages> ("/var/log/packages");
+		cached_mtime = mtime;
+	}
+	auto ret = cached;
+	g_mutex_unlock(&mutex);
+
+	return ret;
+}
+
+gboolean
+InstalledPackages::is_valid () const noexcept
+{
+	return valid;
+}
+
+/**
+ * slack::InstalledPackages::lookup:
+ * @pkg_fullname: Package name should be looked for.
  *
- * Returns: PK_INFO_ENUM_INSTALLING if pkg_fullname is already installed,
- *          PK_INFO_ENUM_UPDATING if an elder version of pkg_fullname is
- *          installed, PK_INFO_ENUM_UNKNOWN if pkg_fullname is malformed.
+ * Returns: See slack::is_installed().
  **/
 PkInfoEnum
-is_installed (const gchar *pkg_fullname)
+InstalledPackages::lookup (const gchar *pkg_fullname) const noexcept
 {
-	GFileEnumerator *pkg_metadata_enumerator;
-	GFileInfo *pkg_metadata_file_info;
-	GFile *pkg_metadata_dir;
 	PkInfoEnum ret = PK_INFO_ENUM_INSTALLING;
-    const gchar *it;
-    guint8 dashes = 0;
-	ptrdiff_t pkg_name;
 
 	g_return_val_if_fail(pkg_fullname != NULL, PK_INFO_ENUM_UNKNOWN);
 
-    // We want to find the package name without version for the package we're
-    // looking for.
-    g_debug("Looking if %s is installed", pkg_fullname);
-
-    for (it = pkg_fullname + strlen(pkg_fullname); it != pkg_fullname; --it)
-    {
-        if (*it == '-')
-        {
-            if (dashes == 2)
-            {
-                break;
-            }
-            ++dashes;
-        }
-    }
-	if (dashes < 2)
+	gssize pkg_name = package_name_length(pkg_fullname);
+	if (pkg_name < 0 || !valid)
 	{
 		return PK_INFO_ENUM_UNKNOWN;
 	}
-    pkg_name = it - pkg_fullname;
 
-	// Read the package metadata directory and comprare all installed packages
-    // with ones in the cache.
-	pkg_metadata_dir = g_file_new_for_path("/var/log/packages");
-	if (!(pkg_metadata_enumerator = g_file_enumerate_children(pkg_metadata_dir,
-	                                                          "standard::name",
-	                                                          G_FILE_QUERY_INFO_NONE,
-	                                                          NULL,
-	                                                          NULL)))
+	auto range = packages.equal_range(std::string(pkg_fullname, pkg_name));
+	for (auto it = range.first; it != range.second; ++it)
 	{
-		g_object_unref(pkg_metadata_dir);
-		return PK_INFO_ENUM_UNKNOWN;
+		if (it->second == pkg_fullname)
+		{
+			return PK_INFO_ENUM_INSTALLED;
+		}
+		ret = PK_INFO_ENUM_UPDATING;
 	}
 
-	while ((pkg_metadata_file_info = g_file_enumerator_next_file(pkg_metadata_enumerator, NULL, NULL)))
+	return ret;
+}
+
+/**
+ * slack::InstalledPackages::stage:
+ * @db: Metadata database.
+ *
+ * Copies the index into the temporary table "installed" (full_name, name,
+ * ver, arch), so it can be joined with the package list.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ **/
+gboolean
+InstalledPackages::stage (sqlite3 *db) const noexcept
+{
+	sqlite3_stmt *stmt;
+	gboolean ret = TRUE;
+
+	if ((sqlite3_exec(db,
+	                  "CREATE TEMP TABLE IF NOT EXISTS installed (full_name VARCHAR PRIMARY KEY, "
+	                  "name VARCHAR NOT NULL, ver VARCHAR NOT NULL, arch VARCHAR NOT NULL);"
+	                  "DELETE FROM temp.installed",
+	                  NULL, NULL, NULL) != SQLITE_OK)
+	 || (sqlite3_prepare_v2(db,
+	                        "INSERT OR IGNORE INTO temp.installed (full_name, name, ver, arch) "
+	                        "VALUES (@full_name, @name, @ver, @arch)",
+	                        -1,
+	                        &stmt,
+	                        NULL) != SQLITE_OK))
+	{
+		return FALSE;
+	}
+
+	sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+	for (const auto &package : packages)
+	{
+		gchar **tokens = split_package_name(package.second.c_str());
+
+		sqlite3_bind_text(stmt, 1, package.second.c_str(), -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, package.first.c_str(), -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 3, tokens[1], -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 4, tokens[2], -1, SQLITE_TRANSIENT);
+		if (sqlite3_step(stmt) != SQLITE_DONE)
+		{
+			ret = FALSE;
+		}
+		sqlite3_clear_bindings(stmt);
+		sqlite3_reset(stmt);
+
+		g_strfreev(tokens);
+	}
+	sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
+	sqlite3_finalize(stmt);
+
+	return ret;
+}
+
+/**
+ * slack::compare_versions:
+ * @a: Version string.
+ * @a_len: Length of @a or -1 if it is nul-terminated.
+ * @b: Version string.
+ * @b_len: Length of @b or -1 if it is nul-terminated.
+ *
+ * Compares two version strings or build numbers segment by segment. Numeric
+ * segments are compared as numbers, alphabetic ones as strings; a numeric
+ * segment is newer than an alphabetic one, and a version with more segments
+ * is newer than its prefix, so 1.10 > 1.9rc1 > 1.9.
+ *
+ * Returns: A negative value if @a is older than @b, zero if they are
+ *          equal, a positive value if @a is newer.
+ **/
+gint
+compare_versions (const gchar *a, gssize a_len, const gchar *b, gssize b_len)
+{
+	const gchar *a_end = a + (a_len < 0 ? strlen(a) : a_len);
+	const gchar *b_end = b + (b_len < 0 ? strlen(b) : b_len);
+
+	while (TRUE)
 	{
-		const gchar *dir = g_file_info_get_name(pkg_metadata_file_info);
-        dashes = 0;
+		const gchar *a_segment, *b_segment;
+		gsize a_segment_len, b_segment_len;
+		gboolean numeric;
+		gint ret;
 
-        if (strcmp(dir, pkg_fullname) == 0)
-        {
-            ret = PK_INFO_ENUM_INSTALLED;
-        }
-		else
+		while ((a != a_end) && !g_ascii_isalnum(*a))
+		{
+			++a;
+		}
+		while ((b != b_end) && !g_ascii_isalnum(*b))
 		{
-			for (it = dir + strlen(dir); it != dir; --it)
+			++b;
+		}
+		if ((a == a_end) || (b == b_end))
+		{
+			break;
+		}
+
+		numeric = g_ascii_isdigit(*a);
+		if (numeric != g_ascii_isdigit(*b))
+		{
+			return numeric ? 1 : -1;
+		}
+		if (numeric)
+		{ /* Leading zeros don't count */
+			while ((a != a_end - 1) && (*a == '0') && g_ascii_isdigit(a[1]))
 			{
-				if (*it == '-')
-				{
-					if (dashes == 2)
-					{
-						break;
-					}
-					++dashes;
-				}
+				++a;
 			}
-			if (pkg_name == (it - dir) && strncmp(pkg_fullname, dir, pkg_name) == 0)
+			while ((b != b_end - 1) && (*b == '0') && g_ascii_isdigit(b[1]))
 			{
-				ret = PK_INFO_ENUM_UPDATING;
+				++b;
 			}
-
 		}
-		g_object_unref(pkg_metadata_file_info);
+		for (a_segment = a; (a != a_end) && (numeric ? g_ascii_isdigit(*a) : g_ascii_isalpha(*a)); ++a);
+		for (b_segment = b; (b != b_end) && (numeric ? g_ascii_isdigit(*b) : g_ascii_isalpha(*b)); ++b);
+		a_segment_len = a - a_segment;
+		b_segment_len = b - b_segment;
 
-		if (ret != PK_INFO_ENUM_INSTALLING) /* If installed */
+		/* A longer number is greater */
+		if (numeric && (a_segment_len != b_segment_len))
 		{
-			break;
+			return a_segment_len < b_segment_len ? -1 : 1;
+		}
+		if ((ret = memcmp(a_segment, b_segment, MIN(a_segment_len, b_segment_len))))
+		{
+			return ret < 0 ? -1 : 1;
+		}
+		if (a_segment_len != b_segment_len)
+		{
+			return a_segment_len < b_segment_len ? -1 : 1;
 		}
 	}
-	g_object_unref(pkg_metadata_enumerator);
-	g_object_unref(pkg_metadata_dir);
 
-	return ret;
+	return (a != a_end) - (b != b_end);
+}
+
+/**
+ * slack::is_installed:
+ * Checks if a package is already installed in the system.
+ *
+ * Params:
+ * 	pkg_fullname = Package name should be looked for.
+ *
+ * Returns: PK_INFO_ENUM_INSTALLED if pkg_fullname is already installed,
+ *          PK_INFO_ENUM_UPDATING if an elder version of pkg_fullname is
+ *          installed, PK_INFO_ENUM_INSTALLING if it isn't installed at all,
+ *          PK_INFO_ENUM_UNKNOWN if pkg_fullname is malformed.
+ *
+ * Callers checking many packages should get an InstalledPackages
+ * index once and use it for all of them.
+ **/
+PkInfoEnum
+is_installed (const gchar *pkg_fullname)
+{
+	g_return_val_if_fail(pkg_fullname != NULL, PK_INFO_ENUM_UNKNOWN);
+
+	return InstalledPackages::get ()->lookup (pkg_fullname);
 }
 
 /**
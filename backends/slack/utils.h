@@ -2,8 +2,12 @@
 #define __SLACK_UTILS_H
 
 #include <curl/curl.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <pk-backend.h>
 #include <pk-backend-job.h>
+#include <sqlite3.h>
 
 namespace slack {
 
@@ -12,7 +16,6 @@ struct JobData
 	GObjectClass parent_class;
 
 	sqlite3 *db;
-	CURL *curl;
 };
 
 CURLcode get_file (CURL **curl, gchar *source_url, gchar *dest);
@@ -21,6 +24,31 @@ gchar **split_package_name (const gchar *pkg_filename);
 
 PkInfoEnum is_installed (const gchar *pkg_fullname);
 
+gint compare_versions (const gchar *a, gssize a_len, const gchar *b, gssize b_len);
+
+/**
+ * slack::InstalledPackages:
+ *
+ * Index of the packages installed on the system, built from one scan of
+ * the package metadata directory (/var/log/packages).
+ **/
+class InstalledPackages
+{
+public:
+	explicit InstalledPackages (const gchar *pkg_metadata_dir) noexcept;
+
+	static std::shared_ptr<const InstalledPackages> get () noexcept;
+
+	gboolean is_valid () const noexcept;
+	PkInfoEnum lookup (const gchar *pkg_fullname) const noexcept;
+	gboolean stage (sqlite3 *db) const noexcept;
+
+private:
+	gboolean valid = FALSE;
+	/* Package name -> full name (name-version-arch-build) */
+	std::unordered_multimap<std::string, std::string> packages;
+};
+
 extern "C" {
 
 gint cmp_repo (gconstpointer a, gconstpointer b);
@@ -26,6 +26,7 @@
 
 #include <iterator>
 #include <list>
+#include <locale.h>
 #include <map>
 #include <pthread.h>
 #include <set>
@@ -35,6 +36,7 @@
 #include <string>
 #include <sys/vfs.h>
 #include <unistd.h>
+#include <unordered_set>
 #include <vector>
 
 #include <glib.h>
@@ -91,6 +93,8 @@
 #include <zypp/target/rpm/librpmDb.h>
 #include <zypp/ui/Selectable.h>
 
+#include "zypp-utils.h"
+
 using namespace std;
 using namespace zypp;
 using zypp::filesystem::PathInfo;
@@ -98,6 +102,8 @@ using zypp::filesystem::PathInfo;
 #undef ZYPP_BASE_LOGGER_LOGGROUP
 #define ZYPP_BASE_LOGGER_LOGGROUP "packagekit"
 
+#define ZYPP_PK_CONF "/etc/PackageKit/ZYpp.conf"
+
 typedef enum {
         INSTALL,
         REMOVE,
@@ -111,11 +117,40 @@ typedef enum {
         EQUAL_VERSION
 } VersionRelation;
 
+/**
+ * How a job accesses the pool:
+ * libzypp's pool is not thread safe, so every job holds it exclusively
+ * while using it. Writers (refresh, commits, anything using the solver)
+ * also run one at a time and may hand the pool to readers while they do
+ * work that does not touch it. Meanwhile readers get the pool only if it
+ * is already built, as building it would enter RepoManager at the same
+ * time as the writer.
+ */
+typedef enum {
+	ZYPP_JOB_READ_ONLY,
+	ZYPP_JOB_WRITE
+} ZyppJobMode;
+
 class ZyppJob {
  public:
-	ZyppJob(PkBackendJob *job);
+	ZyppJob(PkBackendJob *job, ZyppJobMode mode = ZYPP_JOB_WRITE);
 	~ZyppJob();
 	zypp::ZYpp::Ptr get_zypp();
+
+	/* writers only: temporarily let readers at the pool while doing
+	 * work that does not touch it (e.g. downloading metadata) */
+	void share_pool();
+	void own_pool();
+
+ private:
+	void prepare_pool();
+
+	PkBackendJob *_job;
+	ZyppJobMode _mode;
+	gboolean _pool_shared;
+	/* the job's locale, only for the thread running it */
+	locale_t _locale;
+	locale_t _old_locale;
 };
 
 enum PkgSearchType {
@@ -163,6 +198,15 @@ guint _dl_status = 0;
 
 guint _preload_progress = 0;
 
+/* Identifies the rpmdb state @System was last loaded from */
+static string _system_cookie;
+
+/* All enabled repos have been loaded into the pool */
+static gboolean _repos_loaded = FALSE;
+
+/* The current thread is a reader, the pool was prepared for it */
+static thread_local gboolean _pool_read_only = FALSE;
+
 /**
  * Build a package_id from the specified resolvable.  The returned
  * gchar * should be freed with g_free ().
@@ -619,23 +663,128 @@ class EventDirector
 		}
 };
 
+/**
+ * Settings from /etc/PackageKit/ZYpp.conf and the zypp configuration
+ * which are needed on every update query. They are read once and thrown
+ * away when the file changes or @System was reloaded, as the installed
+ * products decide about e.g. is_tumbleweed.
+ */
+struct ZyppConfig {
+	gboolean valid;
+	/* rpmdb cookie of the @System the settings were read with */
+	string system_cookie;
+	gboolean hide_packages;
+	gboolean dup_allow_vendor_change;
+	gboolean is_tumbleweed;
+};
+
 class PkBackendZYppPrivate {
  public:
 	std::vector<std::string> signatures;
 	EventDirector eventDirector;
 	PkBackendJob *currentJob;
 
+	/* held by writers for the whole job */
 	pthread_mutex_t zypp_mutex;
+	/* held by whoever uses the pool, writers only drop it while sharing */
+	pthread_mutex_t pool_mutex;
+	/* signalled when a writer stops sharing the pool */
+	pthread_cond_t pool_cond;
+	/* pool has been built and can be used by readers without changes;
+	 * only changed with pool_mutex held */
+	gboolean pool_ready;
+	/* a writer is working on the repositories without the pool */
+	gboolean pool_shared;
+	/* base URLs of the pool's repositories before a writer's proxy was
+	 * added to them, only used with the pool held */
+	ZyppSavedUrls pool_urls;
+
+	pthread_mutex_t config_mutex;
+	ZyppConfig config;
 };
 
 }; // namespace ZyppBackend
 
 using namespace ZyppBackend;
 
-ZyppJob::ZyppJob(PkBackendJob *job)
+static ResPool zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local);
+static gboolean zypp_system_is_current (void);
+
+/**
+ * The proxy settings of a job. They are handed to libzypp as part of the
+ * repository URLs rather than through the environment, so jobs running
+ * side by side can't see each other's settings. libzypp has no way to
+ * take a PAC file, so that one is not supported.
+ */
+static ZyppProxySettings
+zypp_job_proxy (PkBackendJob *job)
 {
+	ZyppProxySettings proxy;
+	const gchar *value;
+
+	value = pk_backend_job_get_proxy_http (job);
+	if (!pk_strzero (value)) {
+		g_autofree gchar *uri = pk_backend_convert_uri (value);
+		proxy.http = uri;
+	}
+	value = pk_backend_job_get_proxy_https (job);
+	if (!pk_strzero (value)) {
+		g_autofree gchar *uri = pk_backend_convert_uri (value);
+		proxy.https = uri;
+	}
+	value = pk_backend_job_get_proxy_ftp (job);
+	if (!pk_strzero (value)) {
+		g_autofree gchar *uri = pk_backend_convert_uri (value);
+		proxy.ftp = uri;
+	}
+	value = pk_backend_job_get_proxy_socks (job);
+	if (!pk_strzero (value)) {
+		g_autofree gchar *uri = pk_backend_convert_uri_socks (value);
+		proxy.socks = uri;
+	}
+	value = pk_backend_job_get_no_proxy (job);
+	if (!pk_strzero (value))
+		proxy.no_proxy = value;
+
+	return proxy;
+}
+
+/**
+ * Point the base URLs of a repository at the proxy of @job
+ */
+static void
+zypp_repo_set_proxy (PkBackendJob *job, RepoInfo &repo)
+{
+	ZyppProxySettings proxy = zypp_job_proxy (job);
+
+	RepoInfo::url_set urls;
+	for (const Url &url : repo.baseUrls ())
+		urls.push_back (zypp_url_with_proxy (url, &proxy));
+	repo.setBaseUrls (urls);
+}
+
+ZyppJob::ZyppJob(PkBackendJob *job, ZyppJobMode mode)
+	: _job(job), _mode(mode), _pool_shared(FALSE),
+	  _locale((locale_t) 0), _old_locale((locale_t) 0)
+{
+	/* jobs run in parallel, so setlocale() would change the language
+	 * of all of them */
+	const gchar *locale = pk_backend_job_get_locale(job);
+	if (!pk_strzero (locale))
+		_locale = newlocale(LC_ALL_MASK, locale, (locale_t) 0);
+	if (_locale != (locale_t) 0)
+		_old_locale = uselocale(_locale);
+
+	if (_mode == ZYPP_JOB_READ_ONLY) {
+		MIL << "locking zypp pool" << std::endl;
+		prepare_pool();
+		_pool_read_only = TRUE;
+		return;
+	}
+
 	MIL << "locking zypp" << std::endl;
 	pthread_mutex_lock(&priv->zypp_mutex);
+	pthread_mutex_lock(&priv->pool_mutex);
 
 	if (priv->currentJob) {
 		MIL << "currentjob is already defined - highly impossible" << endl;
@@ -648,14 +797,88 @@ ZyppJob::ZyppJob(PkBackendJob *job)
 
 ZyppJob::~ZyppJob()
 {
+	if (_locale != (locale_t) 0) {
+		uselocale(_old_locale);
+		freelocale(_locale);
+	}
+
+	if (_mode == ZYPP_JOB_READ_ONLY) {
+		MIL << "unlocking zypp pool" << std::endl;
+		_pool_read_only = FALSE;
+		pthread_mutex_unlock(&priv->pool_mutex);
+		return;
+	}
+
+	if (_pool_shared)
+		own_pool();
+
+	/* we may have left the pool in any state, let the next reader check it */
+	priv->pool_ready = FALSE;
+	/* don't keep the job's proxy credentials around */
+	zypp_pool_restore_urls (priv->pool_urls);
+
 	if (priv->currentJob)
 		pk_backend_job_set_locked(priv->currentJob, false);
 	priv->currentJob = 0;
 	priv->eventDirector.setJob(0);
 	MIL << "unlocking zypp" << std::endl;
+	pthread_mutex_unlock(&priv->pool_mutex);
 	pthread_mutex_unlock(&priv->zypp_mutex);
 }
 
+/**
+ * Lock a pool that readers can use as it is, building it first if needed.
+ */
+void
+ZyppJob::prepare_pool()
+{
+	pthread_mutex_lock(&priv->pool_mutex);
+
+	/* a writer is refreshing the repositories, so use the pool as it
+	 * is or wait for the writer to finish */
+	while (priv->pool_shared) {
+		if (priv->pool_ready)
+			return;
+		pthread_cond_wait(&priv->pool_cond, &priv->pool_mutex);
+	}
+
+	if (priv->pool_ready && zypp_system_is_current ())
+		return;
+
+	ZYpp::Ptr zypp = get_zypp();
+	/* without zypp the reader will fail in get_zypp() on its own */
+	if (zypp == NULL)
+		return;
+	zypp_build_pool (zypp, TRUE);
+	priv->pool_ready = TRUE;
+}
+
+void
+ZyppJob::share_pool()
+{
+	if (_mode != ZYPP_JOB_WRITE || _pool_shared)
+		return;
+
+	/* no other writer can get in as we still hold zypp_mutex */
+	MIL << "sharing zypp pool" << std::endl;
+	priv->pool_shared = TRUE;
+	pthread_mutex_unlock(&priv->pool_mutex);
+	_pool_shared = TRUE;
+}
+
+void
+ZyppJob::own_pool()
+{
+	if (_mode != ZYPP_JOB_WRITE || !_pool_shared)
+		return;
+
+	MIL << "waiting for zypp pool readers" << std::endl;
+	pthread_mutex_lock(&priv->pool_mutex);
+	priv->pool_shared = FALSE;
+	pthread_cond_broadcast(&priv->pool_cond);
+	_pool_shared = FALSE;
+}
+
 /**
  * Initialize Zypp (Factory method)
  */
@@ -677,10 +900,10 @@ ZyppJob::get_zypp()
 			initialized = TRUE;
 		}
 	} catch (const ZYppFactoryException &ex) {
-		pk_backend_job_error_code (priv->currentJob, PK_ERROR_ENUM_FAILED_INITIALIZATION, "%s", ex.asUserString().c_str() );
+		pk_backend_job_error_code (_job, PK_ERROR_ENUM_FAILED_INITIALIZATION, "%s", ex.asUserString().c_str() );
 		return NULL;
 	} catch (const Exception &ex) {
-		pk_backend_job_error_code (priv->currentJob, PK_ERROR_ENUM_INTERNAL_ERROR, "%s", ex.asUserString().c_str() );
+		pk_backend_job_error_code (_job, PK_ERROR_ENUM_INTERNAL_ERROR, "%s", ex.asUserString().c_str() );
 		return NULL;
 	}
 
@@ -765,35 +988,85 @@ zypp_is_valid_repo (PkBackendJob *job, RepoInfo repo)
 	return TRUE;
 }
 
+/**
+ * Returns a string which changes whenever the rpm database is written to
+ */
+static string
+zypp_rpmdb_cookie (Target_Ptr target)
+{
+	const target::rpm::RpmDb &rpm = target->rpmDb ();
+	Pathname dbdir = rpm.root () / rpm.dbPath ();
+	ostringstream cookie;
+
+	// sqlite (with its WAL), ndb and bdb backends respectively
+	for (const char *name : { "rpmdb.sqlite", "rpmdb.sqlite-wal", "Packages.db", "Packages" }) {
+		PathInfo info (dbdir / name);
+		if (info.isExist ())
+			cookie << name << ':' << info.mtime () << ':' << info.size () << ';';
+	}
+
+	return cookie.str ();
+}
+
+/**
+ * Whether @System still matches the rpm database
+ */
+static gboolean
+zypp_system_is_current (void)
+{
+	try {
+		Target_Ptr target = getZYpp ()->getTarget ();
+		if (!target)
+			return FALSE;
+		return zypp_rpmdb_cookie (target) == _system_cookie;
+	} catch (const Exception &ex) {
+		return FALSE;
+	}
+}
+
+/**
+ * (Re)load the installed packages into the pool, unless @System is
+ * already up to date with the rpm database.
+ */
+static void
+zypp_load_system (ZYpp::Ptr zypp)
+{
+	// readers use the pool as it is, ZyppJob has reloaded it for them
+	if (_pool_read_only)
+		return;
+
+	Target_Ptr target = zypp->target ();
+	string cookie = zypp_rpmdb_cookie (target);
+	Repository system = sat::Pool::instance ().reposFind (sat::Pool::systemRepoAlias ());
+
+	if (!system.solvablesEmpty () && cookie == _system_cookie)
+		return;
+
+	MIL << "loading @System, rpmdb cookie " << cookie << endl;
+	// FIXME have to wait for fix in zypp (repeated loading of target)
+	if (system != Repository::noRepository)
+		system.eraseFromPool ();
+	target->load ();
+	_system_cookie = cookie;
+}
+
 /**
  * Build and return a ResPool that contains all local resolvables
  * and ones found in the enabled repositories.
+ *
+ * With include_local FALSE, installed packages are not (re)loaded; if
+ * @System is in the pool already it is kept, and callers which do not
+ * want installed packages have to skip solvables for which isSystem()
+ * is true.
  */
 static ResPool
 zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local)
 {
-	static gboolean repos_loaded = FALSE;
-
-	// the target is loaded or unloaded on request
-	if (include_local) {
-		// FIXME have to wait for fix in zypp (repeated loading of target)
-		if (sat::Pool::instance().reposFind( sat::Pool::systemRepoAlias() ).solvablesEmpty ())
-		{
-			// Add local resolvables
-			Target_Ptr target = zypp->target ();
-			target->load ();
-		}
-	} else {
-		if (!sat::Pool::instance().reposFind( sat::Pool::systemRepoAlias() ).solvablesEmpty ())
-		{
-			// Remove local resolvables
-			Repository repository = sat::Pool::instance ().reposFind (sat::Pool::systemRepoAlias());
-			repository.eraseFromPool ();
-		}
-	}
+	if (include_local)
+		zypp_load_system (zypp);
 
 	// we only load repositories once.
-	if (repos_loaded)
+	if (_repos_loaded)
 		return zypp->pool();
 
 	// Add resolvables from enabled repos
@@ -815,7 +1088,7 @@ zypp_build_pool (ZYpp::Ptr zypp, gboolean include_local)
 				manager.loadFromCache (repo);
 
 		}
-		repos_loaded = true;
+		_repos_loaded = TRUE;
 	} catch (const repo::RepoNoAliasException &ex) {
 		g_error ("Can't figure an alias to look in cache");
 	} catch (const repo::RepoNotCachedException &ex) {
@@ -1078,11 +1351,11 @@ class AbortTransactionException {
 };
 
 /**
- * helper to refresh a repo's metadata and cache, catching signature
- * exceptions in a safe way.
+ * helper to refresh a repo's metadata and solv cache on disk, catching
+ * signature exceptions in a safe way. The pool is not touched.
  */
 static gboolean
-zypp_refresh_meta_and_cache (RepoManager &manager, RepoInfo &repo, bool force = false)
+zypp_refresh_meta (RepoManager &manager, RepoInfo &repo, bool force = false)
 {
 	try {
 		manager.refreshMetadata (repo, force ?
@@ -1091,25 +1364,47 @@ zypp_refresh_meta_and_cache (RepoManager &manager, RepoInfo &repo, bool force =
 		manager.buildCache (repo, force ?
 				    RepoManager::BuildForced :
 				    RepoManager::BuildIfNeeded);
-		try
-		{
-			manager.loadFromCache (repo);
-		}
-		catch (const Exception &exp)
-		{
-			// cachefile has old fomat (or is corrupted): rebuild it
-			manager.cleanCache (repo);
-			manager.buildCache (repo, force ?
-					    RepoManager::BuildForced :
-					    RepoManager::BuildIfNeeded);
-			manager.loadFromCache (repo);
-		}
 		return TRUE;
 	} catch (const AbortTransactionException &ex) {
 		return FALSE;
 	}
 }
 
+/**
+ * helper to (re)load a repo into the pool from its solv cache,
+ * replacing the copy the pool has got so far.
+ */
+static void
+zypp_load_repo_from_cache (RepoManager &manager, RepoInfo &repo, bool force = false)
+{
+	try
+	{
+		manager.loadFromCache (repo);
+	}
+	catch (const Exception &exp)
+	{
+		// cachefile has old fomat (or is corrupted): rebuild it
+		manager.cleanCache (repo);
+		manager.buildCache (repo, force ?
+				    RepoManager::BuildForced :
+				    RepoManager::BuildIfNeeded);
+		manager.loadFromCache (repo);
+	}
+}
+
+/**
+ * helper to refresh a repo's metadata and cache, catching signature
+ * exceptions in a safe way.
+ */
+static gboolean
+zypp_refresh_meta_and_cache (RepoManager &manager, RepoInfo &repo, bool force = false)
+{
+	if (!zypp_refresh_meta (manager, repo, force))
+		return FALSE;
+	zypp_load_repo_from_cache (manager, repo, force);
+	return TRUE;
+}
+
 
 static gboolean
 zypp_package_is_devel (const sat::Solvable &item)
@@ -1147,70 +1442,123 @@ zypp_package_is_cached (const sat::Solvable &item)
 }
 
 
+/* Filter relevant attributes of a solvable, see zypp_solvable_attrs () */
+enum {
+	ZYPP_ATTR_KNOWN		= 1 << 0,	/* entry has been computed */
+	ZYPP_ATTR_INSTALLED	= 1 << 1,
+	ZYPP_ATTR_NATIVE_ARCH	= 1 << 2,
+	ZYPP_ATTR_SOURCE	= 1 << 3,
+	ZYPP_ATTR_DEVEL		= 1 << 4,
+	ZYPP_ATTR_APPLICATION	= 1 << 5
+};
+
+/*
+ * Attributes by solvable id, valid for one pool serial. They are filled in
+ * lazily by whoever needs them first; like the pool itself, the cache is
+ * only used with the pool locked (see ZyppJob).
+ */
+static unsigned _attr_cache_serial = 0;
+static std::vector<guint8> _attr_cache;
+
+static guint8
+zypp_solvable_attrs (const sat::Solvable &item)
+{
+	const unsigned serial = sat::Pool::instance ().serial ().serial ();
+
+	if (_attr_cache_serial != serial || _attr_cache.empty ()) {
+		_attr_cache.assign (sat::Pool::instance ().capacity (), 0);
+		_attr_cache_serial = serial;
+	}
+
+	const sat::detail::SolvableIdType id = item.id ();
+	if (id >= _attr_cache.size ())
+		return 0;
+
+	guint8 attrs = _attr_cache[id];
+	if (attrs & ZYPP_ATTR_KNOWN)
+		return attrs;
+
+	attrs = ZYPP_ATTR_KNOWN;
+	if (item.isSystem ())
+		attrs |= ZYPP_ATTR_INSTALLED;
+	if (item.arch () == ZConfig::defaultSystemArchitecture () ||
+	    item.arch () == Arch_noarch)
+		attrs |= ZYPP_ATTR_NATIVE_ARCH;
+	if (isKind<SrcPackage>(item))
+		attrs |= ZYPP_ATTR_SOURCE;
+	if (zypp_package_is_devel (item))
+		attrs |= ZYPP_ATTR_DEVEL;
+	if (zypp_package_provides_application (item))
+		attrs |= ZYPP_ATTR_APPLICATION;
+
+	_attr_cache[id] = attrs;
+	return attrs;
+}
+
+/**
+ * turn the filters into the attributes a solvable must or must not have
+ */
+static void
+zypp_filter_attr_masks (PkBitfield filters, guint8 *required, guint8 *forbidden)
+{
+	static const struct {
+		PkFilterEnum with;
+		PkFilterEnum without;
+		guint8 attr;
+	} map[] = {
+		{ PK_FILTER_ENUM_INSTALLED,	PK_FILTER_ENUM_NOT_INSTALLED,	ZYPP_ATTR_INSTALLED },
+		{ PK_FILTER_ENUM_ARCH,		PK_FILTER_ENUM_NOT_ARCH,	ZYPP_ATTR_NATIVE_ARCH },
+		{ PK_FILTER_ENUM_SOURCE,	PK_FILTER_ENUM_NOT_SOURCE,	ZYPP_ATTR_SOURCE },
+		{ PK_FILTER_ENUM_DEVELOPMENT,	PK_FILTER_ENUM_NOT_DEVELOPMENT,	ZYPP_ATTR_DEVEL },
+		{ PK_FILTER_ENUM_APPLICATION,	PK_FILTER_ENUM_NOT_APPLICATION,	ZYPP_ATTR_APPLICATION },
+	};
+
+	*required = 0;
+	*forbidden = 0;
+	for (guint i = 0; i < G_N_ELEMENTS (map); i++) {
+		if (pk_bitfield_contain (filters, map[i].with))
+			*required |= map[i].attr;
+		if (pk_bitfield_contain (filters, map[i].without))
+			*forbidden |= map[i].attr;
+	}
+}
+
 /**
  * should we omit a solvable from a result because of filtering ?
  */
 static gboolean
 zypp_filter_solvable (PkBitfield filters, const sat::Solvable &item)
 {
-	// iterate through the given filters
+	guint8 required;
+	guint8 forbidden;
+
 	if (!filters)
 		return FALSE;
 
-	for (guint i = 0; i < PK_FILTER_ENUM_LAST; i++) {
-		if ((filters & pk_bitfield_value (i)) == 0)
-			continue;
-		if (i == PK_FILTER_ENUM_INSTALLED && !(item.isSystem ()))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_NOT_INSTALLED && item.isSystem ())
-			return TRUE;
-		if (i == PK_FILTER_ENUM_ARCH) {
-			if (item.arch () != ZConfig::defaultSystemArchitecture () &&
-			    item.arch () != "noarch")
-				return TRUE;
-		}
-		if (i == PK_FILTER_ENUM_NOT_ARCH) {
-			if (item.arch () == ZConfig::defaultSystemArchitecture () ||
-			    item.arch () == "noarch")
-				return TRUE;
-		}
-		if (i == PK_FILTER_ENUM_SOURCE && !(isKind<SrcPackage>(item)))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_NOT_SOURCE && isKind<SrcPackage>(item))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_DEVELOPMENT && !zypp_package_is_devel (item))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_NOT_DEVELOPMENT && zypp_package_is_devel (item))
+	zypp_filter_attr_masks (filters, &required, &forbidden);
+	if (required || forbidden) {
+		guint8 attrs = zypp_solvable_attrs (item);
+		if ((attrs & required) != required || (attrs & forbidden) != 0)
 			return TRUE;
+	}
 
-		if (i == PK_FILTER_ENUM_APPLICATION && !zypp_package_provides_application (item))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_NOT_APPLICATION && zypp_package_provides_application (item))
-			return TRUE;
+	// these depend on more than the pool, so are not cached
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_DOWNLOADED) && !zypp_package_is_cached (item))
+		return TRUE;
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NOT_DOWNLOADED) && zypp_package_is_cached (item))
+		return TRUE;
+	if (pk_bitfield_contain (filters, PK_FILTER_ENUM_NEWEST) && !item.isSystem ()) {
+		ui::Selectable::Ptr sel = ui::Selectable::get (item);
+		const PoolItem & newest (sel->highestAvailableVersionObj ());
 
-		if (i == PK_FILTER_ENUM_DOWNLOADED && !zypp_package_is_cached (item))
+		if (newest && zypp::Edition::compare (newest.edition (), item.edition ()))
 			return TRUE;
-		if (i == PK_FILTER_ENUM_NOT_DOWNLOADED && zypp_package_is_cached (item))
-			return TRUE;
-		if (i == PK_FILTER_ENUM_NEWEST) {
-			if (item.isSystem ()) {
-				return FALSE;
-			}
-			else {
-				ui::Selectable::Ptr sel = ui::Selectable::get (item);
-				const PoolItem & newest (sel->highestAvailableVersionObj ());
-
-				if (newest && zypp::Edition::compare (newest.edition (), item.edition ()))
-					return TRUE;
-				return FALSE;
-			}
-		}
-
-		// FIXME: add more enums - cf. libzif logic and pk-enum.h
-		// PK_FILTER_ENUM_SUPPORTED,
-		// PK_FILTER_ENUM_NOT_SUPPORTED,
 	}
 
+	// FIXME: add more enums - cf. libzif logic and pk-enum.h
+	// PK_FILTER_ENUM_SUPPORTED,
+	// PK_FILTER_ENUM_NOT_SUPPORTED,
+
 	return FALSE;
 }
 
@@ -1227,6 +1575,28 @@ zypp_backend_package (PkBackendJob *job, PkInfoEnum info,
 	g_free (id);
 }
 
+/**
+  * helper to queue a zypp solvable for a batched pk_backend_job_packages()
+  */
+static void
+zypp_stage_package (GPtrArray *packages, PkInfoEnum info,
+		    const sat::Solvable &pkg)
+{
+	g_autoptr(PkPackage) pk_package = pk_package_new ();
+	g_autofree gchar *id = zypp_build_package_id_from_resolvable (pkg);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!pk_package_set_id (pk_package, id, &local_error)) {
+		g_warning ("package_id %s invalid and cannot be processed: %s",
+			   id, local_error->message);
+		return;
+	}
+
+	pk_package_set_info (pk_package, info);
+	pk_package_set_summary (pk_package, make<ResObject>(pkg)->summary().c_str());
+	g_ptr_array_add (packages, g_steal_pointer (&pk_package));
+}
+
 /*
  * Emit signals for the packages, -but- if we have an installed package
  * we don't notify the client that the package is also available, since
@@ -1237,7 +1607,8 @@ zypp_emit_filtered_packages_in_list (PkBackendJob *job, PkBitfield filters, cons
 {
 	typedef vector<sat::Solvable>::const_iterator sat_it_t;
 
-	vector<sat::Solvable> installed;
+	g_autoptr(GPtrArray) packages = g_ptr_array_new_with_free_func (g_object_unref);
+	unordered_set<string> installed;
 
 	// always emit system installed packages first
 	for (sat_it_t it = v.begin (); it != v.end (); ++it) {
@@ -1245,30 +1616,24 @@ zypp_emit_filtered_packages_in_list (PkBackendJob *job, PkBitfield filters, cons
 		    zypp_filter_solvable (filters, *it))
 			continue;
 
-		zypp_backend_package (job, PK_INFO_ENUM_INSTALLED, *it,
-				      make<ResObject>(*it)->summary().c_str());
-		installed.push_back (*it);
+		zypp_stage_package (packages, PK_INFO_ENUM_INSTALLED, *it);
+		installed.insert (zypp_nvra_key (*it));
 	}
 
 	// then available packages later
 	for (sat_it_t it = v.begin (); it != v.end (); ++it) {
-		gboolean match;
-
 		if (it->isSystem() ||
 		    zypp_filter_solvable (filters, *it))
 			continue;
 
-		match = FALSE;
-		for (sat_it_t i = installed.begin (); !match && i != installed.end (); i++) {
-			match = it->sameNVRA (*i) &&
-				!(!isKind<SrcPackage>(*it) ^
-				  !isKind<SrcPackage>(*i));
-		}
-		if (!match) {
-			zypp_backend_package (job, PK_INFO_ENUM_AVAILABLE, *it,
-					      make<ResObject>(*it)->summary().c_str());
-		}
+		if (!installed.empty () && installed.count (zypp_nvra_key (*it)) > 0)
+			continue;
+
+		zypp_stage_package (packages, PK_INFO_ENUM_AVAILABLE, *it);
 	}
+
+	if (packages->len > 0)
+		pk_backend_job_packages (job, packages);
 }
 
 static gboolean
@@ -1291,6 +1656,70 @@ is_tumbleweed (void)
 	return ret;
 }
 
+/**
+ * Read the settings, with the pool held
+ */
+static void
+zypp_config_load (ZyppConfig &config)
+{
+	config.hide_packages = FALSE;
+	if (PathInfo(ZYPP_PK_CONF).isExist()) {
+		try {
+			parser::IniDict vendorConf(InputStream(ZYPP_PK_CONF));
+			if (vendorConf.hasSection("Updates")) {
+				for ( parser::IniDict::entry_const_iterator eit = vendorConf.entriesBegin("Updates");
+				      eit != vendorConf.entriesEnd("Updates");
+				      ++eit )
+				{
+					if ((*eit).first == "HidePackages" &&
+					    str::strToTrue((*eit).second))
+						config.hide_packages = TRUE;
+				}
+			}
+		} catch (const Exception &ex) {
+			g_warning ("failed to parse %s: %s", ZYPP_PK_CONF, ex.asUserString ().c_str ());
+		}
+	}
+
+	config.dup_allow_vendor_change = ZConfig::instance ().solver_dupAllowVendorChange ();
+	config.is_tumbleweed = is_tumbleweed ();
+	config.system_cookie = _system_cookie;
+	config.valid = TRUE;
+}
+
+/**
+ * Returns the cached settings, reading them if needed.
+ * Must be called with the pool locked, like everything looking at @System.
+ */
+static ZyppConfig
+zypp_get_config (void)
+{
+	ZyppConfig config;
+
+	pthread_mutex_lock (&priv->config_mutex);
+	if (!priv->config.valid || priv->config.system_cookie != _system_cookie)
+		zypp_config_load (priv->config);
+	config = priv->config;
+	pthread_mutex_unlock (&priv->config_mutex);
+
+	return config;
+}
+
+static void
+zypp_config_invalidate (void)
+{
+	pthread_mutex_lock (&priv->config_mutex);
+	priv->config.valid = FALSE;
+	pthread_mutex_unlock (&priv->config_mutex);
+}
+
+static void
+zypp_config_changed_cb (PkBackend *backend, gpointer data)
+{
+	g_debug ("%s changed", ZYPP_PK_CONF);
+	zypp_config_invalidate ();
+}
+
 /**
  * Returns a set of all packages the could be updated
  * (you're able to exclude a single (normally the 'patch' repo)
@@ -1306,8 +1735,9 @@ zypp_get_package_updates (string repo, set<PoolItem> &pks)
 	ResPool::byKind_iterator it = pool.byKindBegin (kind);
 	ResPool::byKind_iterator e = pool.byKindEnd (kind);
 
-	if (is_tumbleweed ()) {
-		resolver->dupSetAllowVendorChange (ZConfig::instance ().solver_dupAllowVendorChange ());
+	ZyppConfig config = zypp_get_config ();
+	if (config.is_tumbleweed) {
+		resolver->dupSetAllowVendorChange (config.dup_allow_vendor_change);
 		resolver->doUpgrade ();
 	} else {
 		resolver->doUpdate ();
@@ -1321,7 +1751,7 @@ zypp_get_package_updates (string repo, set<PoolItem> &pks)
 				pks.insert(*it);
 		}
 
-	if (is_tumbleweed ()) {
+	if (config.is_tumbleweed) {
 		resolver->setUpgradeMode (FALSE);
 	} else {
 		resolver->setUpdateMode (FALSE);
@@ -1382,7 +1812,6 @@ zypp_get_patches (PkBackendJob *job, ZYpp::Ptr zypp, set<PoolItem> &patches)
 static SelfUpdate
 zypp_get_updates (PkBackendJob *job, ZYpp::Ptr zypp, set<PoolItem> &candidates)
 {
-	typedef set<PoolItem>::iterator pi_it_t;
 	SelfUpdate detail = zypp_get_patches (job, zypp, candidates);
 
 	if (detail == SelfUpdate::kNo) {
@@ -1392,50 +1821,13 @@ zypp_get_updates (PkBackendJob *job, ZYpp::Ptr zypp, set<PoolItem> &candidates)
 			patchRepo = candidates.begin ()->resolvable ()->repoInfo ().alias ();
 		}
 
-		bool hidePackages = false;
-		if (PathInfo("/etc/PackageKit/ZYpp.conf").isExist()) {
-			parser::IniDict vendorConf(InputStream("/etc/PackageKit/ZYpp.conf"));
-			if (vendorConf.hasSection("Updates")) {
-				for ( parser::IniDict::entry_const_iterator eit = vendorConf.entriesBegin("Updates");
-				      eit != vendorConf.entriesEnd("Updates");
-				      ++eit )
-				{
-					if ((*eit).first == "HidePackages" &&
-					    str::strToTrue((*eit).second))
-						hidePackages = true;
-				}
-			}
-		}
-
-		if (!hidePackages)
+		if (!zypp_get_config ().hide_packages)
 		{
 			set<PoolItem> packages;
 			zypp_get_package_updates(patchRepo, packages);
 
-			pi_it_t cb = candidates.begin (), ce = candidates.end (), ci;
-			for (ci = cb; ci != ce; ++ci) {
-				if (!isKind<Patch>(ci->resolvable()))
-					continue;
-
-				Patch::constPtr patch = asKind<Patch>(ci->resolvable());
-
-				// Remove contained packages from list of packages to add
-				sat::SolvableSet::const_iterator pki;
-				Patch::Contents content(patch->contents());
-				for (pki = content.begin(); pki != content.end(); ++pki) {
-
-					pi_it_t pb = packages.begin (), pe = packages.end (), pi;
-					for (pi = pb; pi != pe; ++pi) {
-						if (pi->satSolvable() == sat::Solvable::noSolvable)
-							continue;
-
-						if (pi->satSolvable().identical (*pki)) {
-							packages.erase (pi);
-							break;
-						}
-					}
-				}
-			}
+			// Remove contained packages from list of packages to add
+			zypp_subtract_patch_contents (candidates, packages);
 
 			// merge into the list
 			candidates.insert (packages.begin (), packages.end ());
@@ -1650,6 +2042,7 @@ zypp_perform_execution (PkBackendJob *job, ZYpp::Ptr zypp, PerformType type, gbo
 		if (!pk_bitfield_contain (transaction_flags, PK_TRANSACTION_FLAG_ENUM_ONLY_TRUSTED))
 			policy.rpmNoSignature(true);
 
+		zypp_pool_apply_proxy (zypp_job_proxy (job), priv->pool_urls);
 		ZYppCommitResult result = zypp->commit (policy);
 
 		bool worked = result.allDone();
@@ -1719,11 +2112,27 @@ zypp_build_package_id_capabilities (Capabilities caps, gboolean terminate = TRUE
 	return package_ids;
 }
 
+/**
+  * collect the errors of repos which failed to refresh
+  */
+static void
+zypp_append_repo_message (gchar **repo_messages, const RepoInfo &repo, const Exception &ex)
+{
+	if (*repo_messages == NULL) {
+		*repo_messages = g_strdup_printf ("%s: %s%s", repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
+	} else {
+		*repo_messages = g_strdup_printf ("%s%s: %s%s", *repo_messages, repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
+	}
+	if (*repo_messages == NULL || !g_utf8_validate (*repo_messages, -1, NULL))
+		*repo_messages = g_strdup ("A repository could not be refreshed");
+	g_strdelimit (*repo_messages, "\\\f\r\t", ' ');
+}
+
 /**
   * refresh the enabled repositories
   */
 static gboolean
-zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
+zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force, ZyppJob *zjob = NULL)
 {
 	MIL << force << endl;
 	// This call is needed as it calls initializeTarget which appears to properly setup the keyring
@@ -1732,16 +2141,6 @@ zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
 		return  FALSE;
 	zypp::filesystem::Pathname pathname("/");
 
-	bool poolIsClean = sat::Pool::instance ().reposEmpty ();
-	// Erase and reload all if pool is too holey (densyity [100: good | 0 bad])
-	// NOTE sat::Pool::capacity() > 2 is asserted in division
-	if (!poolIsClean &&
-	    sat::Pool::instance ().solvablesSize () * 100 / sat::Pool::instance ().capacity () < 33)
-	{
-		sat::Pool::instance ().reposEraseAll ();
-		poolIsClean = true;
-	}
-
 	Target_Ptr target = zypp->getTarget ();
 	if (!target)
 	{
@@ -1753,8 +2152,6 @@ zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
 		// load rpmdb trusted keys into zypp keyring
 		target->rpmDb ().exportTrustedKeysInZyppKeyRing ();
 	}
-	// load installed packages to pool
-	target->load ();
 
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_REFRESH_CACHE);
 	pk_backend_job_set_percentage (job, 0);
@@ -1772,41 +2169,31 @@ zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
 		return FALSE;
 	}
 
-	if (!poolIsClean)
-	{
-		std::vector<std::string> aliasesToRemove;
-
-		for (const Repository &poolrepo : zypp->pool ().knownRepositories ())
-		{
-			if (!(poolrepo.isSystemRepo () || manager.hasRepo (poolrepo.alias ())))
-				aliasesToRemove.push_back (poolrepo.alias ());
-		}
-
-		for (const std::string &aliasToRemove : aliasesToRemove)
-		{
-			sat::Pool::instance ().reposErase (aliasToRemove);
-		}
+	for (list <RepoInfo>::iterator it = repos.begin(); it != repos.end(); ++it) {
+		if (!zypp_is_valid_repo (job, *it))
+			return FALSE;
 	}
 
 	int i = 1;
 	int num_of_repos = repos.size ();
 	gchar *repo_messages = NULL;
+	list <RepoInfo> refreshed;
+
+	// Downloading and building the solv files does not need the pool,
+	// so readers can go on with the current one meanwhile. Nothing may
+	// touch the pool until we own it again.
+	if (zjob)
+		zjob->share_pool ();
 
 	for (list <RepoInfo>::iterator it = repos.begin(); it != repos.end(); ++it, i++) {
 		RepoInfo repo (*it);
 
-		if (!zypp_is_valid_repo (job, repo))
-			return FALSE;
 		if (pk_backend_job_get_is_error_set (job))
 			break;
 
 		// skip disabled repos
 		if (repo.enabled () == false)
-		{
-			if (!poolIsClean)
-				sat::Pool::instance ().reposErase (repo.alias ());
 			continue;
-		}
 
 		// do as zypper does
 		if (!force && !repo.autorefresh())
@@ -1815,32 +2202,75 @@ zypp_refresh_cache (PkBackendJob *job, ZYpp::Ptr zypp, gboolean force)
 		// skip changeable media (DVDs and CDs).  Without doing this,
 		// the disc would be required to be physically present.
 		if (repo.baseUrlsBegin ()->schemeIsVolatile())
-		{
-			if (!poolIsClean)
-				sat::Pool::instance ().reposErase (repo.alias ());
 			continue;
-		}
 
 		try {
 			// Refreshing metadata
 			g_free (_repoName);
 			_repoName = g_strdup (repo.alias ().c_str ());
-			zypp_refresh_meta_and_cache (manager, repo, force);
+			zypp_repo_set_proxy (job, repo);
+			if (zypp_refresh_meta (manager, repo, force))
+				refreshed.push_back (*it);
 		} catch (const Exception &ex) {
-			if (repo_messages == NULL) {
-				repo_messages = g_strdup_printf ("%s: %s%s", repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
-			} else {
-				repo_messages = g_strdup_printf ("%s%s: %s%s", repo_messages, repo.alias ().c_str (), ex.asUserString ().c_str (), "\n");
-			}
-			if (repo_messages == NULL || !g_utf8_validate (repo_messages, -1, NULL))
-				repo_messages = g_strdup ("A repository could not be refreshed");
-			g_strdelimit (repo_messages, "\\\f\r\t", ' ');
+			zypp_append_repo_message (&repo_messages, repo, ex);
 			continue;
 		}
 
 		// Update the percentage completed
 		pk_backend_job_set_percentage (job, i >= num_of_repos ? 100 : (100 * i) / num_of_repos);
 	}
+
+	// Swap the new data in, once nobody is looking at the pool anymore
+	if (zjob)
+		zjob->own_pool ();
+
+	bool poolIsClean = sat::Pool::instance ().reposEmpty ();
+	// Erase and reload all if pool is too holey (densyity [100: good | 0 bad])
+	// NOTE sat::Pool::capacity() > 2 is asserted in division
+	if (!poolIsClean &&
+	    sat::Pool::instance ().solvablesSize () * 100 / sat::Pool::instance ().capacity () < 33)
+	{
+		sat::Pool::instance ().reposEraseAll ();
+		poolIsClean = true;
+		// repos which are not refreshed below have to be loaded again
+		_repos_loaded = FALSE;
+	}
+
+	// load installed packages to pool
+	zypp_load_system (zypp);
+
+	if (!poolIsClean)
+	{
+		std::vector<std::string> aliasesToRemove;
+
+		for (const Repository &poolrepo : zypp->pool ().knownRepositories ())
+		{
+			if (!(poolrepo.isSystemRepo () || manager.hasRepo (poolrepo.alias ())))
+				aliasesToRemove.push_back (poolrepo.alias ());
+		}
+
+		for (const RepoInfo &repo : repos)
+		{
+			// drop disabled repos and changeable media
+			if (repo.enabled () == false || repo.baseUrlsBegin ()->schemeIsVolatile())
+				aliasesToRemove.push_back (repo.alias ());
+		}
+
+		for (const std::string &aliasToRemove : aliasesToRemove)
+		{
+			sat::Pool::instance ().reposErase (aliasToRemove);
+		}
+	}
+
+	for (list <RepoInfo>::iterator it = refreshed.begin(); it != refreshed.end(); ++it) {
+		RepoInfo repo (*it);
+
+		try {
+			zypp_load_repo_from_cache (manager, repo, force);
+		} catch (const Exception &ex) {
+			zypp_append_repo_message (&repo_messages, repo, ex);
+		}
+	}
 	if (repo_messages != NULL)
 		g_printf("%s", repo_messages);
 
@@ -1873,12 +2303,13 @@ zypp_backend_finished_error (PkBackendJob  *job, PkErrorEnum err_code,
 
 
 /**
- * We do not pretend we're thread safe when all we do is having a huge mutex
+ * Read-only jobs run beside a writer while it does not need the pool,
+ * everything else still runs alone (see ZyppJob)
  */
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
 {
-        return FALSE;
+        return TRUE;
 }
 
 
@@ -1904,11 +2335,21 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 	priv = new PkBackendZYppPrivate;
 	priv->currentJob = 0;
 	priv->zypp_mutex = PTHREAD_MUTEX_INITIALIZER;
+	priv->pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+	priv->pool_cond = PTHREAD_COND_INITIALIZER;
+	priv->pool_ready = FALSE;
+	priv->pool_shared = FALSE;
+	priv->config_mutex = PTHREAD_MUTEX_INITIALIZER;
+	priv->config.valid = FALSE;
+
 	zypp_logging ();
 
 	/* Set PATH variable to avoid problems when installing packges(bsc#1175315). */
 	g_setenv("PATH", "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin", TRUE);
 
+	/* update queries use the cached settings until the file changes */
+	pk_backend_watch_file (backend, ZYPP_PK_CONF, zypp_config_changed_cb, NULL);
+
 	g_debug ("zypp_backend_initialize");
 }
 
@@ -2077,7 +2518,7 @@ backend_depends_on_thread (PkBackendJob *job, GVariant *params, gpointer user_da
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
 	pk_backend_job_set_percentage (job, 0);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -2213,7 +2654,7 @@ backend_get_details_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 	g_variant_get (params, "(^a&s)",
 		       &package_ids);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -2474,7 +2915,7 @@ backend_refresh_cache_thread (PkBackendJob *job, GVariant *params, gpointer user
 		return;
 	}
 
-	zypp_refresh_cache (job, zypp, force);
+	zypp_refresh_cache (job, zypp, force, &zjob);
 }
 
 void
@@ -2530,7 +2971,7 @@ backend_get_updates_thread (PkBackendJob *job, GVariant *params, gpointer user_d
 	pk_backend_job_set_percentage (job, 0);
 
 	// refresh the repos before checking for updates
-	if (!zypp_refresh_cache (job, zypp, FALSE)) {
+	if (!zypp_refresh_cache (job, zypp, FALSE, &zjob)) {
 		return;
 	}
 
@@ -2695,7 +3136,7 @@ static void
 backend_get_update_detail_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 {
 	MIL << endl;
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	gchar **package_ids;
@@ -2986,7 +3427,6 @@ backend_remove_packages_thread (PkBackendJob *job, GVariant *params, gpointer us
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_REMOVE);
 	pk_backend_job_set_percentage (job, 0);
 
-	Target_Ptr target;
 	ZyppJob zjob(job);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
@@ -2995,10 +3435,8 @@ backend_remove_packages_thread (PkBackendJob *job, GVariant *params, gpointer us
 	}
 	zypp->resolver()->setCleandepsOnRemove(autoremove);
 
-	target = zypp->target ();
-
 	// Load all the local system "resolvables" (packages)
-	target->load ();
+	zypp_load_system (zypp);
 	pk_backend_job_set_percentage (job, 10);
 
 	PoolStatusSaver saver;
@@ -3073,7 +3511,7 @@ backend_resolve_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 		      &_filters,
 		      &search);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3166,29 +3604,33 @@ static void
 backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 {
 	MIL << endl;
-	const gchar *search;
 	PkRoleEnum role;
 
 	PkBitfield _filters;
 	gchar **values;
+	guint i;
 	g_variant_get(params, "(t^a&s)",
 		&_filters,
 		&values);
 
-	if (values == NULL || values[0] == NULL) {
+	// empty terms are skipped, but at least one term has to be left
+	for (i = 0; values != NULL && values[i] != NULL; i++) {
+		if (values[i][0] != '\0')
+			break;
+	}
+	if (values == NULL || values[i] == NULL) {
 		pk_backend_job_error_code (job, PK_ERROR_ENUM_PACKAGE_ID_INVALID,
 					   "Empty search string is not supported.");
 		return;
 	}
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
 		return;
 	}
 
-	search = values[0];  //Fixme - support the possible multiple values (logical OR search)
 	role = pk_backend_job_get_role(job);
 
 	pk_backend_job_set_status (job, PK_STATUS_ENUM_QUERY);
@@ -3197,13 +3639,17 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 	vector<sat::Solvable> v;
 
 	PoolQuery q;
-	q.addString( search ); // may be called multiple times (OR'ed)
+	// all terms are OR'ed and matched in one pass over the pool
+	for (i = 0; values[i] != NULL; i++) {
+		if (values[i][0] != '\0')
+			q.addString( values[i] );
+	}
 	q.setCaseSensitive( false ); // [<>] We want to be case insensitive for the name and description searches...
 	q.setMatchSubstring();
 
 	switch (role) {
 	case PK_ROLE_ENUM_SEARCH_NAME:
-		zypp_build_pool (zypp, TRUE); // seems to be necessary?
+		zypp_build_pool (zypp, TRUE);
 		q.addKind( ResKind::package );
 		q.addKind( ResKind::srcpackage );
 		q.addAttribute( sat::SolvAttr::name );
@@ -3212,7 +3658,7 @@ backend_find_packages_thread (PkBackendJob *job, GVariant *params, gpointer user
 		// two separate queries.
 		break;
 	case PK_ROLE_ENUM_SEARCH_DETAILS:
-		zypp_build_pool (zypp, TRUE); // seems to be necessary?
+		zypp_build_pool (zypp, TRUE);
 		q.addKind( ResKind::package );
 		//q.addKind( ResKind::srcpackage );
 		q.addAttribute( sat::SolvAttr::name );
@@ -3266,7 +3712,7 @@ backend_search_group_thread (PkBackendJob *job, GVariant *params, gpointer user_
 		&_filters,
 		&search);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3318,16 +3764,19 @@ pk_backend_search_files (PkBackend *backend, PkBackendJob *job, PkBitfield filte
 	pk_backend_job_thread_create (job, backend_find_packages_thread, NULL, NULL);
 }
 
-void
-pk_backend_get_repo_list (PkBackend *backend, PkBackendJob *job, PkBitfield filters)
+static void
+backend_get_repo_list_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
 {
 	MIL << endl;
 
-	ZyppJob zjob(job);
+	PkBitfield filters;
+	g_variant_get (params, "(t)",
+		       &filters);
+
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
-		pk_backend_job_finished (job);
 		return;
 	}
 
@@ -3359,8 +3808,12 @@ pk_backend_get_repo_list (PkBackend *backend, PkBackendJob *job, PkBitfield filt
 					it->name().c_str(),
 					it->enabled());
 	}
+}
 
-	pk_backend_job_finished (job);
+void
+pk_backend_get_repo_list (PkBackend *backend, PkBackendJob *job, PkBitfield filters)
+{
+	pk_backend_job_thread_create (job, backend_get_repo_list_thread, NULL, NULL);
 }
 
 void
@@ -3415,7 +3868,7 @@ backend_get_files_thread (PkBackendJob *job, GVariant *params, gpointer user_dat
 	g_variant_get(params, "(^a&s)",
 		      &package_ids);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3484,7 +3937,7 @@ backend_get_packages_thread (PkBackendJob *job, GVariant *params, gpointer user_
 	g_variant_get (params, "(t)",
 		       &_filters);
 
-	ZyppJob zjob(job);
+	ZyppJob zjob(job, ZYPP_JOB_READ_ONLY);
 	ZYpp::Ptr zypp = zjob.get_zypp();
 
 	if (zypp == NULL){
@@ -3535,7 +3988,7 @@ upgrade_system (PkBackendJob *job,
 		}
 	}
 
-	zypp->resolver ()->dupSetAllowVendorChange (ZConfig::instance ().solver_dupAllowVendorChange ());
+	zypp->resolver ()->dupSetAllowVendorChange (zypp_get_config ().dup_allow_vendor_change);
 	zypp->resolver ()->doUpgrade ();
 
 	zypp_perform_execution (job, zypp, UPGRADE_SYSTEM, FALSE, transaction_flags);
@@ -3564,7 +4017,7 @@ backend_update_packages_thread (PkBackendJob *job, GVariant *params, gpointer us
 	PkRestartEnum restart = PK_RESTART_ENUM_NONE;
 	PoolStatusSaver saver;
 
-	if (is_tumbleweed ()) {
+	if (zypp_get_config ().is_tumbleweed) {
 		upgrade_system (job, zypp, transaction_flags);
 		return;
 	}
@@ -3635,7 +4088,7 @@ pk_backend_upgrade_system_thread (PkBackendJob *job,
 	ResPool pool = zypp_build_pool (zypp, TRUE);
 	PoolStatusSaver saver;
 
-	if (is_tumbleweed ()) {
+	if (zypp_get_config ().is_tumbleweed) {
 		pk_backend_job_error_code (job, PK_ERROR_ENUM_NOT_SUPPORTED,
 					   "upgrade-system is not supported in Tumbleweed, use \"pkcon update\" instead.");
 		return;
@@ -3970,12 +4423,14 @@ backend_download_packages_thread (PkBackendJob *job, GVariant *params, gpointer
 	try
 	{
 		ResPool pool = zypp_build_pool (zypp, FALSE);
+		zypp_pool_apply_proxy (zypp_job_proxy (job), priv->pool_urls);
 
 		pk_backend_job_set_status (job, PK_STATUS_ENUM_DOWNLOAD);
 		for (guint i = 0; package_ids[i]; i++) {
 			sat::Solvable solvable = zypp_get_package_by_id (package_ids[i]);
 
-			if (zypp_is_no_solvable(solvable)) {
+			// installed packages can't be downloaded
+			if (zypp_is_no_solvable(solvable) || solvable.isSystem ()) {
 				zypp_backend_finished_error (job, PK_ERROR_ENUM_PACKAGE_NOT_FOUND,
 							     "couldn't find package");
 				return;
@@ -4034,77 +4489,8 @@ pk_backend_download_packages (PkBackend *backend, PkBackendJob *job, gchar **pac
 void
 pk_backend_start_job (PkBackend *backend, PkBackendJob *job)
 {
-	const gchar *locale;
-	const gchar *proxy_http;
-	const gchar *proxy_https;
-	const gchar *proxy_ftp;
-	const gchar *proxy_socks;
-	const gchar *no_proxy;
-	const gchar *pac;
-	gchar *uri;
-
-	locale = pk_backend_job_get_locale(job);
-	if (!pk_strzero (locale)) {
-		setlocale(LC_ALL, locale);
-	}
-
-	/* http_proxy */
-	proxy_http = pk_backend_job_get_proxy_http (job);
-	if (!pk_strzero (proxy_http)) {
-		uri = pk_backend_convert_uri (proxy_http);
-		g_setenv ("http_proxy", uri, TRUE);
-		g_free (uri);
-	}
-
-	/* https_proxy */
-	proxy_https = pk_backend_job_get_proxy_https (job);
-	if (!pk_strzero (proxy_https)) {
-		uri = pk_backend_convert_uri (proxy_https);
-		g_setenv ("https_proxy", uri, TRUE);
-		g_free (uri);
-	}
-
-	/* ftp_proxy */
-	proxy_ftp = pk_backend_job_get_proxy_ftp (job);
-	if (!pk_strzero (proxy_ftp)) {
-		uri = pk_backend_convert_uri (proxy_ftp);
-		g_setenv ("ftp_proxy", uri, TRUE);
-		g_free (uri);
-	}
-
-	/* socks_proxy */
-	proxy_socks = pk_backend_job_get_proxy_socks (job);
-	if (!pk_strzero (proxy_socks)) {
-		uri = pk_backend_convert_uri (proxy_socks);
-		g_setenv ("socks_proxy", uri, TRUE);
-		g_free (uri);
-	}
-
-	/* no_proxy */
-	no_proxy = pk_backend_job_get_no_proxy (job);
-	if (!pk_strzero (no_proxy)) {
-		g_setenv ("no_proxy", no_proxy, TRUE);
-	}
-
-	/* pac */
-	pac = pk_backend_job_get_pac (job);
-	if (!pk_strzero (pac)) {
-		uri = pk_backend_convert_uri (pac);
-		g_setenv ("pac", uri, TRUE);
-		g_free (uri);
-	}
-}
-
-void
-pk_backend_stop_job (PkBackend *backend, PkBackendJob *job)
-{
-	/* unset proxy info for this transaction */
-	g_unsetenv ("http_proxy");
-	g_unsetenv ("ftp_proxy");
-	g_unsetenv ("https_proxy");
-	g_unsetenv ("no_proxy");
-	g_unsetenv ("socks_proxy");
-	g_unsetenv ("pac");
+	/* the locale is applied by ZyppJob, the proxy settings
+	 * wherever a job accesses the network */
 }
 
 
@@ -0,0 +1,182 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "zypp-utils.h"
+
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <zypp/Patch.h>
+#include <zypp/ResObject.h>
+#include <zypp/ResPool.h>
+#include <zypp/SrcPackage.h>
+#include <zypp/base/String.h>
+
+using namespace std;
+using namespace zypp;
+
+string
+zypp_nvra_key (const sat::Solvable &pkg)
+{
+	ostringstream key;
+	key << pkg.name () << '-' << pkg.edition () << '.' << pkg.arch ()
+	    << (isKind<SrcPackage>(pkg) ? ":src" : "");
+	return key.str ();
+}
+
+void
+zypp_subtract_patch_contents (const set<PoolItem> &patches, set<PoolItem> &packages)
+{
+	// Collect what all patches contain, to remove it from
+	// the list of packages in a single pass
+	unordered_multimap<string, sat::Solvable> patched;
+	for (set<PoolItem>::const_iterator ci = patches.begin (); ci != patches.end (); ++ci) {
+		if (!isKind<Patch>(ci->resolvable()))
+			continue;
+
+		Patch::constPtr patch = asKind<Patch>(ci->resolvable());
+		Patch::Contents content(patch->contents());
+		for (sat::SolvableSet::const_iterator pki = content.begin(); pki != content.end(); ++pki)
+			patched.emplace (zypp_nvra_key (*pki), *pki);
+	}
+
+	for (set<PoolItem>::iterator pi = packages.begin (); !patched.empty () && pi != packages.end (); ) {
+		sat::Solvable solvable = pi->satSolvable();
+		bool contained = false;
+
+		if (solvable != sat::Solvable::noSolvable) {
+			auto range = patched.equal_range (zypp_nvra_key (solvable));
+			for (auto it = range.first; !contained && it != range.second; ++it)
+				contained = solvable.identical (it->second);
+		}
+
+		if (contained)
+			pi = packages.erase (pi);
+		else
+			++pi;
+	}
+}
+
+/**
+  * does the comma separated @no_proxy list contain @host or a domain of it
+  */
+static bool
+zypp_host_in_no_proxy (const string &host, const string &no_proxy)
+{
+	vector<string> entries;
+	str::split (no_proxy, back_inserter (entries), ", ");
+
+	for (string entry : entries) {
+		if (entry == "*")
+			return true;
+		if (entry[0] == '.')
+			entry.erase (0, 1);
+		if (entry.empty ())
+			continue;
+		if (host == entry)
+			return true;
+		if (host.size () > entry.size () &&
+		    host.compare (host.size () - entry.size (), entry.size (), entry) == 0 &&
+		    host[host.size () - entry.size () - 1] == '.')
+			return true;
+	}
+	return false;
+}
+
+Url
+zypp_url_with_proxy (const Url &url, const ZyppProxySettings *proxy)
+{
+	Url result (url);
+
+	// local media never go through a proxy, and one set up for the
+	// repository itself wins over the job's
+	if (proxy == NULL || !result.schemeIsDownloading () ||
+	    !result.getQueryParam ("proxy").empty ())
+		return result;
+
+	if (zypp_host_in_no_proxy (result.getHost (), proxy->no_proxy)) {
+		result.setQueryParam ("proxy", "_none_");
+		return result;
+	}
+
+	string value;
+	if (result.getScheme () == "https")
+		value = proxy->https;
+	else if (result.getScheme () == "ftp")
+		value = proxy->ftp;
+	else if (result.getScheme () == "http")
+		value = proxy->http;
+	if (value.empty ())
+		value = proxy->socks;
+	if (value.empty ())
+		return result;
+
+	Url proxyUrl (value);
+	string scheme = proxyUrl.getScheme ();
+	// curl wants to know which version to speak
+	if (scheme == "socks")
+		scheme = "socks5";
+
+	result.setQueryParam ("proxy", scheme + "://" + proxyUrl.getHost ());
+	if (!proxyUrl.getPort ().empty ())
+		result.setQueryParam ("proxyport", proxyUrl.getPort ());
+	if (!proxyUrl.getUsername ().empty ())
+		result.setQueryParam ("proxyuser", proxyUrl.getUsername ());
+	if (!proxyUrl.getPassword ().empty ())
+		result.setQueryParam ("proxypass", proxyUrl.getPassword ());
+
+	return result;
+}
+
+void
+zypp_pool_apply_proxy (const ZyppProxySettings &proxy, ZyppSavedUrls &saved)
+{
+	for (Repository repo : ResPool::instance ().knownRepositories ()) {
+		if (repo.isSystemRepo ())
+			continue;
+
+		RepoInfo info = repo.info ();
+		auto it = saved.find (info.alias ());
+		if (it == saved.end ())
+			it = saved.emplace (info.alias (), info.baseUrls ()).first;
+
+		RepoInfo::url_set urls;
+		for (const Url &url : it->second)
+			urls.push_back (zypp_url_with_proxy (url, &proxy));
+		info.setBaseUrls (urls);
+		repo.setInfo (info);
+	}
+}
+
+void
+zypp_pool_restore_urls (ZyppSavedUrls &saved)
+{
+	for (Repository repo : ResPool::instance ().knownRepositories ()) {
+		auto it = saved.find (repo.alias ());
+		if (it == saved.end ())
+			continue;
+
+		RepoInfo info = repo.info ();
+		info.setBaseUrls (it->second);
+		repo.setInfo (info);
+	}
+	saved.clear ();
+}